@@ -1,5 +1,9 @@
-import { createApp, ref, reactive, computed, onMounted, nextTick } from 'vue';
+import { createApp, ref, reactive, computed, onMounted, nextTick, markRaw } from 'vue';
 import MidiManager from './midi-manager.js';
+import { LogBuffer, visibleRange } from './log-buffer.js';
+
+// 通信ログの行の間隔(px)。style.css の .log-entry の height（22px）に行間の2pxを足した値
+const LOG_ROW_HEIGHT = 24;
 
 createApp({
   setup() {
@@ -9,14 +13,25 @@ createApp({
     const selectedDeviceId = ref('');
     const availableDevices = ref([]);
     const webMidiStatus = ref('Checking...');
-    const logEntries = ref([]);
     const fileInput = ref(null);
     const logContent = ref(null);
+
+    // 通信ログ: エントリはリアクティブにしないリングバッファに追加し、
+    // 画面への反映はアニメーションフレーム毎に1回だけ行う（logVersion を進める）
+    const logBuffer = markRaw(new LogBuffer());
+    const logVersion = ref(0);
+    const logScrollTop = ref(0);
+    const logViewportHeight = ref(300);
+    let logFrameRequested = false;
+    let logDroppedShown = 0;
     
     // Device info
     const deviceInfo = ref(null); // {numSwitches, version}
     const switchConfigurations = ref([]); // Array of switch configurations
     const savedConfigurations = ref([]); // デバイスから読み込んだ設定
+    // 未保存の変更があるイベント（キーは `${switchIdx}_${eventType}`）
+    // 描画毎に全イベントを比較しないよう、編集・読み込み・保存のたびにそのイベントだけ比較して更新する
+    const dirtyEvents = reactive({});
 
     // MIDI Manager instance
     const midiManager = new MidiManager();
@@ -32,14 +47,10 @@ createApp({
 
     // 設定比較の共通ロジック
     const isMessagesChanged = (current, saved) => {
-      console.log('isMessagesChanged:', Array.from(current), Array.from(saved));
       if (!saved || saved.length === 0) {
-        const result = current.length > 0;
-        console.log('  no saved or empty saved, result:', result);
-        return result;
+        return current.length > 0;
       }
       if (current.length !== saved.length) {
-        console.log('  length different:', current.length, 'vs', saved.length);
         return true;
       }
       
@@ -50,39 +61,42 @@ createApp({
             curr.channel !== save.channel ||
             curr.param1 !== save.param1 ||
             curr.param2 !== save.param2) {
-          console.log('  message different at index', i, ':', curr, 'vs', save);
           return true;
         }
       }
-      console.log('  no changes detected');
       return false;
     };
 
-    const hasChanges = computed(() => {
-      if (!switchConfigurations.value.length) return false;
+    // 1つのイベントの変更状態を比較し直す
+    const updateEventDirty = (switchIdx, eventType) => {
+      const switchConfig = switchConfigurations.value[switchIdx];
+      if (!switchConfig) return;
       
+      const savedEvent = savedConfigurations.value[switchIdx]?.[eventType];
+      const key = `${switchIdx}_${eventType}`;
+      if (isMessagesChanged(switchConfig[eventType].messages, savedEvent?.messages)) {
+        dirtyEvents[key] = true;
+      } else {
+        delete dirtyEvents[key];
+      }
+    };
+
+    // 全イベントの変更状態を比較し直す（接続・読み込み時）
+    const updateAllDirty = () => {
+      for (const key of Object.keys(dirtyEvents)) {
+        delete dirtyEvents[key];
+      }
       for (let switchIdx = 0; switchIdx < switchConfigurations.value.length; switchIdx++) {
-        const switchConfig = switchConfigurations.value[switchIdx];
-        const savedConfig = savedConfigurations.value[switchIdx];
-        
-        if (isMessagesChanged(switchConfig.press.messages, savedConfig?.press?.messages) ||
-            isMessagesChanged(switchConfig.release.messages, savedConfig?.release?.messages)) {
-          return true;
-        }
+        updateEventDirty(switchIdx, 'press');
+        updateEventDirty(switchIdx, 'release');
       }
-      return false;
-    });
+    };
+
+    const hasChanges = computed(() => Object.keys(dirtyEvents).length > 0);
 
     // 個別のスイッチ/イベントの変更状態をチェック
     const isEventChanged = (switchIdx, eventType) => {
-      if (switchIdx >= switchConfigurations.value.length) return false;
-      
-      const switchConfig = switchConfigurations.value[switchIdx];
-      const savedConfig = savedConfigurations.value[switchIdx];
-      const event = eventType === 'press' ? switchConfig.press : switchConfig.release;
-      const savedEvent = savedConfig?.[eventType];
-      
-      return isMessagesChanged(event.messages, savedEvent?.messages);
+      return dirtyEvents[`${switchIdx}_${eventType}`] === true;
     };
 
     // スイッチ全体の変更状態をチェック
@@ -90,22 +104,78 @@ createApp({
       return isEventChanged(switchIdx, 'press') || isEventChanged(switchIdx, 'release');
     };
 
-    // Helper functions
-    const log = (message, type = 'info') => {
-      const timestamp = new Date().toLocaleTimeString();
-      logEntries.value.push({
-        id: Date.now() + Math.random(),
-        timestamp,
-        message,
-        type
-      });
-      
-      // Auto-scroll to bottom
+    // 表示中の行だけを取り出す（時刻と16進表記は描く行だけ整形する）
+    const logRows = computed(() => {
+      logVersion.value;   // logBuffer の更新を依存関係にする
+      const { first, last } = visibleRange(logScrollTop.value, logViewportHeight.value, LOG_ROW_HEIGHT, logBuffer.length);
+      return logBuffer.slice(first, last).map((entry, i) => ({
+        id: entry.seq,
+        top: (first + i) * LOG_ROW_HEIGHT,
+        type: entry.type,
+        timestamp: new Date(entry.time).toLocaleTimeString(),
+        message: entry.data ? `${entry.message} [${entry.data.map(b => b.toString(16).padStart(2, '0')).join(' ')}]` : entry.message
+      }));
+    });
+
+    const logStatus = computed(() => {
+      logVersion.value;   // logBuffer の更新を依存関係にする
+      return logBuffer.dropped > 0 ? `last ${logBuffer.length} of ${logBuffer.total}` : `${logBuffer.length}`;
+    });
+
+    const logHeight = computed(() => {
+      logVersion.value;   // logBuffer の更新を依存関係にする
+      return logBuffer.length * LOG_ROW_HEIGHT;
+    });
+
+    // フレーム毎の反映。最下部を表示していれば追従し、そうでなければ古い行が消えた分だけ戻して同じ行を表示し続ける
+    const updateLogView = () => {
+      logFrameRequested = false;
+      const el = logContent.value;
+      const atBottom = !el || el.scrollTop + el.clientHeight >= el.scrollHeight - LOG_ROW_HEIGHT;
+      const shifted = logBuffer.dropped - logDroppedShown;
+      logDroppedShown = logBuffer.dropped;
+      logVersion.value++;
+
       nextTick(() => {
-        if (logContent.value) {
-          logContent.value.scrollTop = logContent.value.scrollHeight;
+        if (!el) return;
+        if (atBottom) {
+          el.scrollTop = el.scrollHeight;
+        } else if (shifted > 0) {
+          el.scrollTop = Math.max(0, el.scrollTop - shifted * LOG_ROW_HEIGHT);
         }
+        logScrollTop.value = el.scrollTop;
+      });
+    };
+
+    const requestLogFrame = () => {
+      if (logFrameRequested) return;
+      logFrameRequested = true;
+      requestAnimationFrame(updateLogView);
+    };
+
+    const onLogScroll = () => {
+      if (logContent.value) {
+        logScrollTop.value = logContent.value.scrollTop;
+      }
+    };
+
+    const clearLog = () => {
+      logBuffer.clear();
+      logDroppedShown = 0;
+      requestLogFrame();
+    };
+
+    // Helper functions
+    // data を渡すと表示時に16進で後ろに付ける（受信の多いMIDIメッセージは追加時に整形しない）
+    const log = (message, type = 'info', data = null) => {
+      logBuffer.push({
+        seq: logBuffer.total,
+        time: Date.now(),
+        message,
+        type,
+        data
       });
+      requestLogFrame();
     };
 
     // スイッチ設定の初期化
@@ -134,14 +204,24 @@ createApp({
           release: { messages: [] }
         });
       }
+      updateAllDirty();
     };
 
     // メッセージタイプの表示名取得
     const getMessageTypeName = (msgType) => {
-      const types = { 0: 'None', 1: 'CC', 2: 'PC', 3: 'Note' };
+      const types = { 0: 'None', 1: 'CC', 2: 'PC', 3: 'Note', 4: 'Key', 5: 'Consumer' };
       return types[msgType] || 'Unknown';
     };
 
+    // HID Consumer の usage は param2 (上位7bit) と param1 (下位7bit) に分割して送る
+    const getConsumerUsage = (msg) => (msg.param2 << 7) | msg.param1;
+
+    const setConsumerUsage = (msg, value) => {
+      const usage = Math.max(0, Math.min(0x3FFF, parseInt(value, 10) || 0));
+      msg.param1 = usage & 0x7F;
+      msg.param2 = usage >> 7;
+    };
+
     // メッセージの表示文字列生成
     const formatMessage = (msg) => {
       const typeName = getMessageTypeName(msg.msgType);
@@ -149,6 +229,11 @@ createApp({
         return `${typeName} Ch${msg.channel + 1}: ${msg.param1}`;
       } else if (msg.msgType === 3) { // Note
         return `${typeName} Ch${msg.channel + 1}: ${msg.param1} Vel${msg.param2}`;
+      } else if (msg.msgType === 4) { // HID Key
+        return `${typeName} ${msg.param2 > 0 ? 'Down' : 'Up'}: ${msg.param1} Mod${msg.channel}`;
+      } else if (msg.msgType === 5) { // HID Consumer
+        const usage = getConsumerUsage(msg);
+        return usage > 0 ? `${typeName}: 0x${usage.toString(16).padStart(3, '0')}` : `${typeName}: Release`;
       } else { // CC
         return `${typeName} Ch${msg.channel + 1}: ${msg.param1}=${msg.param2}`;
       }
@@ -170,6 +255,7 @@ createApp({
         param1: 0,
         param2: 127
       });
+      updateEventDirty(switchIdx, eventType);
     };
 
     // メッセージ削除
@@ -179,6 +265,7 @@ createApp({
       
       if (event.messages.length > 1) {
         event.messages.splice(messageIdx, 1);
+        updateEventDirty(switchIdx, eventType);
       } else {
         log('At least one message is required', 'warning');
       }
@@ -211,6 +298,7 @@ createApp({
       deviceInfo.value = null;
       switchConfigurations.value = [];
       savedConfigurations.value = [];
+      updateAllDirty();
       log('Disconnected', 'success');
     };
 
@@ -220,23 +308,31 @@ createApp({
       
       isLoading.value = true;
       log('Loading all configurations...');
+      const startTime = performance.now();
       
       try {
+        // 全スイッチのPress/Releaseを並行して取得（応答はスイッチ/イベント毎に対応付けられる）
+        const targets = [];
         for (let switchIdx = 0; switchIdx < deviceInfo.value.numSwitches; switchIdx++) {
-          // Press設定取得
-          const pressConfig = await midiManager.getMessages(switchIdx, 0);
-          savedConfigurations.value[switchIdx].press.messages = JSON.parse(JSON.stringify(pressConfig.messages));
-          switchConfigurations.value[switchIdx].press.messages = JSON.parse(JSON.stringify(pressConfig.messages));
-          
-          // Release設定取得
-          const releaseConfig = await midiManager.getMessages(switchIdx, 1);
-          savedConfigurations.value[switchIdx].release.messages = JSON.parse(JSON.stringify(releaseConfig.messages));
-          switchConfigurations.value[switchIdx].release.messages = JSON.parse(JSON.stringify(releaseConfig.messages));
-          
-          log(`Loaded Switch ${switchIdx} configuration`);
+          targets.push({ switchNum: switchIdx, eventType: 0 }, { switchNum: switchIdx, eventType: 1 });
         }
         
-        log('All configurations loaded successfully', 'success');
+        const results = await midiManager.getMessagesBatch(targets, {
+          onRetry: ({ switchNum, eventType, attempt }) => {
+            log(`Retrying Switch ${switchNum} ${eventType === 0 ? 'press' : 'release'} (attempt ${attempt + 1})`, 'warning');
+          }
+        });
+        
+        results.forEach((result, i) => {
+          const { switchNum, eventType } = targets[i];
+          const eventKey = eventType === 0 ? 'press' : 'release';
+          savedConfigurations.value[switchNum][eventKey].messages = JSON.parse(JSON.stringify(result.messages));
+          switchConfigurations.value[switchNum][eventKey].messages = JSON.parse(JSON.stringify(result.messages));
+        });
+        updateAllDirty();
+        
+        const elapsed = Math.round(performance.now() - startTime);
+        log(`All configurations loaded successfully (${targets.length} requests in ${elapsed} ms)`, 'success');
       } catch (error) {
         log(`Failed to load configurations: ${error.message}`, 'error');
       } finally {
@@ -244,11 +340,11 @@ createApp({
       }
     };
 
-    // 設定の保存
+    // 設定の保存（成功したらtrue）
     const saveConfiguration = async (switchIdx, eventType) => {
       if (!isConnected.value) {
         log('Device not connected', 'error');
-        return;
+        return false;
       }
 
       const switchConfig = switchConfigurations.value[switchIdx];
@@ -262,32 +358,64 @@ createApp({
         
         // 保存した設定をsavedに反映（ディープコピー）
         savedConfigurations.value[switchIdx][eventType].messages = JSON.parse(JSON.stringify(event.messages));
+        updateEventDirty(switchIdx, eventType);
         
         log(`Switch ${switchIdx} ${eventType} configuration saved successfully`, 'success');
+        return true;
       } catch (error) {
         log(`Failed to save configuration: ${error.message}`, 'error');
+        return false;
       }
     };
 
-    // 全設定の保存
+    // 変更のあるイベントだけを保存
+    // 1つのトランザクションで送るので、デバイスには全部が一度に反映され、フラッシュへの保存も1回で済む。
+    // どれかが失敗したらトランザクションを捨て、デバイスの設定は変えない
     const saveAllConfigurations = async () => {
       if (!isConnected.value) {
         log('Device not connected', 'error');
         return;
       }
 
-      log('Saving all configurations...');
+      const changed = [];
+      for (let switchIdx = 0; switchIdx < switchConfigurations.value.length; switchIdx++) {
+        for (const eventType of ['press', 'release']) {
+          if (isEventChanged(switchIdx, eventType)) changed.push({ switchIdx, eventType });
+        }
+      }
+      if (changed.length === 0) {
+        log('No changes to save');
+        return;
+      }
+
+      log(`Saving ${changed.length} changed event(s)...`);
+      const startTime = performance.now();
       
+      // 応答（成功/失敗のみ）にはスイッチ番号が入らないので、1つずつ順に送る
       try {
-        for (let switchIdx = 0; switchIdx < switchConfigurations.value.length; switchIdx++) {
-          await saveConfiguration(switchIdx, 'press');
-          await saveConfiguration(switchIdx, 'release');
+        await midiManager.beginTransaction();
+        for (const { switchIdx, eventType } of changed) {
+          const event = switchConfigurations.value[switchIdx][eventType];
+          try {
+            await midiManager.setMessages(switchIdx, eventType === 'press' ? 0 : 1, event.messages);
+          } catch (error) {
+            throw new Error(`Switch ${switchIdx} ${eventType}: ${error.message}`);
+          }
         }
-        
-        log('All configurations saved successfully', 'success');
+        await midiManager.commitTransaction();
       } catch (error) {
-        log(`Failed to save all configurations: ${error.message}`, 'error');
+        await midiManager.rollbackTransaction().catch(() => {});
+        log(`Failed to save changes (nothing was applied): ${error.message}`, 'error');
+        return;
+      }
+
+      for (const { switchIdx, eventType } of changed) {
+        savedConfigurations.value[switchIdx][eventType].messages =
+          JSON.parse(JSON.stringify(switchConfigurations.value[switchIdx][eventType].messages));
+        updateEventDirty(switchIdx, eventType);
       }
+      const elapsed = Math.round(performance.now() - startTime);
+      log(`All changes saved successfully (${changed.length} event(s) in ${elapsed} ms)`, 'success');
     };
 
     // 設定をファイルに保存
@@ -320,6 +448,7 @@ createApp({
           
           if (config.deviceInfo && config.configurations) {
             switchConfigurations.value = config.configurations;
+            updateAllDirty();
             log(`Configuration loaded from file`, 'success');
           } else {
             throw new Error('Invalid configuration file format');
@@ -365,6 +494,7 @@ createApp({
         deviceInfo.value = null;
         switchConfigurations.value = [];
         savedConfigurations.value = [];
+        updateAllDirty();
         log('Device disconnected', 'warning');
       });
 
@@ -373,13 +503,11 @@ createApp({
       });
 
       midiManager.addEventListener('midiMessage', (event) => {
-        const data = event.detail.data;
-        log(`MIDI: [${data.map(b => b.toString(16).padStart(2, '0')).join(' ')}]`, 'midi');
+        log('MIDI:', 'midi', event.detail.data);
       });
 
       midiManager.addEventListener('sysexSent', (event) => {
-        const data = event.detail.data;
-        log(`TX: [${data.map(b => b.toString(16).padStart(2, '0')).join(' ')}]`, 'sysex');
+        log('TX:', 'sysex', event.detail.data);
       });
     };
 
@@ -402,6 +530,12 @@ createApp({
     };
 
     onMounted(() => {
+      // 表示する行数はログ欄の高さで決まる
+      if (logContent.value) {
+        new ResizeObserver(() => {
+          logViewportHeight.value = logContent.value.clientHeight;
+        }).observe(logContent.value);
+      }
       initialize();
     });
 
@@ -412,7 +546,6 @@ createApp({
       selectedDeviceId,
       availableDevices,
       webMidiStatus,
-      logEntries,
       fileInput,
       logContent,
       deviceInfo,
@@ -421,6 +554,9 @@ createApp({
       
       // Computed
       connectionStatusText,
+      logRows,
+      logStatus,
+      logHeight,
       hasChanges,
       
       // Methods
@@ -435,8 +571,13 @@ createApp({
       removeMessage,
       formatMessage,
       getMessageTypeName,
+      getConsumerUsage,
+      setConsumerUsage,
       isEventChanged,
       isSwitchChanged,
+      updateEventDirty,
+      onLogScroll,
+      clearLog,
       log
     };
   }
@@ -0,0 +1,175 @@
+#!/usr/bin/env node
+/**
+ * PicoMIDI Switch provisioning CLI
+ *
+ * 設定ツールと同じMidiManager（SysExプロトコル）を使い、複数のデバイスへ並行して設定を読み書きする。
+ *
+ * usage: picomidi-cli.js <command> [options] -d <transport> [-d <transport> ...]
+ *   list                       rawmidiデバイスの一覧
+ *   read -o <file>             設定をファイルに保存（デバイスが複数なら {n} を番号に置き換える）
+ *   write <file>               ファイルの設定を書き込み、読み直して確かめる（違う項目だけ送る）
+ *   verify <file>              デバイスの設定がファイルと同じか確かめる
+ *   ping [-c <count>]          GET_INFOの往復時間
+ *   record -o <file>           フライトレコーダを止めて記録をファイルに保存し、記録を再開する
+ *
+ * transport: rawmidi:/dev/snd/midiC1D0 または module:<path>[:arg]（transports.js）
+ */
+
+import fs from 'node:fs';
+import { parseArgs } from 'node:util';
+import MidiManager from '../midi-manager.js';
+import { openTransport, listRawMidi } from './transports.js';
+import { validateProfile, readDevice, writeDevice, verifyDevice, ping } from './provision.js';
+
+const USAGE = `usage: picomidi-cli.js <list|read|write|verify|ping|record> [options]
+  -d, --device <transport>   rawmidi:/dev/snd/midiC1D0 or module:<path>[:arg] (repeatable)
+  -o, --output <file>        read, record: output file ({n} = device number)
+  -c, --count <n>            ping: number of round trips (default 20)
+  -t, --timeout <ms>         response timeout (default 2000)
+  -q, --quiet                print only the summary`;
+
+const loadProfile = (file) => validateProfile(JSON.parse(fs.readFileSync(file, 'utf8')));
+
+const formatMs = (ms) => `${ms.toFixed(2)} ms`;
+
+// 1台分の処理。結果の行を返し、失敗したら例外を投げる
+const runDevice = async (command, spec, index, options, profile) => {
+  const transport = await openTransport(spec);
+  const manager = new MidiManager();
+  manager.responseTimeout = options.timeout;
+
+  let lastError = null;
+  manager.addEventListener('error', (event) => {
+    lastError = event.detail.message;
+  });
+
+  try {
+    if (!await manager.connectPorts(transport.input, transport.output)) {
+      throw new Error(lastError ?? 'connect failed');
+    }
+
+    switch (command) {
+    case 'read': {
+      const config = await readDevice(manager);
+      const file = options.output.replaceAll('{n}', String(index));
+      fs.writeFileSync(file, JSON.stringify(config, null, 2) + '\n');
+      return `${config.configurations.length} switches -> ${file}`;
+    }
+
+    case 'write': {
+      const start = performance.now();
+      const writes = await writeDevice(manager, profile);
+      const differences = await verifyDevice(manager, profile);
+      if (differences.length) {
+        throw new Error(`verify failed after write: ${differences.join(', ')}`);
+      }
+      return `${writes} change(s) written and verified in ${formatMs(performance.now() - start)}`;
+    }
+
+    case 'verify': {
+      const differences = await verifyDevice(manager, profile);
+      if (differences.length) {
+        throw new Error(`differs: ${differences.join(', ')}`);
+      }
+      return 'matches';
+    }
+
+    case 'record': {
+      // 読む間に上書きされないよう止めてから読む（異常で止まっていればその理由が残る）
+      await manager.setFlightRecorder(true);
+      const record = await manager.getFlightRecord();
+      const file = options.output.replaceAll('{n}', String(index));
+      fs.writeFileSync(file, JSON.stringify(record, null, 2) + '\n');
+      await manager.setFlightRecorder(false);
+      const trigger = record.trigger === null ? '' : ` at entry ${record.trigger}`;
+      return `${record.entries.length} entries (${record.reason ?? 'running'}${trigger}) -> ${file}`;
+    }
+
+    case 'ping': {
+      const r = await ping(manager, options.count);
+      return `${r.count} pings: min ${formatMs(r.min)} avg ${formatMs(r.avg)} ` +
+        `p50 ${formatMs(r.p50)} p99 ${formatMs(r.p99)} max ${formatMs(r.max)}`;
+    }
+    }
+    throw new Error(`unknown command '${command}'`);
+  } finally {
+    manager.disconnect();
+    await transport.close();
+  }
+};
+
+const main = async () => {
+  const { values, positionals } = parseArgs({
+    allowPositionals: true,
+    options: {
+      device: { type: 'string', short: 'd', multiple: true, default: [] },
+      output: { type: 'string', short: 'o' },
+      count: { type: 'string', short: 'c', default: '20' },
+      timeout: { type: 'string', short: 't', default: '2000' },
+      quiet: { type: 'boolean', short: 'q', default: false },
+      help: { type: 'boolean', short: 'h', default: false }
+    }
+  });
+  const [command, file] = positionals;
+
+  if (values.help || !command) {
+    console.log(USAGE);
+    return command || values.help ? 0 : 2;
+  }
+
+  if (command === 'list') {
+    for (const { spec, name } of listRawMidi()) {
+      console.log(`${spec}\t${name}`);
+    }
+    return 0;
+  }
+
+  const options = {
+    output: values.output,
+    count: Math.max(1, parseInt(values.count, 10) || 1),
+    timeout: Math.max(1, parseInt(values.timeout, 10) || 2000)
+  };
+  const devices = values.device;
+  if (devices.length === 0) {
+    console.error('no device (-d rawmidi:/dev/snd/midiC1D0)');
+    return 2;
+  }
+  if ((command === 'read' || command === 'record') && (!options.output || (devices.length > 1 && !options.output.includes('{n}')))) {
+    console.error(`${command} needs -o <file> ({n} is required for several devices)`);
+    return 2;
+  }
+
+  let profile = null;
+  if (command === 'write' || command === 'verify') {
+    if (!file) {
+      console.error(`${command} needs a config file`);
+      return 2;
+    }
+    try {
+      profile = loadProfile(file);
+    } catch (error) {
+      console.error(`${file}: ${error.message}`);
+      return 2;
+    }
+  }
+
+  // 全デバイスを並行して処理する
+  const start = performance.now();
+  const results = await Promise.allSettled(
+    devices.map((spec, index) => runDevice(command, spec, index, options, profile)));
+
+  let failed = 0;
+  results.forEach((result, index) => {
+    if (result.status === 'fulfilled') {
+      if (!values.quiet) console.log(`[${index}] ${devices[index]}: ${result.value}`);
+    } else {
+      failed++;
+      console.error(`[${index}] ${devices[index]}: ${result.reason.message}`);
+    }
+  });
+  console.log(`${command}: ${devices.length - failed}/${devices.length} device(s) ok in ` +
+    `${formatMs(performance.now() - start)}`);
+  return failed ? 1 : 0;
+};
+
+process.exitCode = await main();
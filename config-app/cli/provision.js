@@ -0,0 +1,306 @@
+/**
+ * 設定ファイル（設定ツールの「Save to File」と同じ形）とデバイスの間の読み書き
+ *
+ * ファイルの形は tools/default_config.py のプロファイルと同じで、configurations 以外は省略できる。
+ * 書き込みでは省略した項目はデバイスのまま残し、デバイスと違う項目だけを送る。
+ * 送る項目は1つのトランザクションにまとめるので、デバイスには全部が一度に反映され、フラッシュへの保存も1回で済む。
+ */
+
+const MAX_SWITCHES = 16;
+const MAX_MESSAGES_PER_EVENT = 10;
+const MAX_FEEDBACK_MAPS = 32;
+const MAX_EXCLUSIVE_GROUPS = 8;
+const PIXEL_STATE_COUNT = 6;
+const PIXEL_STATE_HOST_1 = 2;
+const FEEDBACK_CHANNEL_NONE = 0x7F;
+const EVENT_TYPES = ['press', 'release'];
+
+const checkRange = (value, low, high, what) => {
+  if (!Number.isInteger(value) || value < low || value > high) {
+    throw new Error(`${what}: ${JSON.stringify(value)} is not in ${low}-${high}`);
+  }
+};
+
+/**
+ * 設定ファイルの形と値の範囲を確認する（予約ピンなどはデバイスが確認する）
+ */
+export const validateProfile = (profile) => {
+  const configurations = profile?.configurations;
+  if (!Array.isArray(configurations) || configurations.length < 1 || configurations.length > MAX_SWITCHES) {
+    throw new Error(`configurations: 1-${MAX_SWITCHES} switches required`);
+  }
+  configurations.forEach((sw, i) => {
+    for (const eventType of EVENT_TYPES) {
+      const what = `configurations[${i}].${eventType}`;
+      const messages = sw?.[eventType]?.messages ?? [];
+      if (!Array.isArray(messages) || messages.length > MAX_MESSAGES_PER_EVENT) {
+        throw new Error(`${what}: up to ${MAX_MESSAGES_PER_EVENT} messages`);
+      }
+      messages.forEach((msg, j) => {
+        checkRange(msg.msgType, 0, 5, `${what}.messages[${j}].msgType`);
+        for (const key of ['channel', 'param1', 'param2']) {
+          checkRange(msg[key] ?? 0, 0, 127, `${what}.messages[${j}].${key}`);
+        }
+      });
+    }
+  });
+
+  if ('pinMap' in profile) {
+    if (!Array.isArray(profile.pinMap) || profile.pinMap.length !== configurations.length) {
+      throw new Error(`pinMap: ${configurations.length} pins required`);
+    }
+    profile.pinMap.forEach(pin => checkRange(pin, 0, 29, 'pinMap'));
+  }
+  if ('pixelColors' in profile) {
+    if (!Array.isArray(profile.pixelColors) || profile.pixelColors.length !== PIXEL_STATE_COUNT) {
+      throw new Error(`pixelColors: ${PIXEL_STATE_COUNT} colors required`);
+    }
+    profile.pixelColors.forEach((rgb, i) => {
+      if (!Array.isArray(rgb) || rgb.length !== 3) throw new Error(`pixelColors[${i}]: [r, g, b] required`);
+      rgb.forEach(c => checkRange(c, 0, 127, `pixelColors[${i}]`));
+    });
+  }
+  if ('feedbackChannel' in profile && profile.feedbackChannel !== FEEDBACK_CHANNEL_NONE) {
+    checkRange(profile.feedbackChannel, 0, 15, 'feedbackChannel');
+  }
+  if ('feedbackMaps' in profile) {
+    if (!Array.isArray(profile.feedbackMaps) || profile.feedbackMaps.length > MAX_FEEDBACK_MAPS) {
+      throw new Error(`feedbackMaps: up to ${MAX_FEEDBACK_MAPS} entries`);
+    }
+    profile.feedbackMaps.forEach((map, i) => {
+      for (const key of ['msgType', 'number', 'switchNum', 'state']) {
+        checkRange(map?.[key], 0, 127, `feedbackMaps[${i}].${key}`);
+      }
+    });
+  }
+  if ('exclusiveGroups' in profile) {
+    if (!Array.isArray(profile.exclusiveGroups) || profile.exclusiveGroups.length > MAX_EXCLUSIVE_GROUPS) {
+      throw new Error(`exclusiveGroups: up to ${MAX_EXCLUSIVE_GROUPS} groups`);
+    }
+    profile.exclusiveGroups.forEach((group, i) => {
+      if (!Array.isArray(group) || group.length < 2 || new Set(group).size !== group.length) {
+        throw new Error(`exclusiveGroups[${i}]: 2 or more different switches required`);
+      }
+      group.forEach(sw => checkRange(sw, 0, configurations.length - 1, `exclusiveGroups[${i}]`));
+    });
+  }
+  return profile;
+};
+
+const normalizeMessage = ({ msgType, channel = 0, param1 = 0, param2 = 0 }) => ({ msgType, channel, param1, param2 });
+
+const sameMessages = (a, b) => JSON.stringify(a.map(normalizeMessage)) === JSON.stringify(b.map(normalizeMessage));
+
+const sameFeedbackMap = (a, b) =>
+  a.msgType === b.msgType && (a.msgType === 0 ||
+    (a.number === b.number && a.switchNum === b.switchNum && a.state === b.state));
+
+const sameGroup = (a, b) => JSON.stringify([...a].sort((x, y) => x - y)) === JSON.stringify([...b].sort((x, y) => x - y));
+
+const eventTargets = (numSwitches) => {
+  const targets = [];
+  for (let switchNum = 0; switchNum < numSwitches; switchNum++) {
+    targets.push({ switchNum, eventType: 0 }, { switchNum, eventType: 1 });
+  }
+  return targets;
+};
+
+const readFeedbackMaps = async (manager) => {
+  const maps = [];
+  for (let i = 0; i < MAX_FEEDBACK_MAPS; i++) {
+    maps.push(await manager.getFeedbackMap(i));
+  }
+  return maps;
+};
+
+/**
+ * デバイスの設定をすべて読み出す
+ */
+export const readDevice = async (manager) => {
+  const info = await manager.getDeviceInfo();
+  const results = await manager.getMessagesBatch(eventTargets(info.numSwitches));
+  const configurations = [];
+  for (let i = 0; i < info.numSwitches; i++) {
+    configurations.push({
+      press: { messages: results[i * 2].messages },
+      release: { messages: results[i * 2 + 1].messages }
+    });
+  }
+
+  const colors = await manager.getPixelColors();
+  const maps = await readFeedbackMaps(manager);
+
+  return {
+    deviceInfo: info,
+    configurations,
+    pinMap: await manager.getPinMap(),
+    pixelColors: colors.map(({ r, g, b }) => [r, g, b]),
+    feedbackChannel: maps[0].channel,
+    feedbackMaps: maps
+      .filter(map => map.msgType !== 0)
+      .map(({ msgType, number, switchNum, state }) => ({ msgType, number, switchNum, state })),
+    exclusiveGroups: (await manager.getExclusiveGroups()).filter(group => group.length > 0)
+  };
+};
+
+/**
+ * 設定ファイルの内容をデバイスに書き込む（違う項目だけ、1つのトランザクションで）
+ * 途中でエラーになればトランザクションを捨てるので、デバイスの設定は変わらない
+ * @returns {number} 送ったSET系コマンドの数（0でなければデバイスでのフラッシュ書き込みは1回）
+ */
+export const writeDevice = async (manager, profile) => {
+  await manager.beginTransaction();
+  let writes;
+  try {
+    writes = await writeChanges(manager, profile);
+  } catch (error) {
+    await manager.rollbackTransaction().catch(() => {});
+    throw error;
+  }
+  if (writes > 0) {
+    await manager.commitTransaction();
+  } else {
+    await manager.rollbackTransaction();
+  }
+  return writes;
+};
+
+// トランザクションの中で違う項目を送る（読み出しも作業領域を読むので、ピン割り当ての後のスイッチ数が見える）
+const writeChanges = async (manager, profile) => {
+  let writes = 0;
+
+  // ピン割り当てでスイッチ数が変わるので最初に書く
+  if (profile.pinMap) {
+    const pins = await manager.getPinMap();
+    if (JSON.stringify(pins) !== JSON.stringify(profile.pinMap)) {
+      await manager.setPinMap(profile.pinMap);
+      writes++;
+    }
+  }
+
+  const info = await manager.getDeviceInfo();
+  manager.deviceInfo = info;
+  if (info.numSwitches !== profile.configurations.length) {
+    throw new Error(`device has ${info.numSwitches} switches but the file has ${profile.configurations.length} (add pinMap)`);
+  }
+
+  const targets = eventTargets(info.numSwitches);
+  const current = await manager.getMessagesBatch(targets);
+  for (let i = 0; i < targets.length; i++) {
+    const { switchNum, eventType } = targets[i];
+    const messages = profile.configurations[switchNum][EVENT_TYPES[eventType]]?.messages ?? [];
+    if (!sameMessages(current[i].messages, messages)) {
+      await manager.setMessages(switchNum, eventType, messages.map(normalizeMessage));
+      writes++;
+    }
+  }
+
+  if (profile.pixelColors) {
+    const colors = await manager.getPixelColors();
+    for (let state = 0; state < profile.pixelColors.length; state++) {
+      const [r, g, b] = profile.pixelColors[state];
+      const color = colors[state];
+      if (!color || color.r !== r || color.g !== g || color.b !== b) {
+        await manager.setPixelColor(state, r, g, b);
+        writes++;
+      }
+    }
+  }
+
+  if ('feedbackChannel' in profile || profile.feedbackMaps) {
+    const maps = await readFeedbackMaps(manager);
+    if ('feedbackChannel' in profile && maps[0].channel !== profile.feedbackChannel) {
+      await manager.setFeedbackChannel(profile.feedbackChannel);
+      writes++;
+    }
+    if (profile.feedbackMaps) {
+      for (let i = 0; i < MAX_FEEDBACK_MAPS; i++) {
+        // 未使用の割り当てもstateはHOST_1以上でないとデバイスが断る
+        const wanted = profile.feedbackMaps[i] ?? { msgType: 0, number: 0, switchNum: 0, state: PIXEL_STATE_HOST_1 };
+        if (!sameFeedbackMap(maps[i], wanted)) {
+          await manager.setFeedbackMap(i, wanted);
+          writes++;
+        }
+      }
+    }
+  }
+
+  if (profile.exclusiveGroups) {
+    const groups = await manager.getExclusiveGroups();
+    for (let i = 0; i < MAX_EXCLUSIVE_GROUPS; i++) {
+      const wanted = profile.exclusiveGroups[i] ?? [];
+      if (!sameGroup(groups[i] ?? [], wanted)) {
+        await manager.setExclusiveGroup(i, wanted);
+        writes++;
+      }
+    }
+  }
+
+  return writes;
+};
+
+/**
+ * デバイスの設定が設定ファイルと同じか確かめる（ファイルにある項目だけ）
+ * @returns {string[]} 違いの一覧（空なら一致）
+ */
+export const verifyDevice = async (manager, profile) => {
+  const device = await readDevice(manager);
+  const differences = [];
+
+  if (device.configurations.length !== profile.configurations.length) {
+    differences.push(`numSwitches: device ${device.configurations.length}, file ${profile.configurations.length}`);
+  } else {
+    profile.configurations.forEach((sw, i) => {
+      for (const eventType of EVENT_TYPES) {
+        if (!sameMessages(device.configurations[i][eventType].messages, sw[eventType]?.messages ?? [])) {
+          differences.push(`configurations[${i}].${eventType}`);
+        }
+      }
+    });
+  }
+  if (profile.pinMap && JSON.stringify(device.pinMap) !== JSON.stringify(profile.pinMap)) {
+    differences.push(`pinMap: device [${device.pinMap}], file [${profile.pinMap}]`);
+  }
+  if (profile.pixelColors && JSON.stringify(device.pixelColors) !== JSON.stringify(profile.pixelColors)) {
+    differences.push('pixelColors');
+  }
+  if ('feedbackChannel' in profile && device.feedbackChannel !== profile.feedbackChannel) {
+    differences.push(`feedbackChannel: device ${device.feedbackChannel}, file ${profile.feedbackChannel}`);
+  }
+  if (profile.feedbackMaps) {
+    const wanted = profile.feedbackMaps.filter(map => map.msgType !== 0);
+    if (wanted.length !== device.feedbackMaps.length ||
+        wanted.some((map, i) => !sameFeedbackMap(device.feedbackMaps[i], map))) {
+      differences.push('feedbackMaps');
+    }
+  }
+  if (profile.exclusiveGroups &&
+      (profile.exclusiveGroups.length !== device.exclusiveGroups.length ||
+       profile.exclusiveGroups.some((group, i) => !sameGroup(device.exclusiveGroups[i], group)))) {
+    differences.push('exclusiveGroups');
+  }
+  return differences;
+};
+
+/**
+ * GET_INFOの往復時間を測る
+ * @returns {{count, min, avg, p50, p99, max}} ミリ秒
+ */
+export const ping = async (manager, count) => {
+  const times = [];
+  for (let i = 0; i < count; i++) {
+    const start = performance.now();
+    await manager.getDeviceInfo();
+    times.push(performance.now() - start);
+  }
+  times.sort((a, b) => a - b);
+  const percentile = (p) => times[Math.min(times.length - 1, Math.ceil(times.length * p / 100) - 1)];
+  return {
+    count,
+    min: times[0],
+    avg: times.reduce((sum, t) => sum + t, 0) / times.length,
+    p50: percentile(50),
+    p99: percentile(99),
+    max: times[times.length - 1]
+  };
+};
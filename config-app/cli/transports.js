@@ -0,0 +1,158 @@
+/**
+ * CLIのトランスポート層
+ *
+ * トランスポートはWebMIDIのポートと同じ形の {name, input, output, close()} を返す。
+ * input.onmidimessage に {data: Uint8Array} で1メッセージずつ渡し、output.send(bytes) で送る。
+ * MidiManager.connectPorts() にそのまま渡せる。
+ *
+ * 指定方法:
+ *   rawmidi:/dev/snd/midiC1D0   ALSAのrawmidiデバイス（Linux、追加のパッケージ不要）
+ *   module:./my-transport.js[:arg]
+ *                               open(arg) をdefault exportするモジュール（テスト用の仮想デバイスなど）
+ */
+
+import fs from 'node:fs';
+import path from 'node:path';
+import { pathToFileURL } from 'node:url';
+
+// ステータスバイト毎のデータバイト数（0xF0-0xF7はSysEx/システムコモン）
+const dataLength = (status) => {
+  if (status >= 0xF8) return 0;
+  switch (status & 0xF0) {
+  case 0xC0:
+  case 0xD0:
+    return 1;
+  case 0xF0:
+    return status === 0xF1 || status === 0xF3 ? 1 : status === 0xF2 ? 2 : 0;
+  default:
+    return 2;
+  }
+};
+
+/**
+ * バイト列をMIDIメッセージに区切る（ランニングステータス・SysEx中のリアルタイムメッセージに対応）
+ */
+export class MidiStreamParser {
+  constructor(onMessage) {
+    this.onMessage = onMessage;
+    this.sysex = null;
+    this.status = 0;
+    this.data = [];
+  }
+
+  push(bytes) {
+    for (const byte of bytes) {
+      if (byte >= 0xF8) {
+        this.onMessage(Uint8Array.of(byte));
+      } else if (byte === 0xF0) {
+        this.sysex = [byte];
+      } else if (byte === 0xF7) {
+        if (this.sysex) {
+          this.sysex.push(byte);
+          this.onMessage(Uint8Array.from(this.sysex));
+          this.sysex = null;
+        }
+      } else if (byte & 0x80) {
+        this.sysex = null;
+        this.status = byte;
+        this.data = [];
+        if (dataLength(byte) === 0) this.onMessage(Uint8Array.of(byte));
+      } else if (this.sysex) {
+        this.sysex.push(byte);
+      } else if (this.status) {
+        this.data.push(byte);
+        if (this.data.length === dataLength(this.status)) {
+          this.onMessage(Uint8Array.from([this.status, ...this.data]));
+          this.data = [];
+        }
+      }
+    }
+  }
+}
+
+/**
+ * ALSAのrawmidiデバイスを開く
+ */
+export const openRawMidi = async (devicePath) => {
+  const handle = await fs.promises.open(devicePath, 'r+');
+  const input = { name: devicePath, onmidimessage: null };
+  const parser = new MidiStreamParser((data) => {
+    if (input.onmidimessage) input.onmidimessage({ data });
+  });
+
+  const stream = handle.createReadStream({ autoClose: false });
+  stream.on('data', (chunk) => parser.push(chunk));
+  stream.on('error', () => {});
+
+  // 送信は順序を保つため直列にする
+  let writing = Promise.resolve();
+  const output = {
+    name: devicePath,
+    send(bytes) {
+      const buffer = Buffer.from(bytes);
+      writing = writing.then(() => handle.write(buffer)).catch(() => {});
+    }
+  };
+
+  return {
+    name: devicePath,
+    input,
+    output,
+    async close() {
+      await writing;
+      stream.destroy();
+      await handle.close();
+    }
+  };
+};
+
+/**
+ * rawmidiデバイスの一覧（/dev/snd/midiC*D* とカード名）
+ */
+export const listRawMidi = () => {
+  let entries = [];
+  try {
+    entries = fs.readdirSync('/dev/snd').filter(name => /^midiC\d+D\d+$/.test(name));
+  } catch {
+    return [];
+  }
+  return entries.sort().map(name => {
+    const card = name.match(/^midiC(\d+)/)[1];
+    let cardName = '';
+    try {
+      cardName = fs.readFileSync(`/proc/asound/card${card}/id`, 'utf8').trim();
+    } catch {
+      // カード名が取れなくてもデバイスは使える
+    }
+    return { spec: `rawmidi:/dev/snd/${name}`, name: cardName };
+  });
+};
+
+/**
+ * 指定からトランスポートを開く
+ */
+export const openTransport = async (spec) => {
+  const separator = spec.indexOf(':');
+  const kind = separator < 0 ? spec : spec.slice(0, separator);
+  const rest = separator < 0 ? '' : spec.slice(separator + 1);
+
+  switch (kind) {
+  case 'rawmidi':
+    return openRawMidi(rest);
+
+  case 'module': {
+    // module:<path>[:arg]（Windowsのドライブ文字は考えない）
+    const argIndex = rest.indexOf(':');
+    const modulePath = argIndex < 0 ? rest : rest.slice(0, argIndex);
+    const arg = argIndex < 0 ? undefined : rest.slice(argIndex + 1);
+    const module = await import(pathToFileURL(path.resolve(modulePath)).href);
+    if (typeof module.default !== 'function') {
+      throw new Error(`${modulePath}: default export must be open(arg)`);
+    }
+    return module.default(arg);
+  }
+
+  default:
+    throw new Error(`Unknown transport '${kind}' (rawmidi:<path> or module:<path>[:arg])`);
+  }
+};
@@ -27,5 +27,14 @@ export default [
       "quotes": ["error", "single"],
       "indent": ["error", 2]
     }
+  },
+  {
+    // provisioning CLI and device simulator (Node.js)
+    files: ["cli/**/*.js", "sim/**/*.js"],
+    languageOptions: {
+      globals: {
+        ...globals.node
+      }
+    }
   }
 ];
\ No newline at end of file
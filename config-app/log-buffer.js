@@ -0,0 +1,65 @@
+/**
+ * Log Buffer - 通信ログの固定容量リングバッファと表示範囲の計算
+ *
+ * 容量を超えると古いエントリから上書きするので、長時間の受信でもメモリと描画量が増えない。
+ * 追加はO(1)で、画面への反映（requestAnimationFrame毎）と表示する行の取り出しは app.js が行う。
+ */
+
+export const LOG_CAPACITY = 5000;     // 保持するエントリ数
+export const LOG_OVERSCAN = 10;       // スクロール中の空白を防ぐため表示範囲の前後に余分に描く行数
+
+export class LogBuffer {
+  constructor(capacity = LOG_CAPACITY) {
+    this.capacity = capacity;
+    this.entries = new Array(capacity);
+    this.start = 0;         // 最も古いエントリの位置
+    this.length = 0;
+    this.total = 0;         // これまでに追加した数（上書きされた分を含む）
+  }
+
+  push(entry) {
+    if (this.length < this.capacity) {
+      this.entries[(this.start + this.length) % this.capacity] = entry;
+      this.length++;
+    } else {
+      this.entries[this.start] = entry;
+      this.start = (this.start + 1) % this.capacity;
+    }
+    this.total++;
+  }
+
+  // i番目（0が最も古い）のエントリ
+  at(i) {
+    return this.entries[(this.start + i) % this.capacity];
+  }
+
+  slice(begin, end) {
+    const result = [];
+    for (let i = Math.max(0, begin); i < Math.min(end, this.length); i++) {
+      result.push(this.at(i));
+    }
+    return result;
+  }
+
+  clear() {
+    this.entries = new Array(this.capacity);
+    this.start = 0;
+    this.length = 0;
+    this.total = 0;
+  }
+
+  // 上書きで失われた数
+  get dropped() {
+    return this.total - this.length;
+  }
+}
+
+/**
+ * スクロール位置から描く行の範囲を求める（行の高さは固定）
+ * @returns {{first, last}} 描く行 [first, last)
+ */
+export const visibleRange = (scrollTop, viewportHeight, rowHeight, count, overscan = LOG_OVERSCAN) => {
+  const first = Math.max(0, Math.floor(scrollTop / rowHeight) - overscan);
+  const last = Math.min(count, Math.ceil((scrollTop + viewportHeight) / rowHeight) + overscan);
+  return { first, last: Math.max(first, last) };
+};
@@ -0,0 +1,52 @@
+/**
+ * 通信ログのリングバッファと表示範囲の検査（node --test）
+ */
+
+import { test } from 'node:test';
+import assert from 'node:assert/strict';
+
+import { LogBuffer, visibleRange } from './log-buffer.js';
+
+test('keeps the newest entries in order when full', () => {
+  const buffer = new LogBuffer(4);
+  for (let i = 0; i < 10; i++) {
+    buffer.push(i);
+  }
+  assert.equal(buffer.length, 4);
+  assert.equal(buffer.total, 10);
+  assert.equal(buffer.dropped, 6);
+  assert.deepEqual(buffer.slice(0, 4), [6, 7, 8, 9]);
+  assert.deepEqual(buffer.slice(-2, 2), [6, 7]);
+  assert.deepEqual(buffer.slice(3, 100), [9]);
+
+  buffer.clear();
+  assert.equal(buffer.length, 0);
+  assert.deepEqual(buffer.slice(0, 4), []);
+  buffer.push('a');
+  assert.deepEqual(buffer.slice(0, 1), ['a']);
+});
+
+test('draws only the rows around the viewport', () => {
+  assert.deepEqual(visibleRange(0, 300, 24, 0), { first: 0, last: 0 });
+  assert.deepEqual(visibleRange(0, 300, 24, 5), { first: 0, last: 5 });
+  assert.deepEqual(visibleRange(0, 300, 24, 1000, 0), { first: 0, last: 13 });
+  assert.deepEqual(visibleRange(2400, 300, 24, 1000, 10), { first: 90, last: 123 });
+  assert.deepEqual(visibleRange(24 * 995, 300, 24, 1000, 10), { first: 985, last: 1000 });
+});
+
+test('stays bounded under a message flood', () => {
+  const buffer = new LogBuffer();
+  const data = [0xB0, 0x07, 0x40];
+  const start = performance.now();
+  for (let i = 0; i < 200000; i++) {
+    buffer.push({ seq: buffer.total, time: 0, message: 'MIDI:', type: 'midi', data });
+  }
+  const elapsed = performance.now() - start;
+
+  assert.equal(buffer.length, buffer.capacity);
+  assert.equal(buffer.at(buffer.length - 1).seq, 199999);
+  // 描くのは画面の行だけ
+  const { first, last } = visibleRange(buffer.length * 24 - 300, 300, 24, buffer.length);
+  assert.ok(last - first <= 30);
+  assert.ok(elapsed < 500, `200000 entries in ${elapsed.toFixed(1)} ms`);
+});
@@ -7,6 +7,37 @@
 const SYSEX_CMD_GET_INFO = 0x01;      // スイッチ数やバージョンを返す
 const SYSEX_CMD_GET_MESSAGE = 0x02;   // 特定のスイッチの設定を取得
 const SYSEX_CMD_SET_MESSAGE = 0x03;   // 特定のスイッチの設定をセット
+const SYSEX_CMD_GET_PIXEL_COLORS = 0x04; // WS2812の状態別カラーを取得
+const SYSEX_CMD_SET_PIXEL_COLOR = 0x05;  // WS2812の状態別カラーをセット
+const SYSEX_CMD_GET_FEEDBACK_MAP = 0x06; // ホストフィードバックの割り当てを取得
+const SYSEX_CMD_SET_FEEDBACK_MAP = 0x07; // ホストフィードバックの割り当てをセット
+const SYSEX_CMD_SET_FEEDBACK_CHANNEL = 0x08; // ホストフィードバックの受信チャンネルをセット
+const SYSEX_CMD_GET_PIN_MAP = 0x09;   // スイッチのピン割り当てを取得
+const SYSEX_CMD_SET_PIN_MAP = 0x0A;   // スイッチのピン割り当てをセット
+const SYSEX_CMD_GET_BOOT_TIMES = 0x0B; // 起動の各段階の時刻を取得
+const SYSEX_CMD_GET_DEBOUNCE = 0x0C;  // スイッチの受け付け窓とチャタリングのヒストグラムを取得
+const SYSEX_CMD_GET_FLIGHT_RECORD = 0x0D;   // フライトレコーダの記録を取得
+const SYSEX_CMD_SET_FLIGHT_RECORDER = 0x0E; // フライトレコーダの再開/停止
+const SYSEX_CMD_BEGIN_TRANSACTION = 0x0F;    // 以後の設定を作業領域にためる
+const SYSEX_CMD_COMMIT_TRANSACTION = 0x10;   // ためた設定をまとめて反映・保存
+const SYSEX_CMD_ROLLBACK_TRANSACTION = 0x11; // ためた設定を捨てる
+const SYSEX_CMD_GET_EXCLUSIVE_GROUPS = 0x12; // 排他グループのメンバーを取得
+const SYSEX_CMD_SET_EXCLUSIVE_GROUP = 0x13;  // 排他グループのメンバーをセット
+
+// GET_BOOT_TIMESの段階（応答の順）
+const BOOT_PHASES = ['start', 'usbInit', 'configLoaded', 'ready', 'mounted', 'configSaved'];
+const BOOT_TIME_NONE = 0x0FFFFFFF;
+
+// GET_FLIGHT_RECORDの止めた理由と記録の種類
+const FLIGHT_REASONS = [null, 'retrigger', 'queueFull', 'host'];
+const FLIGHT_INDEX_NONE = 0x3FFF;
+const FLIGHT_ENTRY_SIZE = 8;
+
+// 一括読み込み（getMessagesBatch）の既定値
+// デバイスは応答を送り終えるまで次のリクエストを読まないので、応答待ちを増やしすぎても速くならない
+const BATCH_WINDOW = 4;          // 同時に応答待ちにするリクエスト数
+const BATCH_RETRIES = 2;         // タイムアウトしたリクエストを送り直す回数
+const BATCH_TIMEOUT = 250;       // 1リクエストの応答待ち(ms)
 
 class MidiManager extends EventTarget {
   constructor() {
@@ -114,6 +145,22 @@ class MidiManager extends EventTarget {
         throw new Error('Corresponding output device not found');
       }
 
+      return await this.connectPorts(input, output);
+    } catch (error) {
+      this.dispatchEvent(new CustomEvent('error', { 
+        detail: { message: `Failed to connect: ${error.message}` }
+      }));
+      return false;
+    }
+  }
+
+  /**
+   * 入出力ポートを指定して接続する
+   * WebMIDIのポートのほか、同じ形のもの（inputはonmidimessageに{data}を渡し、outputはsend(bytes)を持つ）
+   * を渡せば、Node.jsのCLIやシミュレータでもプロトコルの処理をそのまま使える
+   */
+  async connectPorts(input, output) {
+    try {
       this.currentInput = input;
       this.currentOutput = output;
       
@@ -195,10 +242,20 @@ class MidiManager extends EventTarget {
    * 特定のスイッチ/イベントの設定を取得
    */
   async getMessages(switchNum, eventType) {
-    if (!this.isConnected || !this.currentOutput) {
-      throw new Error('No device connected');
+    try {
+      return await this.requestMessages(switchNum, eventType, this.responseTimeout);
+    } catch (error) {
+      this.dispatchEvent(new CustomEvent('error', { 
+        detail: { message: `Failed to get messages: ${error.message}` }
+      }));
+      throw error;
     }
+  }
 
+  /**
+   * 設定取得のリクエストを送って応答を待つ（失敗してもerrorイベントは出さない）
+   */
+  async requestMessages(switchNum, eventType, timeout) {
     const sysexData = [
       0xF0, 0x00, 0x7D, 0x01,      // SysEx header
       SYSEX_CMD_GET_MESSAGE,       // Get Message command
@@ -207,26 +264,55 @@ class MidiManager extends EventTarget {
       0xF7                         // SysEx end
     ];
 
-    const responseKey = `message_${switchNum}_${eventType}`;
-    const responsePromise = this.createResponsePromise(responseKey);
+    return this.sendAndWait(sysexData, `message_${switchNum}_${eventType}`,
+      `Message request for Switch ${switchNum} Event ${eventType}`, timeout);
+  }
 
-    try {
-      this.currentOutput.send(sysexData);
-      
-      this.dispatchEvent(new CustomEvent('sysexSent', { 
-        detail: { 
-          message: `Message request sent for Switch ${switchNum} Event ${eventType}`,
-          data: sysexData 
+  /**
+   * 複数のスイッチ/イベントの設定をまとめて取得
+   * 最大windowSize個のリクエストを応答待ちにしたまま次を送り、応答はスイッチ/イベント毎のキーで対応付ける。
+   * タイムアウトしたリクエストだけをretries回まで送り直す
+   * @param {Array<{switchNum, eventType}>} targets
+   * @param {Object} options - {windowSize, retries, timeout, onRetry({switchNum, eventType, attempt})}
+   * @returns {Promise<Array>} targetsと同じ順の {switchNum, eventType, messages}
+   */
+  async getMessagesBatch(targets, options = {}) {
+    const {
+      windowSize = BATCH_WINDOW,
+      retries = BATCH_RETRIES,
+      timeout = BATCH_TIMEOUT,
+      onRetry = null
+    } = options;
+    const results = new Array(targets.length);
+    let next = 0;
+
+    const worker = async () => {
+      while (next < targets.length) {
+        const index = next++;
+        const { switchNum, eventType } = targets[index];
+        for (let attempt = 1; ; attempt++) {
+          try {
+            results[index] = await this.requestMessages(switchNum, eventType, timeout);
+            break;
+          } catch (error) {
+            if (attempt > retries || !this.isConnected) {
+              this.dispatchEvent(new CustomEvent('error', { 
+                detail: { message: `Failed to get messages for Switch ${switchNum} Event ${eventType}: ${error.message}` }
+              }));
+              throw error;
+            }
+            if (onRetry) onRetry({ switchNum, eventType, attempt });
+          }
         }
-      }));
+      }
+    };
 
-      return await responsePromise;
-    } catch (error) {
-      this.dispatchEvent(new CustomEvent('error', { 
-        detail: { message: `Failed to get messages: ${error.message}` }
-      }));
-      throw error;
+    const workers = [];
+    for (let i = 0; i < Math.min(windowSize, targets.length); i++) {
+      workers.push(worker());
     }
+    await Promise.all(workers);
+    return results;
   }
 
   /**
@@ -283,15 +369,225 @@ class MidiManager extends EventTarget {
     }
   }
 
+  /**
+   * SysExを送信してレスポンスを待つ（失敗してもerrorイベントは出さない）
+   */
+  async sendAndWait(sysexData, responseKey, description, timeout = this.responseTimeout) {
+    if (!this.isConnected || !this.currentOutput) {
+      throw new Error('No device connected');
+    }
+
+    const responsePromise = this.createResponsePromise(responseKey, timeout);
+    this.currentOutput.send(sysexData);
+
+    this.dispatchEvent(new CustomEvent('sysexSent', { 
+      detail: { message: `${description} sent`, data: sysexData }
+    }));
+
+    return responsePromise;
+  }
+
+  /**
+   * SysExを送信してレスポンスを待つ
+   */
+  async sendRequest(sysexData, responseKey, description) {
+    try {
+      return await this.sendAndWait(sysexData, responseKey, description);
+    } catch (error) {
+      this.dispatchEvent(new CustomEvent('error', { 
+        detail: { message: `Failed: ${description}: ${error.message}` }
+      }));
+      throw error;
+    }
+  }
+
+  /**
+   * WS2812の状態別カラーを取得 (各色0-127)
+   */
+  async getPixelColors() {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_GET_PIXEL_COLORS, 0xF7
+    ], 'pixel_colors', 'Pixel colors request');
+  }
+
+  /**
+   * WS2812の状態別カラーを設定 (各色0-127)
+   */
+  async setPixelColor(state, r, g, b) {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_SET_PIXEL_COLOR,
+      state & 0x7F, r & 0x7F, g & 0x7F, b & 0x7F,
+      0xF7
+    ], `status_${SYSEX_CMD_SET_PIXEL_COLOR}`, `Set pixel color ${state}`);
+  }
+
+  /**
+   * ホストフィードバックの割り当てを取得
+   * @returns {channel, msgType, number, switchNum, state}
+   */
+  async getFeedbackMap(index) {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_GET_FEEDBACK_MAP, index & 0x7F, 0xF7
+    ], `feedback_${index}`, `Feedback map ${index} request`);
+  }
+
+  /**
+   * ホストフィードバックの割り当てを設定（msgType 0で解除）
+   */
+  async setFeedbackMap(index, { msgType, number, switchNum, state }) {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_SET_FEEDBACK_MAP,
+      index & 0x7F, msgType & 0x7F, number & 0x7F, switchNum & 0x7F, state & 0x7F,
+      0xF7
+    ], `status_${SYSEX_CMD_SET_FEEDBACK_MAP}`, `Set feedback map ${index}`);
+  }
+
+  /**
+   * ホストフィードバックの受信チャンネルを設定（0x7Fで無効）
+   */
+  async setFeedbackChannel(channel) {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_SET_FEEDBACK_CHANNEL, channel & 0x7F, 0xF7
+    ], `status_${SYSEX_CMD_SET_FEEDBACK_CHANNEL}`, `Set feedback channel ${channel}`);
+  }
+
+  /**
+   * スイッチのピン割り当てを取得
+   * @returns {number[]} スイッチ毎のGPIO番号
+   */
+  async getPinMap() {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_GET_PIN_MAP, 0xF7
+    ], 'pin_map', 'Pin map request');
+  }
+
+  /**
+   * スイッチのピン割り当てを設定（予約ピン・重複があればデバイスがエラーを返す）
+   * スイッチ数が変わるので、設定後はgetDeviceInfo()から読み直す
+   */
+  async setPinMap(pins) {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_SET_PIN_MAP,
+      pins.length & 0x7F, ...pins.map(pin => pin & 0x7F),
+      0xF7
+    ], `status_${SYSEX_CMD_SET_PIN_MAP}`, `Set pin map [${pins.join(', ')}]`);
+  }
+
+  /**
+   * 排他グループ（押すと同じグループの選択中のスイッチを解除する）を取得
+   * @returns {number[][]} グループ毎のスイッチ番号（未使用のグループは空）
+   */
+  async getExclusiveGroups() {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_GET_EXCLUSIVE_GROUPS, 0xF7
+    ], 'exclusive_groups', 'Exclusive groups request');
+  }
+
+  /**
+   * 排他グループのメンバーを設定（空で未使用、1つだけ・範囲外ならデバイスがエラーを返す）
+   */
+  async setExclusiveGroup(index, switches) {
+    const members = switches.reduce((mask, switchNum) => mask | (1 << switchNum), 0);
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_SET_EXCLUSIVE_GROUP,
+      index & 0x7F, members & 0x7F, (members >> 7) & 0x7F, (members >> 14) & 0x7F,
+      0xF7
+    ], `status_${SYSEX_CMD_SET_EXCLUSIVE_GROUP}`, `Set exclusive group ${index} [${switches.join(', ')}]`);
+  }
+
+  /**
+   * 起動の各段階の時刻を取得
+   * @returns {Object} 段階名 -> リセットからのµs（未到達ならnull）
+   */
+  async getBootTimes() {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_GET_BOOT_TIMES, 0xF7
+    ], 'boot_times', 'Boot times request');
+  }
+
+  /**
+   * スイッチのチャタリングの学習状態を取得
+   * @returns {{switchNum, windowMs, savedMs, samples, histogram}} histogram[n]: 長さnミリ秒の標本数（最後はそれ以上）
+   */
+  async getDebounce(switchNum) {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_GET_DEBOUNCE, switchNum & 0x7F, 0xF7
+    ], `debounce_${switchNum}`, `Debounce request for Switch ${switchNum}`);
+  }
+
+  /**
+   * トランザクションを始める（以後の設定は保存も反映もされず、読み出しには反映される）
+   * 開いているトランザクションがあれば捨ててやり直す
+   */
+  async beginTransaction() {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_BEGIN_TRANSACTION, 0xF7
+    ], `status_${SYSEX_CMD_BEGIN_TRANSACTION}`, 'Begin transaction');
+  }
+
+  /**
+   * ためた設定をまとめて反映し、1回で保存する（開いていなければエラー）
+   */
+  async commitTransaction() {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_COMMIT_TRANSACTION, 0xF7
+    ], `status_${SYSEX_CMD_COMMIT_TRANSACTION}`, 'Commit transaction');
+  }
+
+  /**
+   * ためた設定を捨てる（開いていなければエラー）
+   */
+  async rollbackTransaction() {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_ROLLBACK_TRANSACTION, 0xF7
+    ], `status_${SYSEX_CMD_ROLLBACK_TRANSACTION}`, 'Rollback transaction');
+  }
+
+  /**
+   * フライトレコーダを止める（freeze=true）/ 記録を消して再開する（freeze=false）
+   */
+  async setFlightRecorder(freeze) {
+    return this.sendRequest([
+      0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_SET_FLIGHT_RECORDER, freeze ? 1 : 0, 0xF7
+    ], `status_${SYSEX_CMD_SET_FLIGHT_RECORDER}`, freeze ? 'Freeze flight recorder' : 'Restart flight recorder');
+  }
+
+  /**
+   * フライトレコーダの記録を古い方から全部読む（記録中は読む間に上書きされるので、先に止める）
+   * @returns {{reason, frozen, trigger, entries}} trigger: 異常を見つけた記録の番号（なければnull）
+   */
+  async getFlightRecord() {
+    const pages = [];
+    let index = 0;
+    let count = 0;
+    do {
+      const page = await this.sendRequest([
+        0xF0, 0x00, 0x7D, 0x01, SYSEX_CMD_GET_FLIGHT_RECORD, index & 0x7F, (index >> 7) & 0x7F, 0xF7
+      ], `flight_${index}`, `Flight record from ${index}`);
+      pages.push(page);
+      count = page.count;
+      if (page.entries.length === 0) break;
+      index += page.entries.length;
+    } while (index < count);
+
+    const last = pages[pages.length - 1];
+    return {
+      reason: last.reason,
+      frozen: last.frozen,
+      trigger: last.trigger,
+      entries: pages.flatMap(page => page.entries)
+    };
+  }
+
   /**
    * レスポンス待機Promise作成
    */
-  createResponsePromise(key) {
+  createResponsePromise(key, timeout = this.responseTimeout) {
     return new Promise((resolve, reject) => {
       const timeoutId = setTimeout(() => {
         this.pendingResponses.delete(key);
         reject(new Error('Response timeout'));
-      }, this.responseTimeout);
+      }, timeout);
 
       this.pendingResponses.set(key, {
         resolve: (data) => {
@@ -353,6 +649,46 @@ class MidiManager extends EventTarget {
       case SYSEX_CMD_SET_MESSAGE:
         this.handleSetResponse(data);
         break;
+
+      case SYSEX_CMD_GET_PIXEL_COLORS:
+        this.handlePixelColorsResponse(data);
+        break;
+
+      case SYSEX_CMD_GET_FEEDBACK_MAP:
+        this.handleFeedbackMapResponse(data);
+        break;
+
+      case SYSEX_CMD_GET_PIN_MAP:
+        this.handlePinMapResponse(data);
+        break;
+
+      case SYSEX_CMD_GET_BOOT_TIMES:
+        this.handleBootTimesResponse(data);
+        break;
+
+      case SYSEX_CMD_GET_EXCLUSIVE_GROUPS:
+        this.handleExclusiveGroupsResponse(data);
+        break;
+
+      case SYSEX_CMD_GET_DEBOUNCE:
+        this.handleDebounceResponse(data);
+        break;
+
+      case SYSEX_CMD_GET_FLIGHT_RECORD:
+        this.handleFlightRecordResponse(data);
+        break;
+
+      case SYSEX_CMD_SET_PIXEL_COLOR:
+      case SYSEX_CMD_SET_FEEDBACK_MAP:
+      case SYSEX_CMD_SET_FEEDBACK_CHANNEL:
+      case SYSEX_CMD_SET_PIN_MAP:
+      case SYSEX_CMD_SET_FLIGHT_RECORDER:
+      case SYSEX_CMD_BEGIN_TRANSACTION:
+      case SYSEX_CMD_COMMIT_TRANSACTION:
+      case SYSEX_CMD_ROLLBACK_TRANSACTION:
+      case SYSEX_CMD_SET_EXCLUSIVE_GROUP:
+        this.handleStatusResponse(command, data);
+        break;
     }
   }
 
@@ -415,6 +751,176 @@ class MidiManager extends EventTarget {
     }
   }
 
+  /**
+   * WS2812カラー取得レスポンス処理
+   */
+  handlePixelColorsResponse(data) {
+    if (data.length < 7) return;
+
+    const count = data[5];
+    const colors = [];
+    for (let i = 0, pos = 6; i < count && pos + 2 < data.length - 1; i++, pos += 3) {
+      colors.push({ r: data[pos], g: data[pos + 1], b: data[pos + 2] });
+    }
+
+    const pending = this.pendingResponses.get('pixel_colors');
+    if (pending) {
+      pending.resolve(colors);
+    }
+  }
+
+  /**
+   * ホストフィードバック割り当てレスポンス処理
+   */
+  handleFeedbackMapResponse(data) {
+    if (data.length < 12) return;
+
+    const index = data[5];
+    const pending = this.pendingResponses.get(`feedback_${index}`);
+    if (pending) {
+      pending.resolve({
+        channel: data[6],
+        msgType: data[7],
+        number: data[8],
+        switchNum: data[9],
+        state: data[10]
+      });
+    }
+  }
+
+  /**
+   * ピン割り当てレスポンス処理
+   */
+  handlePinMapResponse(data) {
+    if (data.length < 7) return;
+
+    const count = data[5];
+    const pins = Array.from(data.slice(6, 6 + Math.min(count, data.length - 7)));
+
+    const pending = this.pendingResponses.get('pin_map');
+    if (pending) {
+      pending.resolve(pins);
+    }
+  }
+
+  /**
+   * 排他グループのレスポンス処理（メンバーは7bit×3のビットマスク、下位から）
+   */
+  handleExclusiveGroupsResponse(data) {
+    if (data.length < 7) return;
+
+    const groups = [];
+    for (let g = 0; g < data[5] && 6 + g * 3 + 3 < data.length; g++) {
+      const pos = 6 + g * 3;
+      const members = data[pos] | data[pos + 1] << 7 | data[pos + 2] << 14;
+      const switches = [];
+      for (let i = 0; members >> i; i++) {
+        if (members & (1 << i)) switches.push(i);
+      }
+      groups.push(switches);
+    }
+
+    const pending = this.pendingResponses.get('exclusive_groups');
+    if (pending) {
+      pending.resolve(groups);
+    }
+  }
+
+  /**
+   * 起動時刻レスポンス処理（各時刻は7bit×4、下位から）
+   */
+  handleBootTimesResponse(data) {
+    if (data.length < 7) return;
+
+    const count = data[5];
+    const times = {};
+    for (let i = 0, pos = 6; i < count && pos + 3 < data.length - 1; i++, pos += 4) {
+      const time = data[pos] | data[pos + 1] << 7 | data[pos + 2] << 14 | data[pos + 3] << 21;
+      times[BOOT_PHASES[i] ?? `phase${i}`] = time === BOOT_TIME_NONE ? null : time;
+    }
+
+    const pending = this.pendingResponses.get('boot_times');
+    if (pending) {
+      pending.resolve(times);
+    }
+  }
+
+  /**
+   * チャタリングの学習状態レスポンス処理
+   */
+  handleDebounceResponse(data) {
+    if (data.length < 11) return;
+
+    const switchNum = data[5];
+    const buckets = Math.min(data[9], data.length - 11);
+    const pending = this.pendingResponses.get(`debounce_${switchNum}`);
+    if (pending) {
+      pending.resolve({
+        switchNum,
+        windowMs: data[6],
+        savedMs: data[7],
+        samples: data[8],
+        histogram: Array.from(data.slice(10, 10 + buckets))
+      });
+    }
+  }
+
+  /**
+   * フライトレコーダの記録レスポンス処理（番号は7bit×2、各記録は時刻µs 7bit×5・種類・id・value）
+   */
+  handleFlightRecordResponse(data) {
+    if (data.length < 15) return;
+
+    const index = data[5] | data[6] << 7;
+    const trigger = data[9] | data[10] << 7;
+    const entries = [];
+    for (let i = 0, pos = 14; i < data[13] && pos + FLIGHT_ENTRY_SIZE < data.length; i++, pos += FLIGHT_ENTRY_SIZE) {
+      const timeUs = data[pos] + data[pos + 1] * 2 ** 7 + data[pos + 2] * 2 ** 14 +
+        data[pos + 3] * 2 ** 21 + data[pos + 4] * 2 ** 28;
+      const [type, id, value] = [data[pos + 5], data[pos + 6], data[pos + 7]];
+      switch (type) {
+      case 0:
+        entries.push({ timeUs, type: 'raw', switchNum: id, pressed: value === 1 });
+        break;
+      case 1:
+        entries.push({ timeUs, type: 'accept', switchNum: id, pressed: (value & 1) === 1, windowMs: value >> 1 });
+        break;
+      case 2:
+        entries.push({ timeUs, type: 'packet', switchNum: id >> 1, eventType: id & 1, packet: value });
+        break;
+      default:
+        entries.push({ timeUs, type: 'drop', switchNum: id >> 1, eventType: id & 1 });
+      }
+    }
+
+    const pending = this.pendingResponses.get(`flight_${index}`);
+    if (pending) {
+      pending.resolve({
+        count: data[7] | data[8] << 7,
+        trigger: trigger === FLIGHT_INDEX_NONE ? null : trigger,
+        reason: data[11] < FLIGHT_REASONS.length ? FLIGHT_REASONS[data[11]] : `reason${data[11]}`,
+        frozen: data[12] === 1,
+        entries
+      });
+    }
+  }
+
+  /**
+   * 成功/失敗のみを返すコマンドのレスポンス処理
+   */
+  handleStatusResponse(command, data) {
+    if (data.length < 7) return;
+
+    const pending = this.pendingResponses.get(`status_${command}`);
+    if (pending) {
+      if (data[5] === 0x00) {
+        pending.resolve({ success: true });
+      } else {
+        pending.reject(new Error(`Command 0x${command.toString(16)} failed`));
+      }
+    }
+  }
+
   /**
    * 設定完了レスポンス処理
    */
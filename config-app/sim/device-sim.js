@@ -0,0 +1,501 @@
+/**
+ * PicoMIDI Switch デバイスシミュレータ（SysExプロトコル）
+ *
+ * picomidi.c の sysex_feed_byte() / process_sysex_data() と同じ規則で要求を受け付けて応答する。
+ * 長さの合わない要求は黙って捨て、SET系は範囲外ならエラー（0x01）を返し、反映はすべて検証してから行う。
+ * 要求は1つずつ処理し、応答を返し終えるまで次を読まない（ファームウェアの背圧と同じ）。
+ * SET系はフラッシュへの保存の間（flashWriteMs）止まる。
+ * トランザクション中のSET系は staging（設定の写し）だけを変えて保存せず、GET系もそれを読む。
+ * COMMITで設定へ写し、変わっていれば1回だけ保存する。
+ *
+ * スイッチは持たないので、チャタリングの学習（GET_DEBOUNCE）は debounce[] に、
+ * フライトレコーダ（GET_FLIGHT_RECORD）は flight に直接値を入れて試す。
+ *
+ * 応答の遅延・揺らぎ・欠落・入れ替わりを設定でき、乱数はseedで決まるので結果は再現できる。
+ * WebMIDIのポートと同じ形の input/output を持つので、MidiManager.connectPorts() にそのまま渡せる。
+ * CLIからは module:sim/device-sim.js[:key=value,...] で使う（open() の引数）。
+ */
+
+// picomidi.c と合わせる
+const SYSEX_START_BYTE = 0xF0;
+const SYSEX_END_BYTE = 0xF7;
+const SYSEX_HEADER = [0xF0, 0x00, 0x7D, 0x01];
+const SYSEX_BASIC_MIN_LENGTH = 6;
+const SYSEX_BUFFER_SIZE = 64;
+
+const SYSEX_CMD_GET_INFO = 0x01;
+const SYSEX_CMD_GET_MESSAGE = 0x02;
+const SYSEX_CMD_SET_MESSAGE = 0x03;
+const SYSEX_CMD_GET_PIXEL_COLORS = 0x04;
+const SYSEX_CMD_SET_PIXEL_COLOR = 0x05;
+const SYSEX_CMD_GET_FEEDBACK_MAP = 0x06;
+const SYSEX_CMD_SET_FEEDBACK_MAP = 0x07;
+const SYSEX_CMD_SET_FEEDBACK_CHANNEL = 0x08;
+const SYSEX_CMD_GET_PIN_MAP = 0x09;
+const SYSEX_CMD_SET_PIN_MAP = 0x0A;
+const SYSEX_CMD_GET_BOOT_TIMES = 0x0B;
+const SYSEX_CMD_GET_DEBOUNCE = 0x0C;
+const SYSEX_CMD_GET_FLIGHT_RECORD = 0x0D;
+const SYSEX_CMD_SET_FLIGHT_RECORDER = 0x0E;
+const SYSEX_CMD_BEGIN_TRANSACTION = 0x0F;
+const SYSEX_CMD_COMMIT_TRANSACTION = 0x10;
+const SYSEX_CMD_ROLLBACK_TRANSACTION = 0x11;
+const SYSEX_CMD_GET_EXCLUSIVE_GROUPS = 0x12;
+const SYSEX_CMD_SET_EXCLUSIVE_GROUP = 0x13;
+
+const MAX_SWITCHES = 16;
+const MAX_MESSAGES_PER_EVENT = 10;
+const MAX_FEEDBACK_MAPS = 32;
+const MAX_EXCLUSIVE_GROUPS = 8;
+const PIXEL_STATE_COUNT = 6;
+const PIXEL_STATE_HOST_1 = 2;
+const MIDI_MSG_NONE = 0;
+const MIDI_MSG_CC = 1;
+const MIDI_MSG_NOTE = 3;
+const MIDI_MSG_HID_CONSUMER = 5;
+const FEEDBACK_CHANNEL_NONE = 0x7F;
+const NUM_GPIO_PINS = 30;
+const RESERVED_PINS = [0, 1, 23, 24, 29];   // RESERVED_PIN_MASK
+const BOOT_TIME_NONE = 0x0FFFFFFF;
+const DEBOUNCE_TIME_MS = 20;
+const DEBOUNCE_MIN_MS = 3;
+const DEBOUNCE_MAX_MS = 31;
+const DEBOUNCE_BUCKETS = 32;
+const FLIGHT_ENTRIES_PER_RESPONSE = 4;
+const FLIGHT_INDEX_NONE = 0x3FFF;
+const FLIGHT_REASON_NONE = 0;
+const FLIGHT_REASON_RETRIGGER = 1;
+const FLIGHT_REASON_QUEUE_FULL = 2;
+const FLIGHT_REASON_HOST = 3;
+
+const DEFAULT_PIXEL_COLORS = [
+  [0, 0, 4], [0, 127, 0], [127, 0, 0], [0, 127, 0], [127, 80, 0], [0, 40, 127]
+];
+
+// 保存1回の停止時間（host/flash_sim.h: セクタ消去45ms + 12ページ × 0.4ms）
+const FLASH_WRITE_MS = 49.8;
+
+export const DEFAULT_OPTIONS = {
+  pins: [2, 3],          // ビルド時のGPIO_PINS
+  ledPin: 25,            // PICO_DEFAULT_LED_PIN（ホストビルドにはないのでnull）
+  ws2812Pin: null,       // WS2812_PIN（予約ピンに加わる）
+  latencyMs: 1,          // 要求を受けてから応答を返すまで（USBフレーム）
+  jitterMs: 0,           // latencyMsに加える一様乱数の幅
+  flashWriteMs: FLASH_WRITE_MS,
+  dropRate: 0,           // 応答を捨てる確率
+  reorderRate: 0,        // 応答を次の応答の後に回す確率
+  seed: 1,
+  bootTimes: [0, 180, 5300, 5700, 85000, BOOT_TIME_NONE]  // GET_BOOT_TIMES（µs）
+};
+
+const sleep = (ms) => new Promise(resolve => setTimeout(resolve, ms));
+
+export class DeviceSimulator {
+  constructor(options = {}) {
+    this.options = { ...DEFAULT_OPTIONS, ...options };
+    this.rng = this.options.seed >>> 0 || 1;
+    this.stats = { requests: 0, responses: 0, dropped: 0, reordered: 0, flashWrites: 0, ignored: 0 };
+
+    this.input = { name: 'PicoMIDI Switch (simulated)', onmidimessage: null };
+    this.output = {
+      name: this.input.name,
+      send: (bytes) => this.receive(bytes)
+    };
+
+    this.sysexBuffer = [];
+    this.queue = [];
+    this.processing = false;
+    this.held = null;          // 入れ替えのために保留している応答
+    this.closed = false;
+    this.initDefaultConfig();
+    this.resetFlightRecorder();
+    this.staging = null;       // トランザクションの作業領域（閉じていればnull）
+  }
+
+  // トランザクションで写す設定（device_config_t の、SysExで変えられる部分）
+  snapshotConfig() {
+    return structuredClone({
+      numSwitches: this.numSwitches,
+      pinMap: this.pinMap,
+      events: this.events,
+      pixelColors: this.pixelColors,
+      feedbackChannel: this.feedbackChannel,
+      feedbackMaps: this.feedbackMaps,
+      exclusiveGroups: this.exclusiveGroups,
+      savedMs: this.debounce.map(d => d.savedMs)
+    });
+  }
+
+  // commit_transaction() と同じ（SET系で検証済みなので、作業領域はそのまま使える）
+  // @returns {boolean} フラッシュに書いたか
+  commitStaging() {
+    const staged = this.staging;
+    this.staging = null;
+    const current = this.snapshotConfig();
+    if (JSON.stringify(staged) === JSON.stringify(current)) return false;
+
+    const pinsChanged = JSON.stringify(staged.pinMap) !== JSON.stringify(current.pinMap);
+    const { savedMs, ...config } = staged;
+    Object.assign(this, config);
+    this.debounce.forEach((d, i) => { d.savedMs = savedMs[i]; });
+    if (pinsChanged) this.resetDebounce();
+    return true;
+  }
+
+  // flight_reset() と同じ（entries: {timeUs, type, id, value} の古い順、trigger: 異常の記録の番号）
+  resetFlightRecorder() {
+    this.flight = { entries: [], trigger: 0, reason: FLIGHT_REASON_NONE, frozen: false };
+  }
+
+  // init_default_config() と同じ
+  initDefaultConfig() {
+    const pins = this.options.pins;
+    this.numSwitches = pins.length;
+    this.pinMap = [...pins];
+    this.events = [];
+    for (let i = 0; i < MAX_SWITCHES; i++) {
+      this.events.push([{ msgType: MIDI_MSG_CC, channel: 0, param1: i, param2: 127 }]);
+      this.events.push([{ msgType: MIDI_MSG_CC, channel: 0, param1: i, param2: 0 }]);
+    }
+    this.pixelColors = DEFAULT_PIXEL_COLORS.map(rgb => [...rgb]);
+    this.feedbackChannel = 15;
+    this.feedbackMaps = [];
+    for (let i = 0; i < MAX_FEEDBACK_MAPS; i++) {
+      this.feedbackMaps.push(i < this.numSwitches
+        ? { msgType: MIDI_MSG_CC, number: i, switchNum: i, state: PIXEL_STATE_HOST_1 }
+        : { msgType: MIDI_MSG_NONE, number: 0, switchNum: 0, state: 0 });
+    }
+    this.exclusiveGroups = new Array(MAX_EXCLUSIVE_GROUPS).fill(0);  // グループ毎のメンバー（bit i: スイッチi）
+    this.debounce = Array.from({ length: MAX_SWITCHES }, () => ({ savedMs: 0 }));
+    this.resetDebounce();
+  }
+
+  // compile_pin_map() と同じく、受け付け窓を保存済みの学習値に戻してヒストグラムを空にする
+  resetDebounce() {
+    for (const d of this.debounce) {
+      d.windowMs = d.savedMs >= DEBOUNCE_MIN_MS && d.savedMs <= DEBOUNCE_MAX_MS ? d.savedMs : DEBOUNCE_TIME_MS;
+      d.histogram = new Array(DEBOUNCE_BUCKETS).fill(0);
+    }
+  }
+
+  random() {
+    this.rng ^= this.rng << 13;
+    this.rng >>>= 0;
+    this.rng ^= this.rng >>> 17;
+    this.rng ^= this.rng << 5;
+    this.rng >>>= 0;
+    return this.rng / 0x100000000;
+  }
+
+  close() {
+    this.closed = true;
+    this.queue = [];
+  }
+
+  // ホストからのバイト列（sysex_feed_byte()と同じ組み立て）
+  receive(bytes) {
+    for (const byte of bytes) {
+      if (byte === SYSEX_START_BYTE) {
+        this.sysexBuffer = [byte];
+      } else if (byte === SYSEX_END_BYTE) {
+        if (this.sysexBuffer.length > 0 && this.sysexBuffer.length < SYSEX_BUFFER_SIZE) {
+          this.sysexBuffer.push(byte);
+          this.queue.push(this.sysexBuffer);
+        }
+        this.sysexBuffer = [];
+      } else if (this.sysexBuffer.length > 0) {
+        // 途中のステータスバイトやバッファ超過は途切れたメッセージとして捨てる
+        if ((byte & 0x80) || this.sysexBuffer.length >= SYSEX_BUFFER_SIZE - 1) {
+          this.sysexBuffer = [];
+        } else {
+          this.sysexBuffer.push(byte);
+        }
+      }
+    }
+    this.run();
+  }
+
+  // 要求を1つずつ処理する
+  async run() {
+    if (this.processing) return;
+    this.processing = true;
+    // 処理中の例外（シミュレータの不具合）で止まったままにしない
+    try {
+      while (this.queue.length && !this.closed) {
+        const request = this.queue.shift();
+        this.stats.requests++;
+        const { response, flashWrite } = this.process(request);
+        if (flashWrite) {
+          this.stats.flashWrites++;
+          await sleep(this.options.flashWriteMs);
+        }
+        await sleep(this.options.latencyMs + this.random() * this.options.jitterMs);
+        if (response) {
+          this.deliver(response);
+        } else {
+          this.stats.ignored++;
+        }
+      }
+    } finally {
+      this.processing = false;
+    }
+  }
+
+  deliver(response) {
+    if (this.closed) return;
+    if (this.random() < this.options.dropRate) {
+      this.stats.dropped++;
+      return;
+    }
+    if (!this.held && this.random() < this.options.reorderRate) {
+      // 次の応答の後に届ける（次が来なければ少し後に単独で届ける）
+      this.held = response;
+      this.stats.reordered++;
+      setTimeout(() => this.flushHeld(), this.options.latencyMs * 4 + 5);
+      return;
+    }
+    this.emit(response);
+    this.flushHeld();
+  }
+
+  flushHeld() {
+    if (!this.held) return;
+    const held = this.held;
+    this.held = null;
+    this.emit(held);
+  }
+
+  emit(response) {
+    if (this.closed) return;
+    this.stats.responses++;
+    if (this.input.onmidimessage) {
+      this.input.onmidimessage({ data: Uint8Array.from(response) });
+    }
+  }
+
+  // reserved_pin_mask() と validate_pin_map()
+  validatePinMap(count, pins) {
+    if (count === 0 || count > MAX_SWITCHES) return false;
+    const used = new Set(RESERVED_PINS);
+    if (this.options.ledPin !== null) used.add(this.options.ledPin);
+    if (this.options.ws2812Pin !== null) used.add(this.options.ws2812Pin);
+    for (let i = 0; i < count; i++) {
+      if (pins[i] >= NUM_GPIO_PINS || used.has(pins[i])) return false;
+      used.add(pins[i]);
+    }
+    return true;
+  }
+
+  /**
+   * process_sysex_data() と同じ
+   * @returns {{response: number[]|null, flashWrite: boolean}}
+   */
+  process(data) {
+    const length = data.length;
+    const none = { response: null, flashWrite: false };
+    const reply = (...body) => ({ response: [...SYSEX_HEADER, ...body, SYSEX_END_BYTE], flashWrite: false });
+    const status = (command, ok) => ({ ...reply(command, ok ? 0x00 : 0x01), flashWrite: ok && !this.staging });
+    // config_view() / config_target(): トランザクション中は作業領域を読み書きする
+    const view = this.staging ?? this;
+    const target = this.staging ?? this;
+
+    if (length < SYSEX_BASIC_MIN_LENGTH || data[0] !== SYSEX_START_BYTE || data[length - 1] !== SYSEX_END_BYTE) {
+      return none;
+    }
+    if (data[1] !== SYSEX_HEADER[1] || data[2] !== SYSEX_HEADER[2] || data[3] !== SYSEX_HEADER[3]) {
+      return none;
+    }
+
+    const command = data[4];
+    switch (command) {
+    case SYSEX_CMD_GET_INFO:
+      return length === SYSEX_BASIC_MIN_LENGTH ? reply(command, view.numSwitches, 0x01) : none;
+
+    case SYSEX_CMD_GET_MESSAGE: {
+      if (length !== 8) return none;
+      const [switchNum, eventType] = [data[5], data[6]];
+      if (switchNum >= view.numSwitches || eventType > 1) return none;
+      const messages = view.events[switchNum * 2 + eventType];
+      return reply(command, switchNum, eventType, messages.length,
+        ...messages.flatMap(m => [m.msgType, m.channel, m.param1, m.param2]));
+    }
+
+    case SYSEX_CMD_SET_MESSAGE: {
+      if (length < 9) return status(command, false);
+      const [switchNum, eventType, count] = [data[5], data[6], data[7]];
+      if (switchNum >= view.numSwitches || eventType > 1 || count > MAX_MESSAGES_PER_EVENT ||
+          length < 9 + count * 4) {
+        return status(command, false);
+      }
+      // 全メッセージを検証してから反映する
+      const messages = [];
+      for (let i = 0, pos = 8; i < count; i++, pos += 4) {
+        const msg = {
+          msgType: data[pos],
+          channel: data[pos + 1] & 0x0F,
+          param1: data[pos + 2] & 0x7F,
+          param2: data[pos + 3] & 0x7F
+        };
+        if (msg.msgType > MIDI_MSG_HID_CONSUMER) return status(command, false);
+        messages.push(msg);
+      }
+      target.events[switchNum * 2 + eventType] = messages;
+      return status(command, true);
+    }
+
+    case SYSEX_CMD_GET_PIXEL_COLORS:
+      return length === SYSEX_BASIC_MIN_LENGTH ? reply(command, PIXEL_STATE_COUNT, ...view.pixelColors.flat()) : none;
+
+    case SYSEX_CMD_SET_PIXEL_COLOR:
+      if (length !== 10 || data[5] >= PIXEL_STATE_COUNT || data[6] > 127 || data[7] > 127 || data[8] > 127) {
+        return status(command, false);
+      }
+      target.pixelColors[data[5]] = [data[6], data[7], data[8]];
+      return status(command, true);
+
+    case SYSEX_CMD_GET_FEEDBACK_MAP: {
+      if (length !== 7 || data[5] >= MAX_FEEDBACK_MAPS) return none;
+      const map = view.feedbackMaps[data[5]];
+      return reply(command, data[5], view.feedbackChannel, map.msgType, map.number, map.switchNum, map.state);
+    }
+
+    case SYSEX_CMD_SET_FEEDBACK_MAP:
+      if (length !== 11 || data[5] >= MAX_FEEDBACK_MAPS ||
+          (data[6] !== MIDI_MSG_NONE && data[6] !== MIDI_MSG_CC && data[6] !== MIDI_MSG_NOTE) ||
+          data[7] > 127 || data[8] >= view.numSwitches ||
+          data[9] < PIXEL_STATE_HOST_1 || data[9] >= PIXEL_STATE_COUNT) {
+        return status(command, false);
+      }
+      target.feedbackMaps[data[5]] = { msgType: data[6], number: data[7], switchNum: data[8], state: data[9] };
+      return status(command, true);
+
+    case SYSEX_CMD_SET_FEEDBACK_CHANNEL:
+      if (length !== 7 || (data[5] > 15 && data[5] !== FEEDBACK_CHANNEL_NONE)) {
+        return status(command, false);
+      }
+      target.feedbackChannel = data[5];
+      return status(command, true);
+
+    case SYSEX_CMD_GET_PIN_MAP:
+      return length === SYSEX_BASIC_MIN_LENGTH ? reply(command, view.numSwitches, ...view.pinMap) : none;
+
+    case SYSEX_CMD_SET_PIN_MAP: {
+      const pins = data.slice(6, 6 + data[5]);
+      if (length < 7 || length !== 7 + data[5] || !this.validatePinMap(data[5], pins)) {
+        return status(command, false);
+      }
+      // ピンが変わったスイッチの学習値は捨てる
+      if (this.staging) {
+        this.staging.savedMs.forEach((_, i) => {
+          if (i >= data[5] || this.staging.pinMap[i] !== pins[i]) this.staging.savedMs[i] = 0;
+        });
+      } else {
+        this.debounce.forEach((d, i) => {
+          if (i >= data[5] || this.pinMap[i] !== pins[i]) d.savedMs = 0;
+        });
+      }
+      target.numSwitches = data[5];
+      target.pinMap = Array.from(pins);
+      if (!this.staging) this.resetDebounce();
+      return status(command, true);
+    }
+
+    case SYSEX_CMD_GET_BOOT_TIMES:
+      if (length !== SYSEX_BASIC_MIN_LENGTH) return none;
+      return reply(command, this.options.bootTimes.length,
+        ...this.options.bootTimes.flatMap(t => [t & 0x7F, (t >> 7) & 0x7F, (t >> 14) & 0x7F, (t >> 21) & 0x7F]));
+
+    case SYSEX_CMD_GET_DEBOUNCE: {
+      if (length !== 7 || data[5] >= view.numSwitches) return none;
+      const d = this.debounce[data[5]];
+      const samples = d.histogram.reduce((sum, n) => sum + n, 0);
+      const savedMs = this.staging ? this.staging.savedMs[data[5]] : d.savedMs;
+      return reply(command, data[5], d.windowMs, savedMs, samples, DEBOUNCE_BUCKETS, ...d.histogram);
+    }
+
+    case SYSEX_CMD_GET_FLIGHT_RECORD: {
+      if (length !== 8) return none;
+      const { entries, reason, frozen } = this.flight;
+      const index = data[5] | data[6] << 7;
+      const count = entries.length;
+      const trigger = (reason === FLIGHT_REASON_RETRIGGER || reason === FLIGHT_REASON_QUEUE_FULL)
+        ? this.flight.trigger : FLIGHT_INDEX_NONE;
+      const page = entries.slice(index, index + FLIGHT_ENTRIES_PER_RESPONSE);
+      return reply(command, index & 0x7F, (index >> 7) & 0x7F, count & 0x7F, (count >> 7) & 0x7F,
+        trigger & 0x7F, (trigger >> 7) & 0x7F, reason, frozen ? 1 : 0, page.length,
+        ...page.flatMap(e => [0, 7, 14, 21, 28].map(shift => Math.floor(e.timeUs / 2 ** shift) & 0x7F)
+          .concat([e.type, e.id, e.value])));
+    }
+
+    case SYSEX_CMD_SET_FLIGHT_RECORDER:
+      if (length !== 7 || data[5] > 1) return status(command, false);
+      if (data[5] === 0) {
+        this.resetFlightRecorder();
+      } else {
+        if (this.flight.reason === FLIGHT_REASON_NONE) this.flight.reason = FLIGHT_REASON_HOST;
+        this.flight.frozen = true;
+      }
+      return status(command, true);
+
+    case SYSEX_CMD_GET_EXCLUSIVE_GROUPS:
+      if (length !== SYSEX_BASIC_MIN_LENGTH) return none;
+      return reply(command, MAX_EXCLUSIVE_GROUPS,
+        ...view.exclusiveGroups.flatMap(m => [m & 0x7F, (m >> 7) & 0x7F, m >> 14]));
+
+    case SYSEX_CMD_SET_EXCLUSIVE_GROUP: {
+      // メンバーはスイッチ数の範囲で、0（未使用）か2つ以上
+      if (length !== 10 || data[5] >= MAX_EXCLUSIVE_GROUPS || data[8] > 0x03) return status(command, false);
+      const members = data[6] | data[7] << 7 | data[8] << 14;
+      const count = members.toString(2).replace(/0/g, '').length;
+      if ((members >> view.numSwitches) !== 0 || count === 1) return status(command, false);
+      target.exclusiveGroups[data[5]] = members;
+      return status(command, true);
+    }
+
+    case SYSEX_CMD_BEGIN_TRANSACTION:
+      if (length !== SYSEX_BASIC_MIN_LENGTH) return status(command, false);
+      this.staging = this.snapshotConfig();
+      return reply(command, 0x00);
+
+    case SYSEX_CMD_COMMIT_TRANSACTION:
+      if (length !== SYSEX_BASIC_MIN_LENGTH || !this.staging) {
+        this.staging = null;
+        return status(command, false);
+      }
+      return { ...reply(command, 0x00), flashWrite: this.commitStaging() };
+
+    case SYSEX_CMD_ROLLBACK_TRANSACTION:
+      if (length !== SYSEX_BASIC_MIN_LENGTH || !this.staging) return status(command, false);
+      this.staging = null;
+      return reply(command, 0x00);
+    }
+    return none;
+  }
+}
+
+/**
+ * CLIのトランスポート（module:sim/device-sim.js[:key=value,...]）
+ * 例: module:sim/device-sim.js:pins=2.3.4,latencyMs=2,dropRate=0.05,seed=7（ledPin=none で予約なし）
+ */
+export default async function open(arg) {
+  const options = {};
+  for (const item of (arg ?? '').split(',').filter(Boolean)) {
+    const [key, value] = item.split('=');
+    if (!(key in DEFAULT_OPTIONS)) throw new Error(`device-sim: unknown option '${key}'`);
+    if (key === 'pins') {
+      options[key] = value.split('.').map(Number);
+    } else {
+      options[key] = value === 'none' ? null : Number(value);
+    }
+  }
+  const device = new DeviceSimulator(options);
+  return {
+    name: device.input.name,
+    input: device.input,
+    output: device.output,
+    device,
+    async close() {
+      device.close();
+    }
+  };
+}
@@ -0,0 +1,278 @@
+/**
+ * デバイスシミュレータとMidiManager・CLIの検査（node --test）
+ *
+ * PICOMIDI_SIM にホストビルドの picomidi_sim を指定すると（ctestの config_app_sim）、
+ * ランダムなSysExに対する応答をファームウェアと比べる。
+ */
+
+import { test } from 'node:test';
+import assert from 'node:assert/strict';
+import fs from 'node:fs';
+import os from 'node:os';
+import path from 'node:path';
+import { execFileSync } from 'node:child_process';
+import { fileURLToPath } from 'node:url';
+
+import MidiManager from '../midi-manager.js';
+import { DeviceSimulator } from './device-sim.js';
+import { writeDevice, verifyDevice, readDevice } from '../cli/provision.js';
+
+const here = path.dirname(fileURLToPath(import.meta.url));
+const scriptsDir = path.join(here, '../../host/scripts');
+
+// ホストビルドと同じ構成（GPIO_PINS 2-17、ボードのLEDなし）
+const HOST_OPTIONS = {
+  pins: Array.from({ length: 16 }, (_, i) => i + 2),
+  ledPin: null,
+  latencyMs: 0,
+  flashWriteMs: 0
+};
+
+const hex = (bytes) => Array.from(bytes, b => b.toString(16).toUpperCase().padStart(2, '0')).join(' ');
+
+// 要求を順に送り、SysEx応答を集める（応答のない要求は空）
+const collectResponses = async (device, requests) => {
+  const responses = [];
+  device.input.onmidimessage = ({ data }) => responses.push(hex(data));
+  for (const request of requests) {
+    device.output.send(request);
+    await new Promise(resolve => setTimeout(resolve, 0));
+    while (device.processing) {
+      await new Promise(resolve => setTimeout(resolve, 1));
+    }
+  }
+  return responses;
+};
+
+const parseScript = (text) => text.split('\n')
+  .map(line => line.replace(/#.*/, '').trim().split(/\s+/))
+  .filter(words => words[1] === 'send')
+  .map(words => words.slice(2).map(b => parseInt(b, 16)));
+
+const parseExpected = (text) => text.split('\n')
+  .filter(line => line.split(' ')[1] === 'sysex')
+  .map(line => line.split(' ').slice(2).join(' '));
+
+for (const script of ['sysex', 'pinmap']) {
+  test(`matches host/scripts/${script}.expected`, async () => {
+    const requests = parseScript(fs.readFileSync(path.join(scriptsDir, `${script}.txt`), 'utf8'));
+    const expected = parseExpected(fs.readFileSync(path.join(scriptsDir, `${script}.expected`), 'utf8'));
+    const device = new DeviceSimulator(HOST_OPTIONS);
+    assert.deepEqual(await collectResponses(device, requests), expected);
+  });
+}
+
+// 各フィールドを境界値の周りで選び、ときどき長さを崩す（fuzz_sysex と同じ考え方）
+const randomRequests = (count, seed) => {
+  let rng = seed;
+  const random = (n) => {
+    rng ^= rng << 13; rng >>>= 0;
+    rng ^= rng >>> 17;
+    rng ^= rng << 5; rng >>>= 0;
+    return rng % n;
+  };
+  const pick = (values) => values[random(values.length)];
+  const near = (limit) => pick([0, 1, limit - 1, limit, limit + 1, random(4), random(128)]) & 0x7F;
+
+  const fields = {
+    0x01: () => [],
+    0x02: () => [near(16), near(2)],
+    0x03: () => {
+      const n = near(10);
+      const messages = Array.from({ length: Math.min(n, 12) }, () => [near(6), random(128), random(128), random(128)]);
+      return [near(16), near(2), n, ...messages.flat()];
+    },
+    0x04: () => [],
+    0x05: () => [near(6), random(128), random(128), random(128)],
+    0x06: () => [near(32)],
+    0x07: () => [near(32), pick([0, 1, 2, 3, 4, 127]), random(128), pick([0, 1, 2, random(4), near(16)]), random(8)],
+    0x08: () => [pick([0, 15, 16, 126, 127, random(128)])],
+    0x09: () => [],
+    0x0A: () => {
+      const n = pick([0, 1, 2, 3, 16, 17, random(20)]);
+      const pins = Array.from({ length: n }, () => pick([0, 1, 23, 24, 25, 29, 30, 31, random(30), random(30)]));
+      return [n, ...pins];
+    },
+    0x0C: () => [near(16)],
+    0x0D: () => [pick([0, 1, 4, random(128)]), pick([0, 0, 2, random(128)])],
+    0x0E: () => [pick([0, 1, 1, 2, random(128)])],
+    0x0F: () => [],
+    0x10: () => [],
+    0x11: () => [],
+    0x12: () => [],
+    0x13: () => {
+      const members = random(1 << 17);
+      return [near(8), members & 0x7F, (members >> 7) & 0x7F, pick([0, 1, 3, 4, members >> 14])];
+    },
+    0x14: () => []
+  };
+
+  const requests = [];
+  for (let i = 0; i < count; i++) {
+    const command = pick(Object.keys(fields).map(Number));  // 0x0B（起動時刻）は実行環境の時刻なので除く
+    let body = fields[command]();
+    if (random(8) === 0) {
+      // 長さ違い・バッファ超過
+      body = random(2) ? body.slice(0, random(body.length + 1)) : [...body, ...Array.from({ length: random(60) }, () => random(128))];
+    }
+    const header = random(32) === 0 ? [0xF0, 0x00, 0x7D, 0x02] : [0xF0, 0x00, 0x7D, 0x01];
+    requests.push([...header, command, ...body, 0xF7]);
+  }
+  return requests;
+};
+
+test('matches the firmware (picomidi_sim) on random requests', { skip: !process.env.PICOMIDI_SIM }, async () => {
+  const requests = randomRequests(2000, 12345);
+  const script = requests.map((request, i) => `${(i + 1) * 10} send ${hex(request)}`).join('\n') + '\n';
+  const scriptPath = path.join(fs.mkdtempSync(path.join(os.tmpdir(), 'picomidi-')), 'random.txt');
+  fs.writeFileSync(scriptPath, script);
+
+  const expected = parseExpected(execFileSync(process.env.PICOMIDI_SIM, [scriptPath], { encoding: 'utf8' }));
+  const device = new DeviceSimulator(HOST_OPTIONS);
+  assert.deepEqual(await collectResponses(device, requests), expected);
+});
+
+const connect = async (options) => {
+  const device = new DeviceSimulator(options);
+  const manager = new MidiManager();
+  assert.ok(await manager.connectPorts(device.input, device.output));
+  return { device, manager };
+};
+
+test('batch load survives dropped and reordered responses', async () => {
+  const { device, manager } = await connect({ pins: HOST_OPTIONS.pins, ledPin: null, latencyMs: 1, seed: 3 });
+  Object.assign(device.options, { jitterMs: 2, dropRate: 0.1, reorderRate: 0.2 });
+  device.events[5 * 2 + 1] = [{ msgType: 3, channel: 2, param1: 60, param2: 0 }];
+
+  const targets = [];
+  for (let switchNum = 0; switchNum < 16; switchNum++) {
+    targets.push({ switchNum, eventType: 0 }, { switchNum, eventType: 1 });
+  }
+  let retries = 0;
+  const start = performance.now();
+  const results = await manager.getMessagesBatch(targets, { timeout: 50, retries: 5, onRetry: () => retries++ });
+  const elapsed = performance.now() - start;
+
+  results.forEach((result, i) => {
+    assert.equal(result.switchNum, targets[i].switchNum);
+    assert.equal(result.eventType, targets[i].eventType);
+  });
+  assert.deepEqual(results[11].messages, [{ msgType: 3, channel: 2, param1: 60, param2: 0 }]);
+  assert.ok(device.stats.dropped > 0 && retries >= device.stats.dropped);
+  assert.ok(elapsed < 1000, `16 switches loaded in ${elapsed.toFixed(1)} ms`);
+  manager.disconnect();
+  device.close();
+});
+
+test('CLI provisioning writes only differences and verifies', async () => {
+  const { device, manager } = await connect({ latencyMs: 0, flashWriteMs: 1 });
+  const profile = JSON.parse(fs.readFileSync(path.join(scriptsDir, 'profile.json'), 'utf8'));
+
+  // 変えた項目は1つのトランザクションで、フラッシュへの保存は1回
+  const writes = await writeDevice(manager, profile);
+  assert.ok(writes > 1);
+  assert.equal(device.stats.flashWrites, 1);
+  assert.deepEqual(await verifyDevice(manager, profile), []);
+  assert.deepEqual(device.pinMap, [20, 5, 9]);
+  assert.equal(device.feedbackChannel, 14);
+  assert.deepEqual(device.exclusiveGroups, [0b101, 0, 0, 0, 0, 0, 0, 0]);
+
+  // 2回目は何も書かない
+  assert.equal(await writeDevice(manager, profile), 0);
+
+  // ファイルにないフィードバックの割り当ては消す（消した項目もSET_FEEDBACK_MAPの検証を通る）
+  const maps = [{ msgType: 3, number: 64, switchNum: 1, state: 3 }];
+  assert.ok((await readDevice(manager)).feedbackMaps.length > maps.length);
+  assert.ok(await writeDevice(manager, { ...profile, feedbackMaps: maps }) > 1);
+  assert.deepEqual((await readDevice(manager)).feedbackMaps, maps);
+  assert.deepEqual(await verifyDevice(manager, { ...profile, feedbackMaps: maps }), []);
+
+  // 読み出した設定はそのまま書き戻せる
+  const config = await readDevice(manager);
+  assert.deepEqual(config.pinMap, profile.pinMap);
+  assert.equal(await writeDevice(manager, config), 0);
+
+  // 予約ピンはデバイスがエラーを返し、それまでに送った項目も反映しない
+  const flashWrites = device.stats.flashWrites;
+  const changed = structuredClone(profile);
+  changed.configurations[0].press.messages[0].param1 ^= 1;
+  await assert.rejects(writeDevice(manager, { ...changed, pinMap: [20, 5, 25] }));
+  assert.equal(device.stats.flashWrites, flashWrites);
+  assert.deepEqual(await verifyDevice(manager, profile), []);
+  assert.equal(device.staging, null);
+  manager.disconnect();
+  device.close();
+});
+
+test('transactions stage writes until commit', async () => {
+  const { device, manager } = await connect({ latencyMs: 0, flashWriteMs: 0 });
+  await assert.rejects(manager.commitTransaction());
+  await assert.rejects(manager.rollbackTransaction());
+
+  await manager.beginTransaction();
+  await manager.setFeedbackChannel(3);
+  await manager.setPixelColor(1, 1, 2, 3);
+  assert.equal((await manager.getFeedbackMap(0)).channel, 3);
+  assert.equal(device.feedbackChannel, 15);
+  assert.equal(device.stats.flashWrites, 0);
+  await manager.commitTransaction();
+  assert.equal(device.feedbackChannel, 3);
+  assert.deepEqual(device.pixelColors[1], [1, 2, 3]);
+  assert.equal(device.stats.flashWrites, 1);
+
+  await manager.beginTransaction();
+  await manager.setFeedbackChannel(4);
+  await manager.rollbackTransaction();
+  assert.equal((await manager.getFeedbackMap(0)).channel, 3);
+  assert.equal(device.stats.flashWrites, 1);
+  manager.disconnect();
+  device.close();
+});
+
+test('reads the learned debounce window of each switch', async () => {
+  const { device, manager } = await connect({ latencyMs: 0 });
+  Object.assign(device.debounce[1], { savedMs: 6, windowMs: 5 });
+  device.debounce[1].histogram[3] = 40;
+
+  assert.deepEqual(await manager.getDebounce(0), {
+    switchNum: 0, windowMs: 20, savedMs: 0, samples: 0, histogram: new Array(32).fill(0)
+  });
+  const learned = await manager.getDebounce(1);
+  assert.equal(learned.windowMs, 5);
+  assert.equal(learned.savedMs, 6);
+  assert.equal(learned.samples, 40);
+  assert.equal(learned.histogram[3], 40);
+  manager.disconnect();
+  device.close();
+});
+
+test('reads the flight record page by page', async () => {
+  const { device, manager } = await connect({ latencyMs: 0 });
+  // 二重押下: 押下 -> 窓の終わりで解放 -> 再押下
+  device.flight.entries = [
+    { timeUs: 1000, type: 0, id: 1, value: 1 },
+    { timeUs: 1000, type: 1, id: 1, value: 20 << 1 | 1 },
+    { timeUs: 1500, type: 2, id: 2, value: 0 },
+    { timeUs: 21000, type: 0, id: 1, value: 0 },
+    { timeUs: 24000, type: 1, id: 1, value: 20 << 1 },
+    { timeUs: 2 ** 32 - 1, type: 1, id: 1, value: 20 << 1 | 1 }
+  ];
+  Object.assign(device.flight, { trigger: 5, reason: 1, frozen: true });
+
+  const record = await manager.getFlightRecord();
+  assert.equal(record.reason, 'retrigger');
+  assert.equal(record.frozen, true);
+  assert.equal(record.trigger, 5);
+  assert.equal(record.entries.length, 6);
+  assert.deepEqual(record.entries[1], { timeUs: 1000, type: 'accept', switchNum: 1, pressed: true, windowMs: 20 });
+  assert.deepEqual(record.entries[2], { timeUs: 1500, type: 'packet', switchNum: 1, eventType: 0, packet: 0 });
+  assert.equal(record.entries[5].timeUs, 2 ** 32 - 1);
+
+  // 再開すると消え、止めるとホストが理由になる
+  await manager.setFlightRecorder(false);
+  assert.deepEqual(await manager.getFlightRecord(), { reason: null, frozen: false, trigger: null, entries: [] });
+  await manager.setFlightRecorder(true);
+  assert.equal((await manager.getFlightRecord()).reason, 'host');
+  manager.disconnect();
+  device.close();
+});
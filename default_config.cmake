@@ -0,0 +1,31 @@
+# Generate default_config.h from a JSON profile (the config app's file export).
+#
+# The header holds a complete, validated device_config_t initializer including
+# its checksum. picomidi.c keeps it in flash (.rodata) and uses it whenever the
+# config sector holds no valid config, so a first boot needs no flash write.
+set(PICOMIDI_DEFAULT_CONFIG_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/tools/default_config.py)
+
+# picomidi_generate_default_config(<target> <profile.json> <GPIO_PINS> <output> [WS2812_PIN])
+function(picomidi_generate_default_config target profile pins output)
+    find_package(Python3 REQUIRED COMPONENTS Interpreter)
+
+    get_filename_component(profile ${profile} ABSOLUTE)
+    get_filename_component(output_dir ${output} DIRECTORY)
+    file(MAKE_DIRECTORY ${output_dir})
+    set(extra_args "")
+    if(ARGC GREATER 4 AND NOT "${ARGV4}" STREQUAL "")
+        set(extra_args --ws2812-pin ${ARGV4})
+    endif()
+
+    add_custom_command(
+        OUTPUT ${output}
+        COMMAND ${Python3_EXECUTABLE} ${PICOMIDI_DEFAULT_CONFIG_SCRIPT}
+            ${profile} ${output} --pins ${pins} ${extra_args}
+        DEPENDS ${profile} ${PICOMIDI_DEFAULT_CONFIG_SCRIPT}
+        COMMENT "Generating default config from ${profile}"
+        VERBATIM)
+
+    target_sources(${target} PRIVATE ${output})
+    target_include_directories(${target} BEFORE PRIVATE ${output_dir})
+    target_compile_definitions(${target} PRIVATE PICOMIDI_DEFAULT_CONFIG=1)
+endfunction()
@@ -0,0 +1,487 @@
+// シミュレータ上のレイテンシ/スループットベンチマーク
+//
+// usage: picomidi_bench [--quick] [--check] [-o result.json]
+//
+// シナリオ毎に、スイッチのエッジからパケットがホストに届くまでの時間（仮想時間）、
+// パケットレート、欠落数、1イベントあたりのCPU時間（ホスト実測）を計測し、JSONで出力する。
+// 仮想時間の結果は決定的なので、--checkを付けるとレイテンシ予算を超えた場合に失敗する。
+// 加えて check_switches() / 送信経路 / RX経路 単体の所要時間（ns/op）を計測する。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "switch_pins.h"
+
+#define MAX_EXPECTED 65536
+#define SETTLE_US 100000        // 起動直後のデバウンス期間を避けるための待ち
+#define DRAIN_US 50000
+#define MATCH_WINDOW_US 20000  // エッジからこれ以上遅れたパケットは別物とみなす
+
+// 期待するパケット（エッジ時刻付き）
+typedef struct {
+    uint8_t data[4];
+    uint64_t edge_us;
+    bool matched;
+} expectation_t;
+
+typedef struct {
+    const char* name;
+    uint32_t events;            // 出力を伴うはずのエッジ数
+    uint32_t expected;
+    uint32_t received;
+    uint32_t dropped;           // 期待したのに届かなかったパケット
+    uint32_t unexpected;        // 期待していないパケット（チャタリングの誤検出など）
+    uint32_t sysex_requests;
+    uint32_t sysex_responses;
+    uint64_t duration_us;
+    double cpu_ns_per_event;    // アイドル時のループを差し引いたもの
+    uint64_t cpu_ns_total;
+    uint64_t cpu_ns_idle;
+    uint32_t latency_p50;
+    uint32_t latency_p90;
+    uint32_t latency_p99;
+    uint32_t latency_max;
+    uint32_t latency_budget_us; // --check時の上限（p99）
+    bool ok;
+} scenario_result_t;
+
+static expectation_t expectations[MAX_EXPECTED];
+static uint32_t expectation_count;
+static uint32_t latencies[MAX_EXPECTED];
+static uint32_t latency_count;
+static scenario_result_t* current;
+static bool quick;
+
+//--------------------------------------------------------------------+
+// Helpers
+//--------------------------------------------------------------------+
+
+static uint64_t cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t lcg_state = 12345;
+
+static uint32_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245u + 12345u;
+    return lcg_state >> 16;
+}
+
+static void expect(uint8_t cin, uint8_t status, uint8_t data1, uint8_t data2, uint64_t edge_us) {
+    if (expectation_count >= MAX_EXPECTED) return;
+    expectation_t* e = &expectations[expectation_count++];
+    e->data[0] = cin;
+    e->data[1] = status;
+    e->data[2] = data1;
+    e->data[3] = data2;
+    e->edge_us = edge_us;
+    e->matched = false;
+    current->expected++;
+}
+
+// デフォルト設定：スイッチnはCC nを押下127/解放0で送る
+static void expect_default(uint8_t switch_idx, bool pressed, uint64_t edge_us) {
+    expect(0x0B, 0xB0, switch_idx, pressed ? 127 : 0, edge_us);
+}
+
+static void on_packet(const sim_packet_t* packet, void* user) {
+    (void) user;
+    uint8_t cin = packet->data[0] & 0x0F;
+
+    if (packet->kind == SIM_PACKET_MIDI && cin >= 0x04 && cin <= 0x07) {
+        if (cin != 0x04) current->sysex_responses++;
+        return;
+    }
+
+    current->received++;
+    for (uint32_t i = 0; i < expectation_count; i++) {
+        expectation_t* e = &expectations[i];
+        // 古すぎる期待値には対応させない（1つの欠落で以降のレイテンシがずれるのを防ぐ）
+        if (e->matched || e->edge_us > packet->time_us ||
+            packet->time_us - e->edge_us > MATCH_WINDOW_US) {
+            continue;
+        }
+        if (memcmp(e->data, packet->data, 4) == 0) {
+            e->matched = true;
+            if (latency_count < MAX_EXPECTED) {
+                latencies[latency_count++] = (uint32_t)(packet->time_us - e->edge_us);
+            }
+            return;
+        }
+    }
+    current->unexpected++;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(uint32_t p) {
+    if (latency_count == 0) return 0;
+    size_t index = ((size_t)latency_count * p + 99) / 100;
+    if (index > 0) index--;
+    return latencies[index];
+}
+
+static void begin_scenario(scenario_result_t* result, const char* name, uint32_t budget_us) {
+    memset(result, 0, sizeof(*result));
+    result->name = name;
+    result->latency_budget_us = budget_us;
+    current = result;
+    expectation_count = 0;
+    latency_count = 0;
+    lcg_state = 12345;
+
+    sim_reset(NULL);
+    sim_set_packet_logging(false);
+    sim_set_packet_callback(on_packet, NULL);
+    sim_run_until(SETTLE_US);
+}
+
+static void send_sysex(const uint8_t* bytes, size_t len) {
+    sim_host_send(bytes, len);
+    current->sysex_requests++;
+}
+
+// 同じ仮想時間だけ何もせずに回したときのCPU時間を差し引く。
+// アイドルループが大半を占めるため差分はぶれやすく、安定した比較にはmicroの値を使う
+static void end_scenario(uint64_t cpu_start) {
+    sim_run_until(sim_now_us() + DRAIN_US);
+    uint64_t cpu_used = cpu_ns() - cpu_start;
+    uint64_t duration = sim_now_us();
+
+    sim_set_packet_callback(NULL, NULL);
+    sim_reset(NULL);
+    sim_set_packet_logging(false);
+    uint64_t idle_start = cpu_ns();
+    sim_run_until(duration);
+    uint64_t cpu_idle = cpu_ns() - idle_start;
+
+    scenario_result_t* r = current;
+    r->duration_us = duration - SETTLE_US;
+    r->cpu_ns_total = cpu_used;
+    r->cpu_ns_idle = cpu_idle;
+    r->cpu_ns_per_event = (cpu_used > cpu_idle && r->events > 0)
+        ? (double)(cpu_used - cpu_idle) / r->events : 0.0;
+
+    for (uint32_t i = 0; i < expectation_count; i++) {
+        if (!expectations[i].matched) r->dropped++;
+    }
+
+    qsort(latencies, latency_count, sizeof(latencies[0]), compare_u32);
+    r->latency_p50 = percentile(50);
+    r->latency_p90 = percentile(90);
+    r->latency_p99 = percentile(99);
+    r->latency_max = latency_count ? latencies[latency_count - 1] : 0;
+
+    r->ok = r->dropped == 0 && r->unexpected == 0 &&
+            r->sysex_responses == r->sysex_requests &&
+            r->latency_p99 <= r->latency_budget_us;
+}
+
+//--------------------------------------------------------------------+
+// Scenarios
+//--------------------------------------------------------------------+
+
+// 1スイッチの押下/解放。USBフレームに対するエッジの位相をずらして分布を取る
+static void scenario_single_press(scenario_result_t* r) {
+    begin_scenario(r, "single_press", 1100);
+    uint32_t iterations = quick ? 50 : 500;
+    uint64_t start = cpu_ns();
+
+    uint64_t t = SETTLE_US;
+    for (uint32_t i = 0; i < iterations; i++) {
+        t += 60000 + (i * 37) % 1000;
+        sim_run_until(t);
+        sim_set_switch(0, true);
+        expect_default(0, true, sim_now_us());
+
+        sim_run_until(t + 30000);
+        sim_set_switch(0, false);
+        expect_default(0, false, sim_now_us());
+        r->events += 2;
+    }
+    end_scenario(start);
+}
+
+// 全スイッチを同時に押下/解放
+static void scenario_simultaneous(scenario_result_t* r) {
+    begin_scenario(r, "simultaneous_presses", 1100);
+    uint32_t iterations = quick ? 20 : 200;
+    uint64_t start = cpu_ns();
+
+    uint64_t t = SETTLE_US;
+    for (uint32_t i = 0; i < iterations; i++) {
+        t += 60000 + (i * 37) % 1000;
+        sim_run_until(t);
+        for (uint8_t s = 0; s < num_switches; s++) {
+            sim_set_switch(s, true);
+            expect_default(s, true, sim_now_us());
+        }
+        sim_run_until(t + 30000);
+        for (uint8_t s = 0; s < num_switches; s++) {
+            sim_set_switch(s, false);
+            expect_default(s, false, sim_now_us());
+        }
+        r->events += 2 * num_switches;
+    }
+    end_scenario(start);
+}
+
+// チャタリング：最初のエッジから5ms以内にランダムにバウンスし、最終状態で安定
+static void bounce(uint8_t switch_idx, bool pressed, uint64_t t) {
+    uint8_t pin = switch_pins[switch_idx];
+    uint64_t at = t;
+    bool level = !pressed;
+
+    sim_run_until(at);
+    sim_set_pin(pin, level);
+    uint32_t bounces = 2 + lcg_next() % 6;
+    for (uint32_t b = 0; b < bounces; b++) {
+        at += 50 + lcg_next() % 800;
+        sim_run_until(at);
+        level = !level;
+        sim_set_pin(pin, level);
+    }
+    sim_run_until(at + 50);
+    sim_set_pin(pin, !pressed);
+}
+
+static void scenario_chatter(scenario_result_t* r) {
+    begin_scenario(r, "chattering_contacts", 1100);
+    uint32_t iterations = quick ? 30 : 300;
+    uint8_t switches = num_switches < 4 ? num_switches : 4;
+    uint64_t start = cpu_ns();
+
+    uint64_t t = SETTLE_US;
+    for (uint32_t i = 0; i < iterations; i++) {
+        for (uint8_t s = 0; s < switches; s++) {
+            t += 60000 + lcg_next() % 1000;
+            expect_default(s, true, t);
+            bounce(s, true, t);
+            t += 30000;
+            expect_default(s, false, t);
+            bounce(s, false, t);
+            r->events += 2;
+        }
+    }
+    end_scenario(start);
+}
+
+// 1イベント10メッセージのマクロ
+static void scenario_macro(scenario_result_t* r) {
+    begin_scenario(r, "macro_10_messages", 1100);
+    uint32_t iterations = quick ? 30 : 300;
+
+    // スイッチ0のpress/releaseにCC 20〜29 を設定
+    for (uint8_t event = 0; event < 2; event++) {
+        uint8_t sysex[8 + 10 * 4 + 1] = {0xF0, 0x00, 0x7D, 0x01, 0x03, 0x00, event, 10};
+        for (uint8_t m = 0; m < 10; m++) {
+            sysex[8 + m * 4 + 0] = 1;               // CC
+            sysex[8 + m * 4 + 1] = 0;
+            sysex[8 + m * 4 + 2] = 20 + m;
+            sysex[8 + m * 4 + 3] = event == 0 ? 127 : 0;
+        }
+        sysex[sizeof(sysex) - 1] = 0xF7;
+        send_sysex(sysex, sizeof(sysex));
+        sim_run_until(sim_now_us() + 10000);
+    }
+    r->sysex_requests = r->sysex_responses = 0;
+    uint64_t start = cpu_ns();
+
+    uint64_t t = sim_now_us();
+    for (uint32_t i = 0; i < iterations; i++) {
+        t += 60000 + (i * 37) % 1000;
+        sim_run_until(t);
+        sim_set_switch(0, true);
+        for (uint8_t m = 0; m < 10; m++) expect(0x0B, 0xB0, 20 + m, 127, sim_now_us());
+
+        sim_run_until(t + 30000);
+        sim_set_switch(0, false);
+        for (uint8_t m = 0; m < 10; m++) expect(0x0B, 0xB0, 20 + m, 0, sim_now_us());
+        r->events += 2;
+    }
+    end_scenario(start);
+}
+
+// スイッチ操作と並行して設定の読み出し/書き込みSysExが流れる
+static void scenario_sysex_concurrent(scenario_result_t* r) {
+    begin_scenario(r, "concurrent_sysex", 1100);
+    uint32_t iterations = quick ? 50 : 500;
+    uint8_t switches = num_switches < 4 ? num_switches : 4;
+    uint64_t start = cpu_ns();
+
+    uint64_t t = SETTLE_US;
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint8_t s = i % switches;
+        t += 60000;
+        for (uint32_t k = 0; k < 30; k++) {
+            sim_run_until(t + k * 2000);
+            uint8_t get[] = {0xF0, 0x00, 0x7D, 0x01, 0x02, (uint8_t)(k % num_switches), (uint8_t)(k & 1), 0xF7};
+            send_sysex(get, sizeof(get));
+            if (k == 5) {
+                sim_set_switch(s, true);
+                expect_default(s, true, sim_now_us());
+            }
+            if (k == 20) {
+                sim_set_switch(s, false);
+                expect_default(s, false, sim_now_us());
+            }
+        }
+        // 最後のスイッチ以外の設定を同じ内容で書き戻す（フラッシュ書き込みを伴う）
+        if (i % 10 == 0 && num_switches > 1) {
+            uint8_t w = num_switches - 1;
+            uint8_t set[] = {0xF0, 0x00, 0x7D, 0x01, 0x03, w, 0x00, 0x01, 0x01, 0x00, w, 0x7F, 0xF7};
+            send_sysex(set, sizeof(set));
+        }
+        r->events += 2;
+    }
+    end_scenario(start);
+}
+
+//--------------------------------------------------------------------+
+// Micro benchmarks
+//--------------------------------------------------------------------+
+
+typedef struct {
+    const char* name;
+    double ns_per_op;
+} micro_result_t;
+
+static double measure(void (*body)(void), uint32_t iterations) {
+    uint64_t start = cpu_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        body();
+    }
+    return (double)(cpu_ns() - start) / iterations;
+}
+
+static void micro_scan_idle(void) {
+    check_switches();
+}
+
+static void micro_send_event(void) {
+    send_midi_messages(0);
+    service_output_queue();
+    sim_tx_discard();
+}
+
+static void micro_rx_feedback(void) {
+    static const uint8_t packet[4] = {0x0B, 0xBF, 0x00, 0x7F};
+    sim_rx_inject(packet);
+    midi_rx_task();
+}
+
+static void micro_rx_sysex_get(void) {
+    static const uint8_t packets[3][4] = {
+        {0x04, 0xF0, 0x00, 0x7D},
+        {0x04, 0x01, 0x02, 0x00},
+        {0x06, 0x00, 0xF7, 0x00},
+    };
+    for (int i = 0; i < 3; i++) sim_rx_inject(packets[i]);
+    midi_rx_task();
+    sim_tx_discard();
+}
+
+static void run_micro(micro_result_t* results) {
+    uint32_t iterations = quick ? 100000 : 2000000;
+
+    sim_reset(NULL);
+    sim_set_packet_logging(false);
+    sim_run_until(SETTLE_US);
+
+    results[0] = (micro_result_t){"check_switches_idle", measure(micro_scan_idle, iterations)};
+    results[1] = (micro_result_t){"send_event_1_message", measure(micro_send_event, iterations)};
+    results[2] = (micro_result_t){"rx_feedback_packet", measure(micro_rx_feedback, iterations)};
+    results[3] = (micro_result_t){"rx_sysex_get_message", measure(micro_rx_sysex_get, iterations / 10)};
+}
+
+//--------------------------------------------------------------------+
+// Output
+//--------------------------------------------------------------------+
+
+static void write_json(FILE* out, const scenario_result_t* scenarios, size_t scenario_count,
+                       const micro_result_t* micro, size_t micro_count) {
+    fprintf(out, "{\n  \"num_switches\": %u,\n  \"scenarios\": [\n", num_switches);
+    for (size_t i = 0; i < scenario_count; i++) {
+        const scenario_result_t* r = &scenarios[i];
+        double seconds = r->duration_us / 1e6;
+        fprintf(out,
+            "    {\"name\": \"%s\", \"events\": %u, \"expected_packets\": %u, \"received_packets\": %u, "
+            "\"dropped\": %u, \"unexpected\": %u, \"sysex_requests\": %u, \"sysex_responses\": %u, "
+            "\"packets_per_sec\": %.1f, \"latency_us\": {\"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u}, "
+            "\"latency_budget_us\": %u, \"cpu_ns_per_event\": %.1f, \"cpu_ns_total\": %llu, \"cpu_ns_idle\": %llu, \"ok\": %s}%s\n",
+            r->name, r->events, r->expected, r->received, r->dropped, r->unexpected,
+            r->sysex_requests, r->sysex_responses,
+            seconds > 0 ? r->received / seconds : 0.0,
+            r->latency_p50, r->latency_p90, r->latency_p99, r->latency_max,
+            r->latency_budget_us, r->cpu_ns_per_event,
+            (unsigned long long)r->cpu_ns_total, (unsigned long long)r->cpu_ns_idle, r->ok ? "true" : "false",
+            i + 1 < scenario_count ? "," : "");
+    }
+    fprintf(out, "  ],\n  \"micro\": [\n");
+    for (size_t i = 0; i < micro_count; i++) {
+        fprintf(out, "    {\"name\": \"%s\", \"ns_per_op\": %.1f}%s\n",
+            micro[i].name, micro[i].ns_per_op, i + 1 < micro_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    bool check = false;
+    const char* output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--check] [-o result.json]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    scenario_result_t scenarios[5];
+    scenario_single_press(&scenarios[0]);
+    scenario_simultaneous(&scenarios[1]);
+    scenario_chatter(&scenarios[2]);
+    scenario_macro(&scenarios[3]);
+    scenario_sysex_concurrent(&scenarios[4]);
+
+    micro_result_t micro[4];
+    run_micro(micro);
+
+    size_t scenario_count = sizeof(scenarios) / sizeof(scenarios[0]);
+    size_t micro_count = sizeof(micro) / sizeof(micro[0]);
+
+    write_json(stdout, scenarios, scenario_count, micro, micro_count);
+    if (output) {
+        FILE* out = fopen(output, "w");
+        if (!out) {
+            perror(output);
+            return 2;
+        }
+        write_json(out, scenarios, scenario_count, micro, micro_count);
+        fclose(out);
+    }
+
+    if (check) {
+        for (size_t i = 0; i < scenario_count; i++) {
+            if (!scenarios[i].ok) {
+                fprintf(stderr, "scenario %s failed\n", scenarios[i].name);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
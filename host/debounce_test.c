@@ -0,0 +1,187 @@
+// スイッチ毎のチャタリング学習（適応デバウンス）の検査
+//
+// usage: debounce_test
+//
+// チャタリングの短いスイッチでは受け付け窓が縮んで短い押下の解放がすぐ届くこと、
+// 学習前の窓より長くチャタリングする摩耗したスイッチでは窓が伸びて誤検出がなくなること、
+// 学習した窓が操作のない間に保存されて再起動後に使われること、ピンを変えたスイッチの学習値は捨てることを確認する。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "flash_sim.h"
+
+#define LOOP_US 50
+#define DEBOUNCE_TIME_MS 20
+#define SAVE_INTERVAL_MS (10 * 60 * 1000)
+
+static uint32_t lcg = 12345;
+
+static uint32_t lcg_next(void) {
+    lcg = lcg * 1103515245u + 12345u;
+    return lcg >> 8;
+}
+
+typedef struct {
+    uint8_t window_ms;
+    uint8_t saved_ms;
+    uint8_t samples;
+} debounce_info_t;
+
+static bool get_debounce(uint8_t switch_idx, debounce_info_t* info) {
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, 0x0C, switch_idx, 0xF7};
+    uint8_t response[64];
+    size_t len = test_request(sysex, sizeof(sysex), response, sizeof(response));
+    if (len != 10 + 32 + 1 || response[5] != switch_idx || response[9] != 32) return false;
+
+    info->window_ms = response[6];
+    info->saved_ms = response[7];
+    info->samples = response[8];
+    uint32_t total = 0;
+    for (int b = 0; b < 32; b++) total += response[10 + b];
+    return total == info->samples;
+}
+
+// 最初のエッジから bounce_us の間に短いパルス（元のレベルへの戻り）を加えてから安定させる
+// 最後のパルスは bounce_us の近くで終わる
+static void edge_with_bounce(uint8_t switch_idx, bool pressed, uint32_t bounce_us) {
+    uint64_t t = sim_now_us();
+    sim_set_switch(switch_idx, pressed);
+
+    uint32_t pulses = 2 + lcg_next() % 4;
+    for (uint32_t p = 0; p < pulses && bounce_us >= 400; p++) {
+        uint32_t end = (p == pulses - 1) ? bounce_us - lcg_next() % 300
+                                         : 300 + lcg_next() % (bounce_us - 300);
+        uint64_t start = t + end - 200 - lcg_next() % 100;
+        if (start > sim_now_us()) sim_run_until(start);
+        sim_set_switch(switch_idx, !pressed);
+        sim_run_until(t + end);
+        sim_set_switch(switch_idx, pressed);
+    }
+}
+
+// 押下/解放のパケット数（デフォルト設定: スイッチsはCC s）
+static uint32_t count_events(uint8_t switch_idx) {
+    uint32_t n = 0;
+    for (size_t i = 0; i < sim_packet_count(); i++) {
+        const sim_packet_t* packet = sim_packet_at(i);
+        if (packet->kind == SIM_PACKET_MIDI && (packet->data[0] & 0x0F) == 0x0B && packet->data[2] == switch_idx) {
+            n++;
+        }
+    }
+    return n;
+}
+
+// 押下/解放を cycles 回繰り返し、受け付けた余分なイベント数を返す
+static uint32_t press_cycles(uint8_t switch_idx, uint32_t cycles, uint32_t bounce_us) {
+    sim_clear_packets();
+    for (uint32_t i = 0; i < cycles; i++) {
+        edge_with_bounce(switch_idx, true, bounce_us);
+        sim_run_until(sim_now_us() + 60000);
+        edge_with_bounce(switch_idx, false, bounce_us);
+        sim_run_until(sim_now_us() + 60000);
+    }
+    return count_events(switch_idx) - 2 * cycles;
+}
+
+// チャタリングの短いスイッチは窓が縮み、短い押下の解放を待たせない
+static void test_clean_switch(void) {
+    test_boot(true, LOOP_US);
+    debounce_info_t info;
+    CHECK(get_debounce(0, &info));
+    CHECK(info.window_ms == DEBOUNCE_TIME_MS && info.saved_ms == 0 && info.samples == 0);
+
+    CHECK(press_cycles(0, 40, 1500) == 0);
+    CHECK(get_debounce(0, &info));
+    CHECK(info.samples >= 32 && info.window_ms <= 5);
+
+    // 8msの押下: 学習前は解放が窓の終わり（20ms）まで遅れる
+    sim_clear_packets();
+    uint64_t pressed_at = sim_now_us();
+    sim_set_switch(0, true);
+    sim_run_until(pressed_at + 8000);
+    sim_set_switch(0, false);
+    sim_run_until(pressed_at + 40000);
+    CHECK(sim_packet_count() == 2);
+    if (sim_packet_count() == 2) {
+        uint64_t release_latency = sim_packet_at(1)->time_us - pressed_at;
+        CHECK(release_latency < 11000);
+        printf("{\"switch\": \"clean\", \"window_ms\": %u, \"short_press_release_us\": %llu}\n",
+               info.window_ms, (unsigned long long)release_latency);
+    }
+}
+
+// 学習前の窓より長くチャタリングするスイッチは、窓が伸びて誤検出がなくなる
+static void test_worn_switch(void) {
+    test_boot(true, LOOP_US);
+    uint32_t before = press_cycles(1, 40, 26000);
+    for (int i = 0; i < 6; i++) {
+        press_cycles(1, 40, 26000);
+    }
+    uint32_t after = press_cycles(1, 40, 26000);
+
+    debounce_info_t info;
+    CHECK(get_debounce(1, &info));
+    CHECK(before > 0);
+    CHECK(after == 0);
+    CHECK(info.window_ms > 26 && info.window_ms <= 31);
+    printf("{\"switch\": \"worn\", \"window_ms\": %u, \"false_events_before\": %u, \"false_events_after\": %u}\n",
+           info.window_ms, before, after);
+}
+
+// 学習した窓は操作のない間に時々保存し、再起動後はそこから始める
+static void test_persistence(void) {
+    test_boot(true, LOOP_US);
+    press_cycles(0, 40, 1500);
+    debounce_info_t learned;
+    CHECK(get_debounce(0, &learned));
+
+    // 操作中・保存間隔の前には書き込まない
+    uint32_t erases = flash_sim_stats()->erases;
+    sim_run_until((uint64_t)(SAVE_INTERVAL_MS - 1000) * 1000);
+    CHECK(flash_sim_stats()->erases == erases);
+    sim_run_until((uint64_t)(SAVE_INTERVAL_MS + 1000) * 1000);
+    CHECK(flash_sim_stats()->erases == erases + 1);
+
+    // 変化がなければ次の間隔でも書かない
+    sim_run_until((uint64_t)(2 * SAVE_INTERVAL_MS + 1000) * 1000);
+    CHECK(flash_sim_stats()->erases == erases + 1);
+
+    test_boot(false, LOOP_US);
+    debounce_info_t info;
+    CHECK(get_debounce(0, &info));
+    CHECK(info.window_ms == learned.window_ms && info.saved_ms == learned.window_ms && info.samples == 0);
+    CHECK(get_debounce(1, &info));
+    CHECK(info.window_ms == DEBOUNCE_TIME_MS && info.saved_ms == 0);
+
+    // ピンを変えたスイッチの学習値は捨て、変えていないスイッチは残す
+    uint8_t pins[] = {0xF0, 0x00, 0x7D, 0x01, 0x09, 0xF7};
+    uint8_t response[32];
+    size_t len = test_request(pins, sizeof(pins), response, sizeof(response));
+    CHECK(len >= 9 && len == 7u + response[5]);
+    if (len >= 9) {
+        uint8_t set[] = {0xF0, 0x00, 0x7D, 0x01, 0x0A, 0x02, response[6], 20, 0xF7};
+        len = test_request(set, sizeof(set), response, sizeof(response));
+        CHECK(len == 7 && response[5] == 0x00);
+        CHECK(get_debounce(0, &info));
+        CHECK(info.saved_ms == learned.window_ms && info.window_ms == learned.window_ms);
+
+        uint8_t swap[] = {0xF0, 0x00, 0x7D, 0x01, 0x0A, 0x02, 20, 21, 0xF7};
+        len = test_request(swap, sizeof(swap), response, sizeof(response));
+        CHECK(len == 7 && response[5] == 0x00);
+        CHECK(get_debounce(0, &info));
+        CHECK(info.saved_ms == 0 && info.window_ms == DEBOUNCE_TIME_MS);
+    }
+}
+
+int main(void) {
+    sim_set_packet_logging(true);
+
+    test_clean_switch();
+    test_worn_switch();
+    test_persistence();
+
+    return test_result();
+}
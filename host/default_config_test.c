@@ -0,0 +1,100 @@
+// JSONプロファイル（scripts/profile.json）から生成した初期設定の検査
+//
+// usage: default_config_test
+//
+// 空のフラッシュで起動してもプロファイルの設定で動作し、フラッシュに書き込まないこと、
+// 設定を変更すると通常どおり保存されて次の起動ではそちらが使われることを確認する。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "flash_sim.h"
+
+// フラッシュの書き込み中は仮想時間を止めて起動する
+static void boot(bool erase_flash) {
+    sim_options_t options;
+    sim_default_options(&options);
+    options.erase_flash = erase_flash;
+    options.flash_stalls = true;
+    test_boot_with(&options);
+}
+
+static void check_response(const uint8_t* sysex, size_t len, const uint8_t* expected, size_t expected_len) {
+    uint8_t response[64];
+    size_t n = test_request(sysex, len, response, sizeof(response));
+    CHECK(n == expected_len && memcmp(response, expected, n) == 0);
+}
+
+static void test_profile_is_default(void) {
+    boot(true);
+    CHECK(flash_sim_stats()->erases == 0);
+    CHECK(sim_usb_init_us() == 0);
+
+    uint8_t info[] = {0xF0, 0x00, 0x7D, 0x01, 0x01, 0xF7};
+    uint8_t info_expected[] = {0xF0, 0x00, 0x7D, 0x01, 0x01, 3, 0x01, 0xF7};
+    check_response(info, sizeof(info), info_expected, sizeof(info_expected));
+
+    uint8_t pins[] = {0xF0, 0x00, 0x7D, 0x01, 0x09, 0xF7};
+    uint8_t pins_expected[] = {0xF0, 0x00, 0x7D, 0x01, 0x09, 3, 20, 5, 9, 0xF7};
+    check_response(pins, sizeof(pins), pins_expected, sizeof(pins_expected));
+
+    uint8_t get[] = {0xF0, 0x00, 0x7D, 0x01, 0x02, 0x00, 0x00, 0xF7};
+    uint8_t get_expected[] = {0xF0, 0x00, 0x7D, 0x01, 0x02, 0x00, 0x00, 2, 2, 1, 5, 0, 3, 0, 60, 100, 0xF7};
+    check_response(get, sizeof(get), get_expected, sizeof(get_expected));
+
+    uint8_t map[] = {0xF0, 0x00, 0x7D, 0x01, 0x06, 0x01, 0xF7};
+    uint8_t map_expected[] = {0xF0, 0x00, 0x7D, 0x01, 0x06, 0x01, 14, 1, 1, 1, 2, 0xF7};
+    check_response(map, sizeof(map), map_expected, sizeof(map_expected));
+
+    uint8_t groups[] = {0xF0, 0x00, 0x7D, 0x01, 0x12, 0xF7};
+    uint8_t groups_expected[6 + 8 * 3 + 1] = {0xF0, 0x00, 0x7D, 0x01, 0x12, 8, 0x05};
+    groups_expected[sizeof(groups_expected) - 1] = 0xF7;
+    check_response(groups, sizeof(groups), groups_expected, sizeof(groups_expected));
+
+    // スイッチ1（GP5）の押下でプロファイルのCCが届く
+    sim_clear_packets();
+    sim_set_pin(5, false);
+    sim_run_until(sim_now_us() + 5000);
+    CHECK(sim_packet_count() == 1);
+    if (sim_packet_count() == 1) {
+        const uint8_t* data = sim_packet_at(0)->data;
+        CHECK(data[0] == 0x0B && data[1] == 0xB2 && data[2] == 64 && data[3] == 127);
+    }
+    sim_set_pin(5, true);
+    sim_run_until(sim_now_us() + 50000);
+
+    // 何度起動しても書き込まない
+    boot(false);
+    CHECK(flash_sim_stats()->erases == 0);
+}
+
+static void test_changes_are_saved(void) {
+    boot(true);
+
+    uint8_t color[] = {0xF0, 0x00, 0x7D, 0x01, 0x05, 0x02, 10, 20, 30, 0xF7};
+    uint8_t ok[] = {0xF0, 0x00, 0x7D, 0x01, 0x05, 0x00, 0xF7};
+    check_response(color, sizeof(color), ok, sizeof(ok));
+    CHECK(flash_sim_stats()->erases == 1);
+
+    // 保存した設定はプロファイルより優先され、プロファイルの他の項目も引き継いでいる
+    boot(false);
+    uint8_t colors[] = {0xF0, 0x00, 0x7D, 0x01, 0x04, 0xF7};
+    uint8_t response[64];
+    size_t len = test_request(colors, sizeof(colors), response, sizeof(response));
+    CHECK(len == 6 + 6 * 3 + 1 && response[6 + 2 * 3] == 10 && response[6 + 2 * 3 + 1] == 20);
+
+    uint8_t pins[] = {0xF0, 0x00, 0x7D, 0x01, 0x09, 0xF7};
+    uint8_t pins_expected[] = {0xF0, 0x00, 0x7D, 0x01, 0x09, 3, 20, 5, 9, 0xF7};
+    check_response(pins, sizeof(pins), pins_expected, sizeof(pins_expected));
+}
+
+int main(void) {
+    sim_set_packet_logging(true);
+
+    test_profile_is_default();
+    test_changes_are_saved();
+
+    return test_result();
+}
@@ -0,0 +1,175 @@
+// 排他グループ（ラジオボタン）の検査
+//
+// usage: exclusive_test
+//
+// グループのメンバーを押すと、選択中の他のメンバーの解放イベント（解除）と押下イベントが
+// 同じUSBフレームで届き、離しても何も送らないこと、グループ外のスイッチは今までどおりであること、
+// 選択中のメンバーのLEDが点灯したままになること、グループの設定が保存されること、不正な設定を断ることを確認する。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+
+#define LOOP_US 50
+#define PIXEL_PRESSED 0xFF000000u   // 緑（押下中の既定色、GRB << 8）
+#define PIXEL_IDLE 0x00000800u      // 暗い青（待機の既定色）
+
+enum { CMD_SET_MESSAGE = 0x03, CMD_GET_EXCLUSIVE_GROUPS = 0x12, CMD_SET_EXCLUSIVE_GROUP = 0x13 };
+
+// グループのメンバーを設定し、結果（0: 成功、1: エラー、-1: 応答なし）を返す
+static int set_group(uint8_t group, uint32_t members) {
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, CMD_SET_EXCLUSIVE_GROUP, group,
+                       members & 0x7F, (members >> 7) & 0x7F, (members >> 14) & 0x7F, 0xF7};
+    return test_command(sysex, sizeof(sysex));
+}
+
+static bool get_groups(uint32_t groups[8]) {
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, CMD_GET_EXCLUSIVE_GROUPS, 0xF7};
+    uint8_t response[64];
+    size_t len = test_request(sysex, sizeof(sysex), response, sizeof(response));
+    if (len != 6 + 8 * 3 + 1 || response[5] != 8) return false;
+    for (int g = 0; g < 8; g++) {
+        const uint8_t* m = &response[6 + g * 3];
+        groups[g] = m[0] | m[1] << 7 | m[2] << 14;
+    }
+    return true;
+}
+
+// スイッチを押して（または離して）届いたCCを返す（デフォルト設定: スイッチsの押下はCC s = 127、解放はCC s = 0）
+typedef struct {
+    uint8_t number;
+    uint8_t value;
+    uint64_t time_us;
+} cc_t;
+
+static size_t set_switch(uint8_t switch_idx, bool pressed, cc_t* out, size_t max) {
+    sim_clear_packets();
+    sim_set_switch(switch_idx, pressed);
+    sim_run_until(sim_now_us() + 60000);
+
+    size_t n = 0;
+    for (size_t i = 0; i < sim_packet_count() && n < max; i++) {
+        const sim_packet_t* packet = sim_packet_at(i);
+        if (packet->kind == SIM_PACKET_MIDI && (packet->data[0] & 0x0F) == 0x0B) {
+            out[n].number = packet->data[2];
+            out[n].value = packet->data[3];
+            out[n].time_us = packet->time_us;
+            n++;
+        }
+    }
+    return n;
+}
+
+static bool is_cc(const cc_t* cc, uint8_t number, uint8_t value) {
+    return cc->number == number && cc->value == value;
+}
+
+// 押下で前の選択を解除し、解除と押下は同じフレームで届く
+static void test_radio(void) {
+    test_boot(true, LOOP_US);
+    CHECK(set_group(0, 0x0007) == 0);   // スイッチ0-2
+
+    cc_t cc[16];
+    size_t n = set_switch(0, true, cc, 16);
+    CHECK(n == 1 && is_cc(&cc[0], 0, 127));
+    n = set_switch(0, false, cc, 16);
+    CHECK(n == 0);
+    CHECK(sim_ws2812_pixel(0) == PIXEL_PRESSED);
+
+    // スイッチ1: スイッチ0の解除（解放イベント）の後に押下
+    n = set_switch(1, true, cc, 16);
+    CHECK(n == 2 && is_cc(&cc[0], 0, 0) && is_cc(&cc[1], 1, 127));
+    if (n == 2) CHECK(cc[0].time_us == cc[1].time_us);
+    CHECK(sim_ws2812_pixel(0) == PIXEL_IDLE);
+    set_switch(1, false, cc, 16);
+    CHECK(sim_ws2812_pixel(1) == PIXEL_PRESSED);
+
+    // 選択中のメンバーを押し直すと押下だけを送る
+    n = set_switch(1, true, cc, 16);
+    CHECK(n == 1 && is_cc(&cc[0], 1, 127));
+    set_switch(1, false, cc, 16);
+
+    // グループ外のスイッチは今までどおり
+    n = set_switch(3, true, cc, 16);
+    CHECK(n == 1 && is_cc(&cc[0], 3, 127));
+    n = set_switch(3, false, cc, 16);
+    CHECK(n == 1 && is_cc(&cc[0], 3, 0));
+    CHECK(sim_ws2812_pixel(1) == PIXEL_PRESSED);
+
+    // 複数メッセージの解除と押下も1つのフレームにまとめて届く
+    uint8_t release[] = {0xF0, 0x00, 0x7D, 0x01, CMD_SET_MESSAGE, 1, 1, 3,
+                         0x01, 0x00, 30, 0, 0x01, 0x00, 31, 0, 0x01, 0x00, 32, 0, 0xF7};
+    uint8_t press[] = {0xF0, 0x00, 0x7D, 0x01, CMD_SET_MESSAGE, 2, 0, 3,
+                       0x01, 0x00, 40, 127, 0x01, 0x00, 41, 127, 0x01, 0x00, 42, 127, 0xF7};
+    uint8_t response[16];
+    CHECK(test_request(release, sizeof(release), response, sizeof(response)) == 7 && response[5] == 0);
+    CHECK(test_request(press, sizeof(press), response, sizeof(response)) == 7 && response[5] == 0);
+    n = set_switch(2, true, cc, 16);
+    CHECK(n == 6);
+    for (size_t i = 0; i < n && n == 6; i++) {
+        CHECK(is_cc(&cc[i], i < 3 ? 30 + i : 40 + i - 3, i < 3 ? 0 : 127));
+        CHECK(cc[i].time_us == cc[0].time_us);
+    }
+    set_switch(2, false, cc, 16);
+}
+
+// スイッチが2つのグループに属する場合は両方のメンバーを解除する
+static void test_overlapping_groups(void) {
+    test_boot(true, LOOP_US);
+    CHECK(set_group(0, 0x0003) == 0);   // スイッチ0, 1
+    CHECK(set_group(1, 0x0006) == 0);   // スイッチ1, 2
+
+    cc_t cc[16];
+    set_switch(0, true, cc, 16);
+    set_switch(0, false, cc, 16);
+    set_switch(2, true, cc, 16);
+    set_switch(2, false, cc, 16);
+    size_t n = set_switch(1, true, cc, 16);
+    CHECK(n == 3 && is_cc(&cc[0], 0, 0) && is_cc(&cc[1], 2, 0) && is_cc(&cc[2], 1, 127));
+    set_switch(1, false, cc, 16);
+
+    // グループを外すと解放イベントは離したときに戻る
+    CHECK(set_group(0, 0) == 0);
+    CHECK(set_group(1, 0) == 0);
+    n = set_switch(1, true, cc, 16);
+    CHECK(n == 1 && is_cc(&cc[0], 1, 127));
+    n = set_switch(1, false, cc, 16);
+    CHECK(n == 1 && is_cc(&cc[0], 1, 0));
+}
+
+// 設定は保存され、不正な設定は断る
+static void test_config(void) {
+    test_boot(true, LOOP_US);
+    uint32_t groups[8];
+    CHECK(get_groups(groups));
+    for (int g = 0; g < 8; g++) CHECK(groups[g] == 0);
+
+    CHECK(set_group(2, 0x8001) == 0);
+    CHECK(set_group(7, 0x00F0) == 0);
+    CHECK(set_group(8, 0x0003) == 1);       // グループ番号
+    CHECK(set_group(0, 0x0004) == 1);       // メンバーが1つ
+    CHECK(set_group(0, 0x10003) == 1);      // スイッチ数の外
+
+    test_boot(false, LOOP_US);
+    CHECK(get_groups(groups));
+    CHECK(groups[2] == 0x8001 && groups[7] == 0x00F0 && groups[0] == 0);
+
+    // 再起動後は選択なし（最初の押下は解除を送らない）
+    cc_t cc[16];
+    size_t n = set_switch(15, true, cc, 16);
+    CHECK(n == 1 && is_cc(&cc[0], 15, 127));
+    n = set_switch(0, true, cc, 16);
+    CHECK(n == 2 && is_cc(&cc[0], 15, 0) && is_cc(&cc[1], 0, 127));
+}
+
+int main(void) {
+    sim_set_packet_logging(true);
+
+    test_radio();
+    test_overlapping_groups();
+    test_config();
+
+    return test_result();
+}
@@ -0,0 +1,138 @@
+#include "flash_sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+uint8_t sim_flash_image[PICO_FLASH_SIZE_BYTES];
+
+static flash_sim_stats_t stats;
+static uint64_t pending_blackout_us;
+
+static FILE* backing_file;
+static uint32_t backing_offset;
+static size_t backing_size;
+
+// 変更した範囲のうちファイルに割り当てた部分を書き戻す
+static void sync_backing(uint32_t offset, size_t count) {
+    if (!backing_file) return;
+
+    uint32_t start = offset > backing_offset ? offset : backing_offset;
+    uint64_t end = (uint64_t)offset + count;
+    uint64_t backing_end = (uint64_t)backing_offset + backing_size;
+    if (end > backing_end) end = backing_end;
+    if (start >= end) return;
+
+    fseek(backing_file, (long)(start - backing_offset), SEEK_SET);
+    fwrite(&sim_flash_image[start], 1, (size_t)(end - start), backing_file);
+    fflush(backing_file);
+}
+
+// 範囲をイメージ内に収める。範囲外ならfalse
+static bool clamp_range(uint32_t flash_offs, size_t* count) {
+    if (flash_offs >= sizeof(sim_flash_image)) return false;
+    if (*count > sizeof(sim_flash_image) - flash_offs) *count = sizeof(sim_flash_image) - flash_offs;
+    return true;
+}
+
+static void add_blackout(uint64_t us) {
+    stats.blackout_us += us;
+    pending_blackout_us += us;
+}
+
+void flash_sim_erase_all(void) {
+    memset(sim_flash_image, 0xFF, sizeof(sim_flash_image));
+    sync_backing(0, sizeof(sim_flash_image));
+    flash_sim_reset_stats();
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    // SDKは消去をセクタ単位でしか受け付けない
+    if ((flash_offs | count) & (FLASH_SECTOR_SIZE - 1)) {
+        stats.misaligned_ops++;
+    }
+    if (!clamp_range(flash_offs, &count)) return;
+
+    // 実機と同じく、範囲が掛かるセクタ全体を消去する
+    uint32_t first = flash_offs / FLASH_SECTOR_SIZE;
+    uint32_t last = (uint32_t)((flash_offs + count + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE);
+    for (uint32_t sector = first; sector < last && sector < FLASH_SIM_SECTORS; sector++) {
+        memset(&sim_flash_image[sector * FLASH_SECTOR_SIZE], 0xFF, FLASH_SECTOR_SIZE);
+        stats.erase_count[sector]++;
+        stats.erases++;
+        add_blackout(FLASH_SIM_SECTOR_ERASE_US);
+    }
+    sync_backing(first * FLASH_SECTOR_SIZE, (last - first) * FLASH_SECTOR_SIZE);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count) {
+    // SDKは書き込みをページ単位でしか受け付けない
+    if ((flash_offs | count) & (FLASH_PAGE_SIZE - 1)) {
+        stats.misaligned_ops++;
+    }
+    if (!clamp_range(flash_offs, &count)) return;
+
+    // NOR：書き込みはビットを0にするだけ
+    for (size_t i = 0; i < count; i++) {
+        uint8_t current = sim_flash_image[flash_offs + i];
+        stats.bits_not_cleared += (uint32_t)__builtin_popcount(data[i] & ~current & 0xFF);
+        sim_flash_image[flash_offs + i] = current & data[i];
+    }
+
+    uint32_t pages = (uint32_t)((count + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE);
+    stats.pages_programmed += pages;
+    stats.bytes_programmed += count;
+    add_blackout((uint64_t)pages * FLASH_SIM_PAGE_PROGRAM_US);
+    sync_backing(flash_offs, count);
+}
+
+const flash_sim_stats_t* flash_sim_stats(void) {
+    return &stats;
+}
+
+void flash_sim_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+    pending_blackout_us = 0;
+}
+
+uint32_t flash_sim_max_erase_count(void) {
+    uint32_t max = 0;
+    for (uint32_t i = 0; i < FLASH_SIM_SECTORS; i++) {
+        if (stats.erase_count[i] > max) max = stats.erase_count[i];
+    }
+    return max;
+}
+
+uint64_t flash_sim_take_blackout_us(void) {
+    uint64_t us = pending_blackout_us;
+    pending_blackout_us = 0;
+    return us;
+}
+
+bool flash_sim_attach_file(const char* path, uint32_t offset, size_t size) {
+    flash_sim_detach_file();
+    if (!clamp_range(offset, &size)) return false;
+
+    FILE* file = fopen(path, "r+b");
+    if (!file) file = fopen(path, "w+b");
+    if (!file) return false;
+
+    memset(&sim_flash_image[offset], 0xFF, size);
+    size_t loaded = fread(&sim_flash_image[offset], 1, size, file);
+
+    backing_file = file;
+    backing_offset = offset;
+    backing_size = size;
+
+    // 新規・短いファイルは消去状態で埋めておく
+    if (loaded < size) {
+        sync_backing(offset + (uint32_t)loaded, size - loaded);
+    }
+    return true;
+}
+
+void flash_sim_detach_file(void) {
+    if (backing_file) {
+        fclose(backing_file);
+        backing_file = NULL;
+    }
+}
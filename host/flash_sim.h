@@ -0,0 +1,48 @@
+#ifndef PICOMIDI_FLASH_SIM_H
+#define PICOMIDI_FLASH_SIM_H
+
+// ホストビルド用のフラッシュ（XIPイメージ）
+//
+// NORフラッシュと同じく、消去でセクタ全体が0xFFになり、書き込みはビットを0にすることしかできない。
+// 消去回数（セクタ毎）、書き込みバイト数、SDKの制約（セクタ/ページ境界）違反、
+// データシートの典型値から見積もった書き込み中の停止時間を記録する。
+// 範囲をファイルに割り当てると、内容はプロセスをまたいで保持される。
+
+#include <stdbool.h>
+#include "hardware/flash.h"
+
+#define FLASH_SIM_SECTORS (PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE)
+
+// W25Q16JV（Pico搭載）の典型値
+#define FLASH_SIM_SECTOR_ERASE_US 45000   // tSE 4KBセクタ消去
+#define FLASH_SIM_PAGE_PROGRAM_US 400     // tPP 256バイトページ書き込み
+#define FLASH_SIM_ENDURANCE_CYCLES 100000 // セクタあたりの消去/書き込み保証回数
+
+typedef struct {
+    uint32_t erase_count[FLASH_SIM_SECTORS];  // セクタ毎の消去回数
+    uint32_t erases;               // 消去したセクタ数の合計
+    uint32_t pages_programmed;
+    uint64_t bytes_programmed;
+    uint32_t misaligned_ops;       // セクタ/ページ境界に揃っていない消去・書き込み
+    uint32_t bits_not_cleared;     // 消去せずに0→1へ書こうとしたビット数
+    uint64_t blackout_us;          // 消去・書き込みでXIPが止まっていた時間の合計
+} flash_sim_stats_t;
+
+// フラッシュ全体を消去状態（0xFF）にし、統計をリセットする（ファイルの範囲も消去される）
+void flash_sim_erase_all(void);
+
+const flash_sim_stats_t* flash_sim_stats(void);
+void flash_sim_reset_stats(void);
+
+// 最も多く消去されたセクタの消去回数
+uint32_t flash_sim_max_erase_count(void);
+
+// 前回の呼び出し以降の停止時間を取り出す（シミュレータの仮想時間を止めるため）
+uint64_t flash_sim_take_blackout_us(void);
+
+// [offset, offset + size) をファイルに割り当てる。既存のファイルの内容を読み込み、
+// 足りない部分は消去状態とする。以降の消去・書き込みはファイルにも反映する
+bool flash_sim_attach_file(const char* path, uint32_t offset, size_t size);
+void flash_sim_detach_file(void);
+
+#endif // PICOMIDI_FLASH_SIM_H
@@ -0,0 +1,306 @@
+// フラッシュへの設定の保存/読み込みの検査（ファイルに割り当てたNORフラッシュ上で実行）
+//
+// usage: flash_test [work_dir]
+//
+// 保存・再起動後の読み込み（ピン割り当てを含む）・保存済みの設定をフラッシュから直接読むこと・
+// A/Bスロットによる書き込み中の電源断からの復帰・破損時のデフォルトへの復帰・SDKの制約（セクタ/ページ境界、
+// 消去せずに書かないこと）・初回起動の書き込みがUSBの開始より後になることを確認し、
+// 保存1回あたりの消去回数と停止時間を出力する。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "flash_sim.h"
+
+// 色を変更して保存させ、書き込んだセクタを返す（消去回数が増えたセクタ）
+static int set_pixel_color(uint8_t state, uint8_t r, uint8_t g, uint8_t b) {
+    static uint32_t before[FLASH_SIM_SECTORS];
+    memcpy(before, flash_sim_stats()->erase_count, sizeof(before));
+
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, 0x05, state, r, g, b, 0xF7};
+    uint8_t response[16];
+    size_t len = test_request(sysex, sizeof(sysex), response, sizeof(response));
+    CHECK(len == 7 && response[5] == 0x00);
+
+    for (int i = 0; i < (int)FLASH_SIM_SECTORS; i++) {
+        if (flash_sim_stats()->erase_count[i] != before[i]) return i;
+    }
+    return -1;
+}
+
+static bool get_pixel_color(uint8_t state, uint8_t rgb[3]) {
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, 0x04, 0xF7};
+    uint8_t response[64];
+    size_t len = test_request(sysex, sizeof(sysex), response, sizeof(response));
+    if (len != 6 + 6 * 3 + 1) return false;
+    memcpy(rgb, &response[6 + state * 3], 3);
+    return true;
+}
+
+static void check_sdk_constraints(void) {
+    const flash_sim_stats_t* stats = flash_sim_stats();
+    CHECK(stats->misaligned_ops == 0);
+    CHECK(stats->bits_not_cleared == 0);
+    CHECK(stats->bytes_programmed % FLASH_PAGE_SIZE == 0);
+}
+
+static void test_nor_semantics(void) {
+    flash_sim_erase_all();
+    uint32_t offset = 64 * FLASH_SECTOR_SIZE;
+    uint8_t page[FLASH_PAGE_SIZE];
+
+    memset(page, 0xF0, sizeof(page));
+    flash_range_program(offset, page, sizeof(page));
+    CHECK(sim_flash_image[offset] == 0xF0);
+    CHECK(flash_sim_stats()->bits_not_cleared == 0);
+
+    // 消去せずに書くとビットは0にしかならない
+    memset(page, 0x0F, sizeof(page));
+    flash_range_program(offset, page, sizeof(page));
+    CHECK(sim_flash_image[offset] == 0x00);
+    CHECK(flash_sim_stats()->bits_not_cleared == 4 * FLASH_PAGE_SIZE);
+
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    CHECK(sim_flash_image[offset] == 0xFF);
+    CHECK(flash_sim_stats()->erase_count[64] == 1);
+    CHECK(flash_sim_stats()->blackout_us == FLASH_SIM_SECTOR_ERASE_US + 2 * FLASH_SIM_PAGE_PROGRAM_US);
+
+    flash_range_program(offset + 1, page, 3);
+    CHECK(flash_sim_stats()->misaligned_ops == 1);
+}
+
+static void test_save_and_reload(void) {
+    test_boot(true, 0);
+
+    // 初回起動でデフォルト設定が1回書き込まれる
+    const flash_sim_stats_t* stats = flash_sim_stats();
+    CHECK(stats->erases == 1);
+    check_sdk_constraints();
+
+    int sector = set_pixel_color(2, 10, 20, 30);
+    CHECK(sector >= 0);
+    CHECK(stats->erases == 2);
+
+    // 再起動しても変更が残り、読み込みだけでは書き込まない
+    test_boot(false, 0);
+    uint8_t rgb[3] = {0};
+    CHECK(get_pixel_color(2, rgb));
+    CHECK(rgb[0] == 10 && rgb[1] == 20 && rgb[2] == 30);
+    CHECK(stats->erases == 2);
+    check_sdk_constraints();
+
+    // 設定の途中のビットが落ちたら、もう一方のスロットの前の設定（初回起動時の初期設定）に戻る
+    if (sector >= 0) {
+        sim_flash_image[sector * FLASH_SECTOR_SIZE + 100] ^= 0x01;
+    }
+    test_boot(false, 0);
+    CHECK(get_pixel_color(2, rgb));
+    CHECK(!(rgb[0] == 10 && rgb[1] == 20 && rgb[2] == 30));
+    CHECK(stats->erases == 2);
+
+    // 両方のスロットが壊れていればデフォルトに戻って書き直す
+    for (int i = 0; i < (int)FLASH_SIM_SECTORS; i++) {
+        if (stats->erase_count[i] > 0) sim_flash_image[i * FLASH_SECTOR_SIZE + 100] ^= 0x02;
+    }
+    test_boot(false, 0);
+    CHECK(stats->erases == 3);
+}
+
+// 保存はもう一方のスロットに書くので、書き込み中に電源が切れても直前の設定が残る
+static void test_power_loss(void) {
+    test_boot(true, 0);
+    int first = set_pixel_color(2, 1, 2, 3);
+    int second = set_pixel_color(2, 4, 5, 6);
+    CHECK(first >= 0 && second >= 0 && first != second);
+    CHECK(set_pixel_color(2, 7, 8, 9) == first);
+    if (first < 0 || second < 0) return;
+
+    uint8_t rgb[3] = {0};
+    uint8_t page[FLASH_PAGE_SIZE];
+    memset(page, 0, sizeof(page));
+
+    // 消去の直後に電源断
+    flash_range_erase((uint32_t)first * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+    test_boot(false, 0);
+    CHECK(get_pixel_color(2, rgb));
+    CHECK(rgb[0] == 4 && rgb[1] == 5 && rgb[2] == 6);
+    CHECK(set_pixel_color(2, 7, 8, 9) == first);
+
+    // 最初のページだけ書き込んだところで電源断（マジックは正しいがchecksumが合わない）
+    memcpy(page, &sim_flash_image[first * FLASH_SECTOR_SIZE], sizeof(page));
+    flash_range_erase((uint32_t)second * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+    flash_range_program((uint32_t)second * FLASH_SECTOR_SIZE, page, sizeof(page));
+    test_boot(false, 0);
+    CHECK(get_pixel_color(2, rgb));
+    CHECK(rgb[0] == 7 && rgb[1] == 8 && rgb[2] == 9);
+
+    // 壊れたスロットには次の保存で上書きし、正しいスロットは消さない
+    CHECK(set_pixel_color(2, 10, 11, 12) == second);
+    test_boot(false, 0);
+    CHECK(get_pixel_color(2, rgb));
+    CHECK(rgb[0] == 10 && rgb[1] == 11 && rgb[2] == 12);
+    check_sdk_constraints();
+}
+
+static void test_file_backing(const char* dir) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/flash_test.bin", dir);
+    remove(path);
+
+    CHECK(flash_sim_attach_file(path, 0, PICO_FLASH_SIZE_BYTES));
+    test_boot(true, 0);
+    set_pixel_color(3, 1, 2, 3);
+    flash_sim_detach_file();
+
+    // メモリ上のイメージを消してからファイルを読み直す
+    flash_sim_erase_all();
+    CHECK(flash_sim_attach_file(path, 0, PICO_FLASH_SIZE_BYTES));
+    test_boot(false, 0);
+    uint8_t rgb[3] = {0};
+    CHECK(get_pixel_color(3, rgb));
+    CHECK(rgb[0] == 1 && rgb[1] == 2 && rgb[2] == 3);
+    flash_sim_detach_file();
+    remove(path);
+}
+
+// ピン割り当ては再起動後も残り、読み込んだ割り当てでスキャンする
+static void test_pin_map(void) {
+    test_boot(true, 0);
+
+    uint8_t set[] = {0xF0, 0x00, 0x7D, 0x01, 0x0A, 0x02, 20, 5, 0xF7};
+    uint8_t response[32];
+    size_t len = test_request(set, sizeof(set), response, sizeof(response));
+    CHECK(len == 7 && response[5] == 0x00);
+
+    test_boot(false, 0);
+    uint8_t get[] = {0xF0, 0x00, 0x7D, 0x01, 0x09, 0xF7};
+    len = test_request(get, sizeof(get), response, sizeof(response));
+    CHECK(len == 9 && response[5] == 2 && response[6] == 20 && response[7] == 5);
+
+    sim_clear_packets();
+    sim_set_pin(5, false);
+    sim_run_until(sim_now_us() + 5000);
+    CHECK(sim_packet_count() == 1 && sim_packet_at(0)->data[2] == 1);  // スイッチ1 = CC 1
+    sim_set_pin(5, true);
+}
+
+// 保存済みの設定はRAMに写さず、フラッシュ（XIP）上のものを直接読む
+static void test_zero_copy(void) {
+    test_boot(true, 0);
+    int sector = set_pixel_color(4, 0x51, 0x52, 0x53);
+    test_boot(false, 0);
+    CHECK(sector >= 0);
+    if (sector < 0) return;
+
+    // フラッシュ上の値を書き換えると、再起動せずにそのまま応答に現れる
+    uint8_t* image = &sim_flash_image[sector * FLASH_SECTOR_SIZE];
+    const uint8_t color[3] = {0x51, 0x52, 0x53};
+    uint8_t* found = NULL;
+    for (size_t i = 0; i + 3 <= FLASH_SECTOR_SIZE && !found; i++) {
+        if (memcmp(&image[i], color, 3) == 0) found = &image[i];
+    }
+    CHECK(found != NULL);
+    if (!found) return;
+    found[1] = 0x12;
+
+    uint8_t rgb[3] = {0};
+    CHECK(get_pixel_color(4, rgb));
+    CHECK(rgb[0] == 0x51 && rgb[1] == 0x12 && rgb[2] == 0x53);
+
+    // 編集はRAMの写しで行い、保存するまでフラッシュは変わらない
+    uint32_t erases = flash_sim_stats()->erases;
+    set_pixel_color(5, 1, 1, 1);
+    CHECK(flash_sim_stats()->erases == erases + 1);
+    CHECK(get_pixel_color(4, rgb));
+    CHECK(rgb[1] == 0x12);
+    check_sdk_constraints();
+}
+
+// GET_BOOT_TIMESの応答から各段階の時刻を取り出す（7bit×4）
+static bool get_boot_times(uint32_t times[6]) {
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, 0x0B, 0xF7};
+    uint8_t response[64];
+    size_t len = test_request(sysex, sizeof(sysex), response, sizeof(response));
+    if (len != 6 + 6 * 4 + 1 || response[5] != 6) return false;
+    for (int i = 0; i < 6; i++) {
+        const uint8_t* p = &response[6 + i * 4];
+        times[i] = p[0] | p[1] << 7 | p[2] << 14 | (uint32_t)p[3] << 21;
+    }
+    return true;
+}
+
+// 初回起動でもUSBはフラッシュの書き込みを待たずに開始し、初期設定は列挙の後に書き込む
+static void test_boot_order(void) {
+    enum { START, USB_INIT, CONFIG_LOADED, READY, MOUNTED, CONFIG_SAVED };
+    const uint32_t none = 0x0FFFFFFF;
+
+    sim_options_t options;
+    sim_default_options(&options);
+    options.flash_stalls = true;
+    sim_reset(&options);
+    CHECK(sim_usb_init_us() == 0);
+    CHECK(flash_sim_stats()->erases == 0);
+
+    sim_run_until(TEST_SETTLE_US);
+    CHECK(flash_sim_stats()->erases == 1);
+    check_sdk_constraints();
+
+    uint32_t times[6];
+    CHECK(get_boot_times(times));
+    CHECK(times[START] <= times[USB_INIT] && times[USB_INIT] <= times[CONFIG_LOADED] &&
+          times[CONFIG_LOADED] <= times[READY]);
+    CHECK(times[MOUNTED] != none && times[CONFIG_SAVED] != none && times[MOUNTED] <= times[CONFIG_SAVED]);
+
+    // 2回目以降は書き込まない
+    options.erase_flash = false;
+    sim_reset(&options);
+    sim_run_until(TEST_SETTLE_US);
+    CHECK(flash_sim_stats()->erases == 1);
+    CHECK(get_boot_times(times));
+    CHECK(times[CONFIG_SAVED] == none);
+
+    printf("{\"first_boot_usb_init_us\": %llu, \"first_boot_blackout_us\": %llu}\n",
+           (unsigned long long)sim_usb_init_us(), (unsigned long long)flash_sim_stats()->blackout_us);
+}
+
+// 保存を繰り返したときの消去回数と停止時間
+static void report_endurance(void) {
+    test_boot(true, 0);
+    flash_sim_reset_stats();
+
+    const uint32_t saves = 100;
+    for (uint32_t i = 0; i < saves; i++) {
+        set_pixel_color(1, i % 128, 0, 0);
+    }
+
+    const flash_sim_stats_t* stats = flash_sim_stats();
+    uint32_t max_erases = flash_sim_max_erase_count();
+    check_sdk_constraints();
+    CHECK(max_erases == saves / 2);  // A/Bの2セクタに分散
+
+    printf("{\"saves\": %u, \"sector_erases\": %u, \"max_erases_per_sector\": %u, "
+           "\"bytes_programmed_per_save\": %llu, \"blackout_us_per_save\": %llu, "
+           "\"saves_until_endurance_limit\": %llu}\n",
+           saves, stats->erases, max_erases,
+           (unsigned long long)(stats->bytes_programmed / saves),
+           (unsigned long long)(stats->blackout_us / saves),
+           (unsigned long long)FLASH_SIM_ENDURANCE_CYCLES * saves / max_erases);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = argc > 1 ? argv[1] : ".";
+    sim_set_packet_logging(true);
+
+    test_nor_semantics();
+    test_save_and_reload();
+    test_power_loss();
+    test_file_backing(dir);
+    test_pin_map();
+    test_zero_copy();
+    test_boot_order();
+    report_endurance();
+
+    return test_result();
+}
@@ -0,0 +1,245 @@
+// フライトレコーダ（生のピン変化・受け付けた変化・送信パケットの記録）の検査
+//
+// usage: flight_test
+//
+// 学習前の窓より長くチャタリングするスイッチの二重押下で記録が止まり、SysExで読み出した記録に
+// 二重押下の前後の生のピン変化（µs）とパケットが残ること、異常がなければ古い記録から上書きし続けること、
+// 送信キュー溢れとホストからの停止・再開を確認する。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+
+#define LOOP_US 50
+#define FLIGHT_ENTRIES 256
+#define FLIGHT_POST_TRIGGER 64
+#define FLIGHT_POST_TRIGGER_US 50000
+#define FLIGHT_INDEX_NONE 0x3FFF
+
+enum { FLIGHT_RAW, FLIGHT_ACCEPT, FLIGHT_PACKET, FLIGHT_DROP };
+enum { REASON_NONE, REASON_RETRIGGER, REASON_QUEUE_FULL, REASON_HOST };
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t type;
+    uint8_t id;
+    uint8_t value;
+} entry_t;
+
+typedef struct {
+    uint16_t count;
+    uint16_t trigger;
+    uint8_t reason;
+    uint8_t frozen;
+    entry_t entries[FLIGHT_ENTRIES];
+} record_t;
+
+static bool set_recorder(uint8_t op) {
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, 0x0E, op, 0xF7};
+    uint8_t response[16];
+    size_t len = test_request(sysex, sizeof(sysex), response, sizeof(response));
+    return len == 7 && response[4] == 0x0E && response[5] == 0x00;
+}
+
+// 古い方から4件ずつ全件を読み出す
+static bool read_record(record_t* record) {
+    memset(record, 0, sizeof(*record));
+    uint16_t index = 0;
+    do {
+        uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, 0x0D, index & 0x7F, index >> 7, 0xF7};
+        uint8_t response[64];
+        size_t len = test_request(sysex, sizeof(sysex), response, sizeof(response));
+        if (len < 15 || response[4] != 0x0D || (response[5] | response[6] << 7) != index ||
+            len != 15u + response[13] * 8u) {
+            return false;
+        }
+
+        record->count = response[7] | response[8] << 7;
+        record->trigger = response[9] | response[10] << 7;
+        record->reason = response[11];
+        record->frozen = response[12];
+        for (uint8_t i = 0; i < response[13]; i++) {
+            const uint8_t* e = &response[14 + i * 8];
+            entry_t* entry = &record->entries[index + i];
+            entry->time_us = 0;
+            for (int k = 4; k >= 0; k--) entry->time_us = entry->time_us << 7 | e[k];
+            entry->type = e[5];
+            entry->id = e[6];
+            entry->value = e[7];
+        }
+        if (response[13] == 0) break;
+        index += response[13];
+    } while (index < record->count);
+    return index == record->count;
+}
+
+// 時刻が記録の順に並んでいる
+static bool in_order(const record_t* record) {
+    for (uint16_t i = 1; i < record->count; i++) {
+        if (record->entries[i].time_us < record->entries[i - 1].time_us) return false;
+    }
+    return true;
+}
+
+// 押下/解放の周りに bounce_us までの逆のレベルのパルスを加える
+static void bouncy_edge(uint8_t switch_idx, bool pressed, uint32_t bounce_us) {
+    uint64_t t = sim_now_us();
+    sim_set_switch(switch_idx, pressed);
+    for (uint32_t end = 4000; end <= bounce_us; end += 4000) {
+        sim_run_until(t + end - 500);
+        sim_set_switch(switch_idx, !pressed);
+        sim_run_until(t + end);
+        sim_set_switch(switch_idx, pressed);
+    }
+}
+
+// 学習前の窓（20ms）より長いチャタリングは解放と再押下として受け付けられ、そこで記録が止まる
+static void test_retrigger(void) {
+    test_boot(true, LOOP_US);
+    CHECK(set_recorder(0));
+
+    sim_clear_packets();
+    uint64_t pressed_at = sim_now_us();
+    bouncy_edge(1, true, 28000);
+    sim_run_until(sim_now_us() + 100000);
+    bouncy_edge(1, false, 4000);
+    sim_run_until(sim_now_us() + 100000);
+
+    record_t record;
+    CHECK(read_record(&record));
+    CHECK(record.reason == REASON_RETRIGGER);
+    CHECK(record.frozen == 1);
+    CHECK(in_order(&record));
+    CHECK(record.trigger < record.count);
+    if (record.trigger >= record.count) return;
+
+    // 異常の記録は再押下、その前に最初の押下と解放を受け付けている
+    const entry_t* retrigger = &record.entries[record.trigger];
+    CHECK(retrigger->type == FLIGHT_ACCEPT && retrigger->id == 1 && (retrigger->value & 1) == 1);
+    CHECK((retrigger->value >> 1) == 20);
+    uint32_t accepts = 0;
+    uint32_t raws = 0;
+    uint32_t packets = 0;
+    for (uint16_t i = 0; i <= record.trigger; i++) {
+        const entry_t* e = &record.entries[i];
+        if (e->type == FLIGHT_ACCEPT) accepts++;
+        if (e->type == FLIGHT_RAW) raws++;
+        if (e->type == FLIGHT_PACKET) packets++;
+    }
+    CHECK(accepts == 3);
+    CHECK(raws >= 10);
+    CHECK(packets == 2);
+
+    // 最初の生のピン変化の時刻は、入力を変えてからループ1回以内
+    const entry_t* first = &record.entries[0];
+    CHECK(first->type == FLIGHT_RAW && first->id == 1 && first->value == 1);
+    CHECK(first->time_us >= pressed_at && first->time_us - pressed_at <= LOOP_US);
+
+    // 異常の後は一定時間だけ、再押下のパケットとチャタリングの続きを記録する（その後の解放は記録しない）
+    bool retrigger_packet = false;
+    for (uint16_t i = record.trigger + 1; i < record.count; i++) {
+        const entry_t* e = &record.entries[i];
+        if (e->type == FLIGHT_PACKET && e->id == 2) retrigger_packet = true;
+        CHECK(e->time_us - retrigger->time_us < FLIGHT_POST_TRIGGER_US);
+        CHECK(e->type != FLIGHT_ACCEPT);
+    }
+    CHECK(retrigger_packet);
+
+    printf("{\"scenario\": \"retrigger\", \"entries\": %u, \"trigger\": %u, \"retrigger_after_us\": %u}\n",
+           record.count, record.trigger, retrigger->time_us - first->time_us);
+
+    // 止まった後の操作は記録しない
+    sim_set_switch(2, true);
+    sim_run_until(sim_now_us() + 60000);
+    sim_set_switch(2, false);
+    sim_run_until(sim_now_us() + 60000);
+    record_t after;
+    CHECK(read_record(&after));
+    CHECK(after.count == record.count && after.reason == REASON_RETRIGGER);
+    CHECK(memcmp(after.entries, record.entries, sizeof(record.entries)) == 0);
+
+    // 再開すると消える
+    CHECK(set_recorder(0));
+    CHECK(read_record(&after));
+    CHECK(after.count == 0 && after.reason == REASON_NONE && after.frozen == 0 && after.trigger == FLIGHT_INDEX_NONE);
+}
+
+// 異常がなければ古い記録から上書きし、ホストが止めるまで記録し続ける
+static void test_wraparound_and_host_freeze(void) {
+    test_boot(true, LOOP_US);
+    for (int i = 0; i < 100; i++) {
+        sim_set_switch(i % 4, true);
+        sim_run_until(sim_now_us() + 60000);
+        sim_set_switch(i % 4, false);
+        sim_run_until(sim_now_us() + 60000);
+    }
+
+    CHECK(set_recorder(1));
+    record_t record;
+    CHECK(read_record(&record));
+    CHECK(record.count == FLIGHT_ENTRIES);
+    CHECK(record.reason == REASON_HOST && record.frozen == 1 && record.trigger == FLIGHT_INDEX_NONE);
+    CHECK(in_order(&record));
+
+    // 最新の記録は最後の解放のパケット
+    const entry_t* last = &record.entries[record.count - 1];
+    CHECK(last->type == FLIGHT_PACKET && last->id == 3 * 2 + 1);
+
+    // 押下1回につき生の変化・受け付け・パケットが1件ずつ
+    uint32_t counts[4] = {0};
+    for (uint16_t i = 0; i < record.count; i++) counts[record.entries[i].type]++;
+    CHECK(counts[FLIGHT_DROP] == 0);
+    CHECK(abs((int)counts[FLIGHT_RAW] - (int)counts[FLIGHT_ACCEPT]) <= 1);
+    CHECK(abs((int)counts[FLIGHT_ACCEPT] - (int)counts[FLIGHT_PACKET]) <= 1);
+
+    // 範囲外の番号は状態だけを返す
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, 0x0D, 0x00, 0x02, 0xF7};
+    uint8_t response[64];
+    size_t len = test_request(sysex, sizeof(sysex), response, sizeof(response));
+    CHECK(len == 15 && response[13] == 0);
+
+    // 不正な操作
+    uint8_t bad[] = {0xF0, 0x00, 0x7D, 0x01, 0x0E, 0x02, 0xF7};
+    len = test_request(bad, sizeof(bad), response, sizeof(response));
+    CHECK(len == 7 && response[5] == 0x01);
+}
+
+// 送信キュー溢れで止まる
+static void test_queue_full(void) {
+    test_boot(true, LOOP_US);
+    for (int i = 0; i < 40; i++) {
+        send_midi_messages(0);
+    }
+    sim_run_until(sim_now_us() + 100000);
+
+    record_t record;
+    CHECK(read_record(&record));
+    CHECK(record.reason == REASON_QUEUE_FULL && record.frozen == 1);
+    CHECK(record.trigger < record.count);
+    if (record.trigger < record.count) {
+        CHECK(record.entries[record.trigger].type == FLIGHT_DROP && record.entries[record.trigger].id == 0);
+    }
+    CHECK(record.count <= record.trigger + 1 + FLIGHT_POST_TRIGGER);
+
+    // 溢れた8イベントと、キューに積めた32イベントのパケット
+    uint32_t drops = 0;
+    uint32_t packets = 0;
+    for (uint16_t i = 0; i < record.count; i++) {
+        if (record.entries[i].type == FLIGHT_DROP) drops++;
+        if (record.entries[i].type == FLIGHT_PACKET) packets++;
+    }
+    CHECK(drops == 8);
+    CHECK(packets == 32);
+}
+
+int main(void) {
+    sim_set_packet_logging(true);
+
+    test_retrigger();
+    test_wraparound_and_host_freeze();
+    test_queue_full();
+
+    return test_result();
+}
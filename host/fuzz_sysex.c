@@ -0,0 +1,495 @@
+// SysEx受信経路（midi_rx_task → sysex_feed_byte → process_sysex_data）のファジングハーネス
+//
+// libFuzzer:  CC=clang cmake -S host -B build-fuzz -DPICOMIDI_FUZZ=ON
+//             ./build-fuzz/fuzz_sysex corpus/
+// 単体実行:   fuzz_sysex [-n iterations] [-s seed] [-w corpus_dir] [files...]
+//             ファイルを与えるとその入力を、与えなければ構造化した乱数入力をn回実行する。
+//             -w は生成した入力をlibFuzzerのシードコーパスとして書き出す。
+//             AFLでは afl-cc でビルドしてファイル1つを引数に実行する。
+//
+// 入力の先頭バイトが偶数なら残りはMIDIバイト列（sim_host_sendと同じ規則でパケット化）、
+// 奇数なら残りはそのままUSB-MIDIパケット（4バイト単位）として受信FIFOに入れる。
+//
+// 各入力で次を検査し、違反したらabort()する（メモリ安全性はASan/UBSanに任せる）
+//   - 応答はSysExのCINのみで、F0 00 7D 01 <cmd> ... F7 の形とコマンド毎の長さを満たす
+//   - 応答の途中にステータスバイトや途切れがない
+//   - 再起動してフラッシュから読み直した設定が再起動前と同じ応答を返す（ピン割り当てを含む）
+//   - フラッシュの消去・書き込みがSDKの制約（境界、消去してから書く）を守る
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "flash_sim.h"
+#include "switch_pins.h"
+#include "tusb.h"
+
+#define MAX_RESPONSE 128
+#define MAX_SNAPSHOT 4096
+#define MAX_INPUT 512
+#define MAX_SWITCHES 16
+
+typedef struct {
+    uint8_t buffer[MAX_RESPONSE];
+    size_t len;
+    bool active;
+} response_assembler_t;
+
+static response_assembler_t assembler;
+
+// 応答を記録するバッファ（再起動前後の比較用。NULLなら記録しない）
+static uint8_t* snapshot;
+static size_t snapshot_len;
+
+static void fail(const char* reason, const uint8_t* data, size_t len) {
+    fprintf(stderr, "invariant violated: %s\n", reason);
+    for (size_t i = 0; i < len; i++) {
+        fprintf(stderr, "%02X ", data[i]);
+    }
+    fprintf(stderr, "\n");
+    abort();
+}
+
+//--------------------------------------------------------------------+
+// Response checks
+//--------------------------------------------------------------------+
+
+static bool valid_message(const uint8_t* m) {
+    return m[0] <= 5 && m[1] <= 15 && m[2] <= 127 && m[3] <= 127;
+}
+
+static void check_response(const uint8_t* r, size_t len) {
+    if (len < 7 || r[0] != 0xF0 || r[1] != 0x00 || r[2] != 0x7D || r[3] != 0x01 || r[len - 1] != 0xF7) {
+        fail("bad response frame", r, len);
+    }
+    for (size_t i = 1; i + 1 < len; i++) {
+        if (r[i] & 0x80) fail("status byte inside response", r, len);
+    }
+
+    switch (r[4]) {
+        case 0x01:  // GET_INFO
+            if (len != 8 || r[5] == 0 || r[5] > MAX_SWITCHES) fail("bad info response", r, len);
+            return;
+        case 0x02: {  // GET_MESSAGE
+            if (len < 9 || r[5] >= MAX_SWITCHES || r[6] > 1 || r[7] > 10 || len != 9u + r[7] * 4u) {
+                fail("bad message response", r, len);
+            }
+            for (uint8_t i = 0; i < r[7]; i++) {
+                if (!valid_message(&r[8 + i * 4])) fail("invalid message in response", r, len);
+            }
+            return;
+        }
+        case 0x04:  // GET_PIXEL_COLORS
+            if (len != 6 + 6 * 3 + 1 || r[5] != 6) fail("bad pixel colors response", r, len);
+            return;
+        case 0x06:  // GET_FEEDBACK_MAP
+            if (len != 12 || r[5] >= 32 || (r[6] > 15 && r[6] != 0x7F)) fail("bad feedback map response", r, len);
+            return;
+        case 0x09: {  // GET_PIN_MAP
+            if (len != 7u + r[5] || r[5] == 0 || r[5] > MAX_SWITCHES) fail("bad pin map response", r, len);
+            uint32_t used = 0;
+            for (uint8_t i = 0; i < r[5]; i++) {
+                if (r[6 + i] >= 30 || (used & (1u << r[6 + i]))) fail("invalid pin map", r, len);
+                used |= 1u << r[6 + i];
+            }
+            return;
+        }
+        case 0x0B:  // GET_BOOT_TIMES
+            if (len != 6 + 6 * 4 + 1 || r[5] != 6) fail("bad boot times response", r, len);
+            return;
+        case 0x0C:  // GET_DEBOUNCE
+            if (len != 10 + 32 + 1 || r[5] >= MAX_SWITCHES || r[6] < 3 || r[6] > 31 || r[9] != 32) {
+                fail("bad debounce response", r, len);
+            }
+            return;
+        case 0x0D:  // GET_FLIGHT_RECORD
+            if (len < 15 || r[13] > 4 || len != 15u + r[13] * 8u || (r[7] | r[8] << 7) > 256 ||
+                r[11] > 3 || r[12] > 1) {
+                fail("bad flight record response", r, len);
+            }
+            return;
+        case 0x12: {  // GET_EXCLUSIVE_GROUPS
+            if (len != 6 + 8 * 3 + 1 || r[5] != 8) fail("bad exclusive groups response", r, len);
+            for (uint8_t g = 0; g < 8; g++) {
+                uint32_t members = r[6 + g * 3] | r[7 + g * 3] << 7 | r[8 + g * 3] << 14;
+                if (members > 0xFFFF || __builtin_popcount(members) == 1) fail("invalid exclusive group", r, len);
+            }
+            return;
+        }
+        case 0x03:  // SET_* の成功/失敗
+        case 0x05:
+        case 0x07:
+        case 0x08:
+        case 0x0A:
+        case 0x0E:
+        case 0x0F:  // トランザクションのBEGIN/COMMIT/ROLLBACK
+        case 0x10:
+        case 0x11:
+        case 0x13:
+            if (len != 7 || r[5] > 1) fail("bad status response", r, len);
+            return;
+        default:
+            fail("response to unknown command", r, len);
+    }
+}
+
+static void check_tx_packet(const uint8_t packet[4]) {
+    uint8_t cin = packet[0] & 0x0F;
+    if (packet[0] >> 4 != 0 || cin < 0x04 || cin > 0x07) {
+        fail("unexpected packet", packet, 4);
+    }
+
+    uint8_t n = (cin == 0x04) ? 3 : cin - 0x04;
+    for (uint8_t i = 0; i < n; i++) {
+        uint8_t byte = packet[1 + i];
+        if (byte == 0xF0) {
+            if (assembler.active) fail("response restarted before F7", assembler.buffer, assembler.len);
+            assembler.active = true;
+            assembler.len = 0;
+        } else if (!assembler.active) {
+            fail("response data outside SysEx", packet, 4);
+        }
+        if (assembler.len == MAX_RESPONSE) fail("response too long", assembler.buffer, assembler.len);
+        assembler.buffer[assembler.len++] = byte;
+
+        if (byte == 0xF7) {
+            if (i + 1 != n || cin == 0x04) fail("F7 not at end of packet", packet, 4);
+            check_response(assembler.buffer, assembler.len);
+            if (snapshot && snapshot_len + assembler.len <= MAX_SNAPSHOT) {
+                memcpy(&snapshot[snapshot_len], assembler.buffer, assembler.len);
+                snapshot_len += assembler.len;
+            }
+            assembler.active = false;
+        }
+    }
+    if (cin != 0x04 && assembler.active) {
+        fail("SysEx end packet without F7", packet, 4);
+    }
+}
+
+//--------------------------------------------------------------------+
+// Driving the RX path
+//--------------------------------------------------------------------+
+
+static uint64_t bytes_parsed;
+
+static void drain_tx(void) {
+    uint8_t packet[4];
+    while (sim_tx_pop(packet)) {
+        check_tx_packet(packet);
+    }
+}
+
+static void pump(void) {
+    midi_rx_task();
+    service_output_queue();
+    drain_tx();
+}
+
+static void feed_packet(const uint8_t packet[4], void* user) {
+    (void) user;
+    while (!sim_rx_inject(packet)) {
+        pump();
+    }
+    bytes_parsed += 4;
+}
+
+// 受信FIFOと保留中の応答がなくなるまで回す
+static void settle(void) {
+    for (int i = 0; i < 64; i++) {
+        pump();
+        if (tud_midi_available() == 0) {
+            pump();
+            return;
+        }
+    }
+    fail("RX path does not make progress", NULL, 0);
+}
+
+static void run_input(const uint8_t* data, size_t size) {
+    if (size == 0) return;
+    if (data[0] & 1) {
+        for (size_t i = 1; i + 4 <= size; i += 4) {
+            feed_packet(&data[i], NULL);
+        }
+    } else {
+        sim_midi_packetize(&data[1], size - 1, feed_packet, NULL);
+    }
+    settle();
+    if (assembler.active) fail("response left unterminated", assembler.buffer, assembler.len);
+}
+
+// 設定を読み出す要求をすべて送り、応答をsnapshotに記録する
+static void read_back_config(uint8_t* out, size_t* out_len) {
+    snapshot = out;
+    snapshot_len = 0;
+
+    // スイッチ数はピン割り当てで変わるので、デバイスに問い合わせる
+    uint8_t info[] = {0x00, 0xF0, 0x00, 0x7D, 0x01, 0x01, 0xF7};
+    run_input(info, sizeof(info));
+    if (snapshot_len != 8) fail("no info response", out, snapshot_len);
+    uint8_t switches = out[5];
+
+    uint8_t pin_map[] = {0x00, 0xF0, 0x00, 0x7D, 0x01, 0x09, 0xF7};
+    run_input(pin_map, sizeof(pin_map));
+    if (snapshot_len != 8u + 7u + switches || out[8 + 5] != switches) {
+        fail("pin map does not match info", out, snapshot_len);
+    }
+
+    for (uint8_t sw = 0; sw < switches; sw++) {
+        for (uint8_t ev = 0; ev < 2; ev++) {
+            uint8_t get[] = {0x00, 0xF0, 0x00, 0x7D, 0x01, 0x02, sw, ev, 0xF7};
+            run_input(get, sizeof(get));
+        }
+    }
+    uint8_t colors[] = {0x00, 0xF0, 0x00, 0x7D, 0x01, 0x04, 0xF7};
+    run_input(colors, sizeof(colors));
+    uint8_t groups[] = {0x00, 0xF0, 0x00, 0x7D, 0x01, 0x12, 0xF7};
+    run_input(groups, sizeof(groups));
+    for (uint8_t i = 0; i < 32; i++) {
+        uint8_t map[] = {0x00, 0xF0, 0x00, 0x7D, 0x01, 0x06, i, 0xF7};
+        run_input(map, sizeof(map));
+    }
+
+    *out_len = snapshot_len;
+    snapshot = NULL;
+}
+
+static void reset_device(bool erase_flash) {
+    sim_options_t options;
+    sim_default_options(&options);
+    options.erase_flash = erase_flash;
+    sim_reset(&options);
+    sim_set_packet_logging(false);
+    memset(&assembler, 0, sizeof(assembler));
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static uint8_t before[MAX_SNAPSHOT];
+    static uint8_t after[MAX_SNAPSHOT];
+    size_t before_len, after_len;
+
+    reset_device(true);
+    run_input(data, size);
+
+    // 開いたままのトランザクションの変更は保存しないので捨ててから比べる
+    uint8_t rollback[] = {0x00, 0xF0, 0x00, 0x7D, 0x01, 0x11, 0xF7};
+    run_input(rollback, sizeof(rollback));
+
+    // 受け付けた変更はすべてフラッシュに保存されているはず
+    read_back_config(before, &before_len);
+    reset_device(false);
+    read_back_config(after, &after_len);
+    if (before_len != after_len || memcmp(before, after, before_len) != 0) {
+        fail("config differs after reboot", data, size);
+    }
+    if (flash_sim_stats()->misaligned_ops != 0 || flash_sim_stats()->bits_not_cleared != 0) {
+        fail("flash access violates NOR/SDK constraints", data, size);
+    }
+    return 0;
+}
+
+//--------------------------------------------------------------------+
+// Standalone driver (gcc / AFL)
+//--------------------------------------------------------------------+
+
+#ifndef PICOMIDI_LIBFUZZER
+
+static uint32_t rng_state;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// 既知のコマンドをほぼ正しい長さで組み立て、一部を壊す
+static size_t generate_message(uint8_t* out, size_t max) {
+    static const uint8_t lengths[] = {6, 6, 8, 9, 6, 10, 7, 11, 7, 6, 6, 6, 7, 8, 7, 6, 6, 6, 6, 10};
+    uint8_t msg[80];
+    size_t len = 0;
+
+    uint8_t command = rng() % 21;
+    msg[len++] = 0xF0;
+    msg[len++] = 0x00;
+    msg[len++] = 0x7D;
+    msg[len++] = 0x01;
+    msg[len++] = command;
+
+    size_t body = command < sizeof(lengths) ? (size_t)lengths[command] - 6 : rng() % 8;
+    if (command == 0x03) {
+        uint8_t count = rng() % 12;
+        msg[len++] = rng() % (num_switches + 1);
+        msg[len++] = rng() % 3;
+        msg[len++] = count;
+        body = count * 4;
+        for (size_t i = 0; i < body && len < sizeof(msg) - 1; i++) {
+            msg[len++] = (i % 4 == 0) ? rng() % 7 : rng() % 0x80;
+        }
+    } else if (command == 0x0A) {
+        // 少ない個数なら有効な割り当てになることもある（予約ピン・重複を含む）
+        uint8_t count = rng() % 18;
+        msg[len++] = count;
+        for (uint8_t i = 0; i < count; i++) {
+            msg[len++] = rng() % 31;
+        }
+    } else if (command == 0x13) {
+        // スイッチ数の前後のメンバー（1つだけのグループを含む）
+        uint32_t members = rng() & ((1u << (num_switches + 1)) - 1);
+        msg[len++] = rng() % 9;
+        msg[len++] = members & 0x7F;
+        msg[len++] = (members >> 7) & 0x7F;
+        msg[len++] = (members >> 14) & 0x7F;
+    } else {
+        for (size_t i = 0; i < body; i++) {
+            msg[len++] = (rng() % 4 == 0) ? rng() % 0x80 : rng() % 20;
+        }
+    }
+    msg[len++] = 0xF7;
+
+    switch (rng() % 8) {
+        case 0:  // 1バイト壊す
+            msg[rng() % len] = rng() & 0xFF;
+            break;
+        case 1:  // 途中で切る
+            len = 1 + rng() % len;
+            break;
+        case 2:  // バッファを溢れさせる
+            len -= 1;
+            while (len < sizeof(msg) - 1) msg[len++] = rng() % 0x80;
+            msg[len++] = 0xF7;
+            break;
+        default:
+            break;
+    }
+
+    if (len > max) len = max;
+    memcpy(out, msg, len);
+    return len;
+}
+
+static size_t generate_input(uint8_t* out, size_t max) {
+    size_t len = 0;
+    out[len++] = rng() & 0xFF;
+
+    if (out[0] & 1) {
+        // 任意のCINを含むUSB-MIDIパケット列
+        size_t packets = 1 + rng() % 32;
+        for (size_t i = 0; i < packets && len + 4 <= max; i++) {
+            out[len++] = rng() % 16;
+            for (int k = 0; k < 3; k++) {
+                out[len++] = (rng() % 3 == 0) ? rng() & 0xFF : rng() % 0x80;
+            }
+        }
+        return len;
+    }
+
+    size_t messages = 1 + rng() % 4;
+    for (size_t i = 0; i < messages && len < max; i++) {
+        if (rng() % 8 == 0) {
+            // フィードバック用のCCを混ぜる
+            uint8_t cc[] = {0xBF, rng() % 0x80, rng() % 0x80};
+            for (size_t k = 0; k < sizeof(cc) && len < max; k++) out[len++] = cc[k];
+        }
+        len += generate_message(&out[len], max - len);
+    }
+    return len;
+}
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        exit(2);
+    }
+    uint8_t* data = malloc(MAX_INPUT);
+    *size = fread(data, 1, MAX_INPUT, file);
+    fclose(file);
+    return data;
+}
+
+static uint64_t cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// 再起動や読み出しを含まない、受信経路だけのスループット
+static double measure_throughput(uint32_t iterations) {
+    static uint8_t inputs[256][MAX_INPUT];
+    static size_t sizes[256];
+
+    for (int i = 0; i < 256; i++) {
+        sizes[i] = generate_input(inputs[i], MAX_INPUT);
+    }
+
+    reset_device(true);
+    bytes_parsed = 0;
+    uint64_t start = cpu_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        run_input(inputs[i % 256], sizes[i % 256]);
+    }
+    uint64_t elapsed = cpu_ns() - start;
+    return elapsed ? bytes_parsed * 1e9 / elapsed : 0.0;
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = 10000;
+    const char* corpus_dir = NULL;
+    int first_file = argc;
+    rng_state = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            rng_state = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (rng_state == 0) rng_state = 1;
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            corpus_dir = argv[++i];
+        } else if (argv[i][0] != '-') {
+            first_file = i;
+            break;
+        } else {
+            fprintf(stderr, "usage: %s [-n iterations] [-s seed] [-w corpus_dir] [files...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (first_file < argc) {
+        for (int i = first_file; i < argc; i++) {
+            size_t size;
+            uint8_t* data = read_file(argv[i], &size);
+            LLVMFuzzerTestOneInput(data, size);
+            free(data);
+        }
+        printf("%d inputs ok\n", argc - first_file);
+        return 0;
+    }
+
+    uint8_t input[MAX_INPUT];
+    for (uint32_t i = 0; i < iterations; i++) {
+        size_t size = generate_input(input, sizeof(input));
+        if (corpus_dir) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/seed-%05u", corpus_dir, i);
+            FILE* file = fopen(path, "wb");
+            if (!file) {
+                perror(path);
+                return 2;
+            }
+            fwrite(input, 1, size, file);
+            fclose(file);
+        }
+        LLVMFuzzerTestOneInput(input, size);
+    }
+
+    double throughput = measure_throughput(iterations);
+    printf("{\"inputs\": %u, \"parser_bytes_per_sec\": %.0f}\n", iterations, throughput);
+    return 0;
+}
+
+#endif // PICOMIDI_LIBFUZZER
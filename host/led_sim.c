@@ -0,0 +1,64 @@
+// ホストビルド用のLEDドライバ（led.h / ws2812.h）
+// PWM/PIO/DMAは無いので、表示内容だけを保持する
+
+#include <string.h>
+
+#include "led.h"
+#include "ws2812.h"
+#include "sim.h"
+
+static uint8_t led_base;
+static uint32_t ws2812_framebuffer[WS2812_MAX_PIXELS];
+static bool ws2812_dirty;
+static uint32_t ws2812_frames;
+
+void led_init(void) {
+    led_base = 0;
+}
+
+void led_set_base(uint8_t level) {
+    led_base = level;
+}
+
+void led_activity(void) {
+}
+
+void led_error(void) {
+}
+
+bool ws2812_init(uint8_t pin, uint8_t count) {
+    (void) pin;
+    (void) count;
+    memset(ws2812_framebuffer, 0, sizeof(ws2812_framebuffer));
+    ws2812_dirty = true;
+    ws2812_frames = 0;
+    return true;
+}
+
+void ws2812_set_pixel(uint8_t index, uint8_t r, uint8_t g, uint8_t b) {
+    if (index >= WS2812_MAX_PIXELS) return;
+
+    uint32_t grb = ((uint32_t)g << 24) | ((uint32_t)r << 16) | ((uint32_t)b << 8);
+    if (ws2812_framebuffer[index] != grb) {
+        ws2812_framebuffer[index] = grb;
+        ws2812_dirty = true;
+    }
+}
+
+void ws2812_task(void) {
+    if (!ws2812_dirty) return;
+    ws2812_dirty = false;
+    ws2812_frames++;
+}
+
+uint32_t sim_ws2812_pixel(uint8_t index) {
+    return index < WS2812_MAX_PIXELS ? ws2812_framebuffer[index] : 0;
+}
+
+uint32_t sim_ws2812_frames(void) {
+    return ws2812_frames;
+}
+
+uint8_t sim_led_base(void) {
+    return led_base;
+}
@@ -0,0 +1,224 @@
+// スクリプトに従ってスイッチ操作やSysExをファームウェアに与え、
+// ホストに届いたUSBパケットを時刻付きで出力するドライバ
+//
+// usage: picomidi_sim [-v] [-l loop_us] [-f packets_per_frame] [-F flash.bin] [-b] [-S] [script]
+//   -F  フラッシュの内容をファイルに保持する（次回の実行で読み込まれる）
+//   -b  フラッシュの消去・書き込み中は仮想時間を止める
+//   -S  終了時にフラッシュの統計を標準エラーに出力する
+//
+// スクリプトは1行1コマンドで、時刻（ms、小数可）は単調増加であること
+//   <ms> press <switch>          スイッチ押下（switch_pinsのインデックス）
+//   <ms> release <switch>        スイッチ解放
+//   <ms> pin <gpio> <0|1>        GPIOのレベルを直接設定（チャタリング再現用）
+//   <ms> send <hex bytes...>     ホストからMIDIバイト列を送信（SysExも可）
+//   <ms> unmount / mount         USB切断/接続
+//   <ms> end                     この時刻まで実行して終了
+// '#'以降はコメント
+//
+// 出力（時刻はホストに届いたUSBフレームの時刻）
+//   <ms> midi <4 bytes>          USB-MIDIイベントパケット
+//   <ms> sysex <bytes...>        SysEx（パケットを組み立てたもの）
+//   <ms> hid <report id> <bytes...>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "sim.h"
+#include "flash_sim.h"
+
+#define DRAIN_US 50000      // スクリプト終了後に送信を待つ時間
+#define MAX_LINE 1024
+#define MAX_SEND_BYTES 512
+
+typedef struct {
+    uint8_t buffer[MAX_SEND_BYTES];
+    size_t len;
+} sysex_assembler_t;
+
+static void print_time(uint64_t time_us) {
+    printf("%llu.%03llu", (unsigned long long)(time_us / 1000), (unsigned long long)(time_us % 1000));
+}
+
+static void print_bytes(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        printf(" %02X", data[i]);
+    }
+    printf("\n");
+}
+
+static void on_packet(const sim_packet_t* packet, void* user) {
+    sysex_assembler_t* sysex = user;
+
+    if (packet->kind == SIM_PACKET_HID) {
+        print_time(packet->time_us);
+        printf(" hid");
+        print_bytes(packet->data, packet->len);
+        return;
+    }
+
+    uint8_t cin = packet->data[0] & 0x0F;
+    if (cin >= 0x04 && cin <= 0x07) {
+        uint8_t n = (cin == 0x04) ? 3 : cin - 0x04;
+        for (uint8_t i = 0; i < n && sysex->len < MAX_SEND_BYTES; i++) {
+            sysex->buffer[sysex->len++] = packet->data[1 + i];
+        }
+        if (cin != 0x04) {
+            print_time(packet->time_us);
+            printf(" sysex");
+            print_bytes(sysex->buffer, sysex->len);
+            sysex->len = 0;
+        }
+        return;
+    }
+
+    print_time(packet->time_us);
+    printf(" midi");
+    print_bytes(packet->data, 4);
+}
+
+static int parse_hex_bytes(char* text, uint8_t* out, size_t max) {
+    size_t len = 0;
+    for (char* token = strtok(text, " \t\r\n"); token; token = strtok(NULL, " \t\r\n")) {
+        char* end;
+        unsigned long value = strtoul(token, &end, 16);
+        if (*end != '\0' || value > 0xFF || len >= max) return -1;
+        out[len++] = (uint8_t)value;
+    }
+    return (int)len;
+}
+
+static int run_script(FILE* input) {
+    char line[MAX_LINE];
+    int line_no = 0;
+    uint64_t last_us = 0;
+
+    while (fgets(line, sizeof(line), input)) {
+        line_no++;
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char* p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0') continue;
+
+        char* end;
+        double ms = strtod(p, &end);
+        if (end == p || ms < 0) {
+            fprintf(stderr, "line %d: missing time\n", line_no);
+            return 1;
+        }
+        uint64_t time_us = (uint64_t)(ms * 1000.0 + 0.5);
+        if (time_us < last_us) {
+            fprintf(stderr, "line %d: time goes backwards\n", line_no);
+            return 1;
+        }
+        last_us = time_us;
+
+        char command[16];
+        int consumed = 0;
+        if (sscanf(end, "%15s %n", command, &consumed) != 1) {
+            fprintf(stderr, "line %d: missing command\n", line_no);
+            return 1;
+        }
+        char* args = end + consumed;
+
+        sim_run_until(time_us);
+
+        unsigned a, b;
+        if (strcmp(command, "press") == 0 && sscanf(args, "%u", &a) == 1) {
+            sim_set_switch((uint8_t)a, true);
+        } else if (strcmp(command, "release") == 0 && sscanf(args, "%u", &a) == 1) {
+            sim_set_switch((uint8_t)a, false);
+        } else if (strcmp(command, "pin") == 0 && sscanf(args, "%u %u", &a, &b) == 2) {
+            sim_set_pin((uint8_t)a, b != 0);
+        } else if (strcmp(command, "send") == 0) {
+            uint8_t bytes[MAX_SEND_BYTES];
+            int len = parse_hex_bytes(args, bytes, sizeof(bytes));
+            if (len <= 0) {
+                fprintf(stderr, "line %d: bad hex bytes\n", line_no);
+                return 1;
+            }
+            sim_host_send(bytes, (size_t)len);
+        } else if (strcmp(command, "mount") == 0) {
+            sim_set_mounted(true);
+        } else if (strcmp(command, "unmount") == 0) {
+            sim_set_mounted(false);
+        } else if (strcmp(command, "end") == 0) {
+            return 0;
+        } else {
+            fprintf(stderr, "line %d: unknown command '%s'\n", line_no, command);
+            return 1;
+        }
+    }
+
+    sim_run_until(last_us + DRAIN_US);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    sim_options_t options;
+    sim_default_options(&options);
+    const char* path = NULL;
+    const char* flash_path = NULL;
+    bool flash_stats = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            sim_set_uart_echo(true);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            options.loop_us = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            options.midi_packets_per_frame = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+            flash_path = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0) {
+            options.flash_stalls = true;
+        } else if (strcmp(argv[i], "-S") == 0) {
+            flash_stats = true;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [-v] [-l loop_us] [-f packets_per_frame] [-F flash.bin] [-b] [-S] [script]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (flash_path) {
+        if (!flash_sim_attach_file(flash_path, 0, PICO_FLASH_SIZE_BYTES)) {
+            perror(flash_path);
+            return 2;
+        }
+        options.erase_flash = false;
+    }
+
+    FILE* input = stdin;
+    if (path) {
+        input = fopen(path, "r");
+        if (!input) {
+            perror(path);
+            return 2;
+        }
+    }
+
+    sysex_assembler_t sysex = {{0}, 0};
+    sim_set_packet_logging(false);
+    sim_set_packet_callback(on_packet, &sysex);
+    sim_reset(&options);
+
+    int result = run_script(input);
+
+    if (input != stdin) fclose(input);
+
+    if (flash_stats) {
+        const flash_sim_stats_t* stats = flash_sim_stats();
+        fprintf(stderr, "flash: %u sector erases (max %u per sector), %u pages / %llu bytes programmed, "
+                "%llu us blackout, %u misaligned ops, %u bits not cleared\n",
+                stats->erases, flash_sim_max_erase_count(), stats->pages_programmed,
+                (unsigned long long)stats->bytes_programmed, (unsigned long long)stats->blackout_us,
+                stats->misaligned_ops, stats->bits_not_cleared);
+    }
+    flash_sim_detach_file();
+    return result;
+}
@@ -0,0 +1,14 @@
+# Runs picomidi_sim on SCRIPT and compares its output with EXPECTED
+execute_process(
+    COMMAND ${SIM} ${SCRIPT}
+    OUTPUT_VARIABLE actual
+    RESULT_VARIABLE result)
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "picomidi_sim failed (${result})")
+endif()
+
+file(READ ${EXPECTED} expected)
+if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "Output mismatch for ${SCRIPT}\n--- expected\n${expected}--- actual\n${actual}")
+endif()
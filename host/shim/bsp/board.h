@@ -0,0 +1,18 @@
+#ifndef HOST_SHIM_BOARD_H
+#define HOST_SHIM_BOARD_H
+
+// TinyUSB bsp/board.h の置き換え（ホストビルド用）
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void board_init(void);
+uint32_t board_millis(void);
+void board_led_write(bool state);
+
+// ファームウェアのprintf（UART出力）はシミュレータ側で捕捉する
+// 実機でもpico_stdioがprintfをラップしているのと同じ扱い
+int sim_uart_printf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+#define printf sim_uart_printf
+
+#endif // HOST_SHIM_BOARD_H
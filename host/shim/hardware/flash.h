@@ -0,0 +1,18 @@
+#ifndef HOST_SHIM_HARDWARE_FLASH_H
+#define HOST_SHIM_HARDWARE_FLASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLASH_PAGE_SIZE   (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+
+// XIPでマップされたフラッシュの代わりにホストメモリ上のイメージを使う
+extern uint8_t sim_flash_image[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)sim_flash_image)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count);
+
+#endif // HOST_SHIM_HARDWARE_FLASH_H
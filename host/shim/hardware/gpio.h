@@ -0,0 +1,18 @@
+#ifndef HOST_SHIM_HARDWARE_GPIO_H
+#define HOST_SHIM_HARDWARE_GPIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define GPIO_IN  false
+#define GPIO_OUT true
+
+#define NUM_BANK0_GPIOS 30
+
+void gpio_init(unsigned int gpio);
+void gpio_set_dir(unsigned int gpio, bool out);
+void gpio_pull_up(unsigned int gpio);
+bool gpio_get(unsigned int gpio);
+uint32_t gpio_get_all(void);
+
+#endif // HOST_SHIM_HARDWARE_GPIO_H
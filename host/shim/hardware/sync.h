@@ -0,0 +1,15 @@
+#ifndef HOST_SHIM_HARDWARE_SYNC_H
+#define HOST_SHIM_HARDWARE_SYNC_H
+
+#include <stdint.h>
+
+// シミュレータは割り込みを持たないので何もしない
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {
+    (void) status;
+}
+
+#endif // HOST_SHIM_HARDWARE_SYNC_H
@@ -0,0 +1,12 @@
+#ifndef HOST_SHIM_HARDWARE_TIMER_H
+#define HOST_SHIM_HARDWARE_TIMER_H
+
+// Pico SDK hardware/timer.h の置き換え（ホストビルド用）
+// 起動からの時刻はシミュレータの仮想時間
+
+#include <stdint.h>
+
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+
+#endif // HOST_SHIM_HARDWARE_TIMER_H
@@ -0,0 +1,6 @@
+#ifndef HOST_SHIM_PICO_FLASH_H
+#define HOST_SHIM_PICO_FLASH_H
+
+#include "hardware/flash.h"
+
+#endif // HOST_SHIM_PICO_FLASH_H
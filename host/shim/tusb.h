@@ -0,0 +1,45 @@
+#ifndef HOST_SHIM_TUSB_H
+#define HOST_SHIM_TUSB_H
+
+// ファームウェアが使うTinyUSBデバイスAPIの最小限の置き換え（ホストビルド用）
+// 実装はhost/sim.cにあり、USBフレーム単位の転送をシミュレートする
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "tusb_config.h"
+
+#ifndef TUD_OPT_HIGH_SPEED
+#define TUD_OPT_HIGH_SPEED 0
+#endif
+
+typedef enum {
+    HID_REPORT_TYPE_INVALID = 0,
+    HID_REPORT_TYPE_INPUT,
+    HID_REPORT_TYPE_OUTPUT,
+    HID_REPORT_TYPE_FEATURE
+} hid_report_type_t;
+
+bool tusb_init(void);
+void tud_task(void);
+bool tud_mounted(void);
+
+// MIDI
+bool tud_midi_mounted(void);
+uint32_t tud_midi_available(void);
+bool tud_midi_packet_read(uint8_t packet[4]);
+bool tud_midi_packet_write(uint8_t const packet[4]);
+uint32_t tud_midi_stream_read(void* buffer, uint32_t bufsize);
+uint32_t tud_midi_stream_write(uint8_t cable_num, uint8_t const* buffer, uint32_t bufsize);
+
+// HID
+bool tud_hid_ready(void);
+bool tud_hid_report(uint8_t report_id, void const* report, uint16_t len);
+
+// アプリケーション側コールバック
+void tud_mount_cb(void);
+void tud_umount_cb(void);
+
+#endif // HOST_SHIM_TUSB_H
@@ -0,0 +1,500 @@
+#include "sim.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "hardware/gpio.h"
+#include "flash_sim.h"
+#include "switch_pins.h"
+
+// TinyUSBのFIFOサイズ（tusb_config.h）をUSB-MIDIパケット数に換算
+#define TX_FIFO_PACKETS (CFG_TUD_MIDI_TX_BUFSIZE / 4)
+#define RX_FIFO_PACKETS (CFG_TUD_MIDI_RX_BUFSIZE / 4)
+
+typedef struct {
+    uint8_t data[4];
+} usb_midi_packet_t;
+
+// 4バイトパケットのリングバッファ
+typedef struct {
+    usb_midi_packet_t* packets;
+    size_t capacity;
+    size_t head;
+    size_t count;
+} packet_fifo_t;
+
+static sim_options_t options;
+static uint64_t now_us;
+static uint64_t next_frame_us;
+static uint64_t usb_init_us;       // tusb_init()が呼ばれた時刻
+static uint32_t pin_levels;
+static bool mounted;
+
+static usb_midi_packet_t tx_storage[TX_FIFO_PACKETS];
+static usb_midi_packet_t rx_storage[RX_FIFO_PACKETS];
+static packet_fifo_t tx_fifo = {tx_storage, TX_FIFO_PACKETS, 0, 0};
+static packet_fifo_t rx_fifo = {rx_storage, RX_FIFO_PACKETS, 0, 0};
+
+// ホストがまだ送っていないパケット（サイズ無制限）
+static packet_fifo_t host_out = {NULL, 0, 0, 0};
+
+// tud_midi_stream_writeのパケット化状態
+static uint8_t tx_stream_packet[4];
+static uint8_t tx_stream_index;
+static uint8_t tx_stream_total;
+static bool tx_stream_in_sysex;
+static uint32_t tx_stream_rejected;
+static size_t tx_high_water;
+
+// HIDは1フレームに1レポート（bInterval = 1ms）
+static bool hid_busy;
+static sim_packet_t hid_pending;
+
+static sim_packet_t* packet_log;
+static size_t packet_log_count;
+static size_t packet_log_capacity;
+static bool packet_logging = true;
+static sim_packet_cb_t packet_cb;
+static void* packet_cb_user;
+
+static bool uart_echo;
+
+//--------------------------------------------------------------------+
+// FIFO helpers
+//--------------------------------------------------------------------+
+
+static bool fifo_push(packet_fifo_t* fifo, const uint8_t data[4]) {
+    if (fifo->count == fifo->capacity) {
+        if (fifo != &host_out) return false;
+
+        // ホスト側の送信待ちキューは必要に応じて拡張する
+        size_t capacity = fifo->capacity ? fifo->capacity * 2 : 64;
+        usb_midi_packet_t* packets = malloc(capacity * sizeof(*packets));
+        if (!packets) return false;
+        for (size_t i = 0; i < fifo->count; i++) {
+            packets[i] = fifo->packets[(fifo->head + i) % fifo->capacity];
+        }
+        free(fifo->packets);
+        fifo->packets = packets;
+        fifo->capacity = capacity;
+        fifo->head = 0;
+    }
+    memcpy(fifo->packets[(fifo->head + fifo->count) % fifo->capacity].data, data, 4);
+    fifo->count++;
+    if (fifo == &tx_fifo && fifo->count > tx_high_water) {
+        tx_high_water = fifo->count;
+    }
+    return true;
+}
+
+static bool fifo_pop(packet_fifo_t* fifo, uint8_t data[4]) {
+    if (fifo->count == 0) return false;
+    memcpy(data, fifo->packets[fifo->head].data, 4);
+    fifo->head = (fifo->head + 1) % fifo->capacity;
+    fifo->count--;
+    return true;
+}
+
+static void fifo_clear(packet_fifo_t* fifo) {
+    fifo->head = 0;
+    fifo->count = 0;
+}
+
+//--------------------------------------------------------------------+
+// Host side
+//--------------------------------------------------------------------+
+
+static void deliver(const sim_packet_t* packet) {
+    if (packet_logging) {
+        if (packet_log_count == packet_log_capacity) {
+            size_t capacity = packet_log_capacity ? packet_log_capacity * 2 : 256;
+            sim_packet_t* log = realloc(packet_log, capacity * sizeof(*log));
+            if (!log) return;
+            packet_log = log;
+            packet_log_capacity = capacity;
+        }
+        packet_log[packet_log_count++] = *packet;
+    }
+    if (packet_cb) {
+        packet_cb(packet, packet_cb_user);
+    }
+}
+
+// USBフレーム境界の処理：TXをホストへ届け、ホストからのOUTをRX FIFOへ入れる
+static void usb_frame(uint64_t frame_us) {
+    if (!mounted) return;
+
+    uint8_t data[4];
+    for (uint32_t i = 0; i < options.midi_packets_per_frame && fifo_pop(&tx_fifo, data); i++) {
+        sim_packet_t packet = {frame_us, SIM_PACKET_MIDI, 4, {0}};
+        memcpy(packet.data, data, 4);
+        deliver(&packet);
+    }
+
+    if (hid_busy) {
+        hid_pending.time_us = frame_us;
+        deliver(&hid_pending);
+        hid_busy = false;
+    }
+
+    while (rx_fifo.count < rx_fifo.capacity && fifo_pop(&host_out, data)) {
+        fifo_push(&rx_fifo, data);
+    }
+}
+
+static void advance(uint32_t us) {
+    now_us += us;
+    while (now_us >= next_frame_us) {
+        usb_frame(next_frame_us);
+        next_frame_us += SIM_FRAME_US;
+    }
+}
+
+// フラッシュの消去・書き込みの間、CPUはXIPから命令を読めずに止まっている
+static void stall_for_flash(void) {
+    uint64_t blackout = flash_sim_take_blackout_us();
+    if (options.flash_stalls && blackout > 0) {
+        advance((uint32_t)blackout);
+    }
+}
+
+void sim_default_options(sim_options_t* opts) {
+    opts->loop_us = 10;
+    opts->midi_packets_per_frame = TX_FIFO_PACKETS;
+    opts->erase_flash = true;
+    opts->flash_stalls = false;
+}
+
+void sim_reset(const sim_options_t* opts) {
+    if (opts) {
+        options = *opts;
+    } else {
+        sim_default_options(&options);
+    }
+    if (options.loop_us == 0) options.loop_us = 1;
+
+    now_us = 0;
+    next_frame_us = SIM_FRAME_US;
+    usb_init_us = 0;
+    pin_levels = 0xFFFFFFFF;  // 全ピンプルアップ（スイッチ解放）
+    mounted = true;
+
+    fifo_clear(&tx_fifo);
+    fifo_clear(&rx_fifo);
+    fifo_clear(&host_out);
+    tx_stream_index = tx_stream_total = 0;
+    tx_stream_in_sysex = false;
+    tx_stream_rejected = 0;
+    tx_high_water = 0;
+    hid_busy = false;
+    packet_log_count = 0;
+
+    if (options.erase_flash) {
+        flash_sim_erase_all();
+    }
+    flash_sim_take_blackout_us();
+
+    picomidi_init();
+    tud_mount_cb();
+    stall_for_flash();
+}
+
+void sim_step(void) {
+    picomidi_task();
+    advance(options.loop_us);
+    stall_for_flash();
+}
+
+void sim_run_until(uint64_t until_us) {
+    while (now_us < until_us) {
+        sim_step();
+    }
+}
+
+uint64_t sim_now_us(void) {
+    return now_us;
+}
+
+uint64_t sim_usb_init_us(void) {
+    return usb_init_us;
+}
+
+void sim_set_pin(uint8_t gpio, bool level) {
+    if (gpio >= 32) return;
+    if (level) {
+        pin_levels |= 1u << gpio;
+    } else {
+        pin_levels &= ~(1u << gpio);
+    }
+}
+
+void sim_set_switch(uint8_t switch_idx, bool pressed) {
+    if (switch_idx >= num_switches) return;
+    sim_set_pin(switch_pins[switch_idx], !pressed);
+}
+
+void sim_set_mounted(bool state) {
+    if (mounted == state) return;
+    mounted = state;
+    if (mounted) {
+        tud_mount_cb();
+    } else {
+        fifo_clear(&tx_fifo);
+        hid_busy = false;
+        tud_umount_cb();
+    }
+}
+
+void sim_midi_packetize(const uint8_t* bytes, size_t len, sim_midi_packet_cb_t emit, void* user) {
+    size_t i = 0;
+    while (i < len) {
+        uint8_t packet[4] = {0};
+        uint8_t status = bytes[i];
+
+        if (status == 0xF0 || status == 0xF7 || status < 0x80) {
+            // SysEx（途中から始まるデータバイトも続きとして扱う）
+            uint8_t n = 0;
+            while (i < len && n < 3) {
+                packet[1 + n++] = bytes[i];
+                if (bytes[i++] == 0xF7) break;
+            }
+            if (packet[n] == 0xF7) {
+                packet[0] = 0x04 + n;  // 0x05, 0x06, 0x07: SysEx end
+            } else {
+                packet[0] = 0x04;      // SysEx start/continue
+            }
+        } else if (status >= 0xF8) {
+            packet[0] = 0x0F;          // リアルタイムメッセージ
+            packet[1] = bytes[i++];
+        } else {
+            uint8_t type = status >> 4;
+            uint8_t size = (type == 0xC || type == 0xD) ? 2 : 3;
+            packet[0] = type;
+            for (uint8_t n = 0; n < size && i < len; n++) {
+                packet[1 + n] = bytes[i++];
+            }
+        }
+        emit(packet, user);
+    }
+}
+
+static void push_host_out(const uint8_t packet[4], void* user) {
+    (void) user;
+    fifo_push(&host_out, packet);
+}
+
+// MIDIバイト列をUSB-MIDIパケットに変換してホスト送信キューへ
+void sim_host_send(const uint8_t* bytes, size_t len) {
+    sim_midi_packetize(bytes, len, push_host_out, NULL);
+}
+
+bool sim_rx_inject(const uint8_t packet[4]) {
+    return fifo_push(&rx_fifo, packet);
+}
+
+bool sim_tx_pop(uint8_t packet[4]) {
+    return fifo_pop(&tx_fifo, packet);
+}
+
+void sim_tx_discard(void) {
+    fifo_clear(&tx_fifo);
+    hid_busy = false;
+}
+
+void sim_set_packet_callback(sim_packet_cb_t callback, void* user) {
+    packet_cb = callback;
+    packet_cb_user = user;
+}
+
+size_t sim_packet_count(void) {
+    return packet_log_count;
+}
+
+const sim_packet_t* sim_packet_at(size_t index) {
+    return index < packet_log_count ? &packet_log[index] : NULL;
+}
+
+void sim_clear_packets(void) {
+    packet_log_count = 0;
+}
+
+void sim_set_packet_logging(bool enabled) {
+    packet_logging = enabled;
+}
+
+size_t sim_tx_high_water(void) {
+    return tx_high_water;
+}
+
+uint32_t sim_tx_stream_rejected(void) {
+    return tx_stream_rejected;
+}
+
+void sim_set_uart_echo(bool enabled) {
+    uart_echo = enabled;
+}
+
+//--------------------------------------------------------------------+
+// Board / GPIO shims
+//--------------------------------------------------------------------+
+
+void board_init(void) {
+}
+
+uint32_t board_millis(void) {
+    return (uint32_t)(now_us / 1000);
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t)now_us;
+}
+
+uint64_t time_us_64(void) {
+    return now_us;
+}
+
+void board_led_write(bool state) {
+    (void) state;
+}
+
+int sim_uart_printf(const char* format, ...) {
+    if (!uart_echo) return 0;
+
+    va_list args;
+    va_start(args, format);
+    int n = vfprintf(stderr, format, args);
+    va_end(args);
+    return n;
+}
+
+void gpio_init(unsigned int gpio) {
+    (void) gpio;
+}
+
+void gpio_set_dir(unsigned int gpio, bool out) {
+    (void) gpio;
+    (void) out;
+}
+
+void gpio_pull_up(unsigned int gpio) {
+    (void) gpio;
+}
+
+bool gpio_get(unsigned int gpio) {
+    return (pin_levels >> gpio) & 1;
+}
+
+uint32_t gpio_get_all(void) {
+    return pin_levels;
+}
+
+//--------------------------------------------------------------------+
+// TinyUSB shims
+//--------------------------------------------------------------------+
+
+bool tusb_init(void) {
+    // それまでのフラッシュの書き込みはUSBの開始を遅らせる
+    stall_for_flash();
+    usb_init_us = now_us;
+    return true;
+}
+
+void tud_task(void) {
+    // USB転送は仮想時間のフレーム境界で処理する（advance）
+}
+
+bool tud_mounted(void) {
+    return mounted;
+}
+
+bool tud_midi_mounted(void) {
+    return mounted;
+}
+
+uint32_t tud_midi_available(void) {
+    return (uint32_t)rx_fifo.count * 4;
+}
+
+bool tud_midi_packet_read(uint8_t packet[4]) {
+    return fifo_pop(&rx_fifo, packet);
+}
+
+bool tud_midi_packet_write(uint8_t const packet[4]) {
+    if (!mounted) return false;
+    return fifo_push(&tx_fifo, packet);
+}
+
+uint32_t tud_midi_stream_read(void* buffer, uint32_t bufsize) {
+    // パケット単位のtud_midi_packet_readのみサポート
+    (void) buffer;
+    (void) bufsize;
+    return 0;
+}
+
+// TinyUSBと同様にバイト列をUSB-MIDIパケットにまとめてTX FIFOへ書く
+// FIFOが一杯になったらそこで止め、受け付けたバイト数を返す（残りは呼び出し側が再送する）
+uint32_t tud_midi_stream_write(uint8_t cable_num, uint8_t const* buffer, uint32_t bufsize) {
+    if (!mounted) return 0;
+
+    for (uint32_t i = 0; i < bufsize; i++) {
+        if (tx_fifo.count == tx_fifo.capacity) {
+            tx_stream_rejected += bufsize - i;
+            return i;
+        }
+        uint8_t data = buffer[i];
+
+        if (tx_stream_index == 0) {
+            memset(tx_stream_packet, 0, sizeof(tx_stream_packet));
+            tx_stream_index = 1;
+            if (data == 0xF0) {
+                tx_stream_in_sysex = true;
+            }
+            if (tx_stream_in_sysex) {
+                tx_stream_total = 4;
+            } else if (data >= 0x80 && data < 0xF0) {
+                uint8_t type = data >> 4;
+                tx_stream_total = (type == 0xC || type == 0xD) ? 3 : 4;
+                tx_stream_packet[0] = (uint8_t)(cable_num << 4 | type);
+            } else {
+                tx_stream_total = 2;
+                tx_stream_packet[0] = (uint8_t)(cable_num << 4 | 0x0F);
+            }
+        }
+
+        tx_stream_packet[tx_stream_index++] = data;
+
+        if (tx_stream_in_sysex) {
+            if (data == 0xF7) {
+                tx_stream_packet[0] = (uint8_t)(cable_num << 4 | (0x04 + tx_stream_index - 1));
+                tx_stream_total = tx_stream_index;
+                tx_stream_in_sysex = false;
+            } else {
+                tx_stream_packet[0] = (uint8_t)(cable_num << 4 | 0x04);
+            }
+        }
+
+        if (tx_stream_index == tx_stream_total) {
+            tx_stream_index = tx_stream_total = 0;
+            fifo_push(&tx_fifo, tx_stream_packet);
+        }
+    }
+    return bufsize;
+}
+
+bool tud_hid_ready(void) {
+    return mounted && !hid_busy;
+}
+
+bool tud_hid_report(uint8_t report_id, void const* report, uint16_t len) {
+    if (!tud_hid_ready() || len + 1 > SIM_MAX_PACKET_LEN) return false;
+
+    hid_pending.kind = SIM_PACKET_HID;
+    hid_pending.len = (uint8_t)(len + 1);
+    hid_pending.data[0] = report_id;
+    memcpy(&hid_pending.data[1], report, len);
+    hid_busy = true;
+    return true;
+}
@@ -0,0 +1,112 @@
+#ifndef PICOMIDI_SIM_H
+#define PICOMIDI_SIM_H
+
+// ホスト上でpicomidi.cを動かすためのシミュレータ
+//
+// 時刻は仮想時間（マイクロ秒）で、sim_step()で進む。
+// メインループ1回をloop_us、USBフレームを1000usとして扱い、
+// TX FIFOの中身はフレーム毎にホストへ届いたものとして記録する。
+// 同じ入力からは常に同じ出力が得られる。
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SIM_FRAME_US 1000
+#define SIM_MAX_PACKET_LEN 9   // HIDキーボードレポート(8) + レポートID
+
+typedef enum {
+    SIM_PACKET_MIDI = 0,   // USB-MIDIイベントパケット（4バイト）
+    SIM_PACKET_HID = 1     // HIDレポート（先頭がレポートID）
+} sim_packet_kind_t;
+
+typedef struct {
+    uint64_t time_us;      // ホストに届いた時刻
+    uint8_t kind;          // sim_packet_kind_t
+    uint8_t len;
+    uint8_t data[SIM_MAX_PACKET_LEN];
+} sim_packet_t;
+
+typedef struct {
+    uint32_t loop_us;                  // メインループ1回の仮想時間
+    uint32_t midi_packets_per_frame;   // 1フレームでホストが受け取るUSB-MIDIパケット数
+    bool erase_flash;                  // sim_reset時にフラッシュを消去する
+    bool flash_stalls;                 // フラッシュの消去・書き込み中は仮想時間を止める（XIP停止の再現）
+} sim_options_t;
+
+// シミュレータがホストに届けたパケット毎に呼ばれる（NULL可）
+typedef void (*sim_packet_cb_t)(const sim_packet_t* packet, void* user);
+
+void sim_default_options(sim_options_t* options);
+
+// 全状態を初期化してファームウェアを起動（picomidi_init）する
+void sim_reset(const sim_options_t* options);
+
+// メインループを1回実行し、仮想時間をloop_us進める
+void sim_step(void);
+
+// 仮想時間がuntil_usに達するまでメインループを回す
+void sim_run_until(uint64_t until_us);
+
+uint64_t sim_now_us(void);
+
+// 直近の起動でファームウェアがtusb_init()を呼んだ仮想時刻
+uint64_t sim_usb_init_us(void);
+
+// スイッチ入力（switch_pins[]のインデックス指定）。押下でLow
+void sim_set_switch(uint8_t switch_idx, bool pressed);
+void sim_set_pin(uint8_t gpio, bool level);
+
+// ホストからデバイスへMIDIバイト列を送る（USB-MIDIパケットに変換してRXへ）
+void sim_host_send(const uint8_t* bytes, size_t len);
+
+// MIDIバイト列をsim_host_sendと同じ規則でUSB-MIDIパケットに変換する
+typedef void (*sim_midi_packet_cb_t)(const uint8_t packet[4], void* user);
+void sim_midi_packetize(const uint8_t* bytes, size_t len, sim_midi_packet_cb_t emit, void* user);
+
+// USB接続状態
+void sim_set_mounted(bool mounted);
+
+// ホストに届いたパケットの記録
+void sim_set_packet_callback(sim_packet_cb_t callback, void* user);
+size_t sim_packet_count(void);
+const sim_packet_t* sim_packet_at(size_t index);
+void sim_clear_packets(void);
+void sim_set_packet_logging(bool enabled);
+
+// TX FIFOが一杯でtud_midi_stream_writeが受け付けなかったバイト数
+// （ファームウェアが後で書き直すべきもの）
+uint32_t sim_tx_stream_rejected(void);
+
+// TX FIFOに溜まったパケット数の最大値
+size_t sim_tx_high_water(void);
+
+// LEDの表示内容（led_sim.c）
+uint32_t sim_ws2812_pixel(uint8_t index);   // GRB << 8
+uint32_t sim_ws2812_frames(void);           // 転送したフレーム数
+uint8_t sim_led_base(void);
+
+// ファームウェアのUART出力を表示するか
+void sim_set_uart_echo(bool enabled);
+
+// ファームウェア（picomidi.c）のエントリポイント
+void picomidi_init(void);
+void picomidi_task(void);
+
+// ベンチマーク用に個別に呼び出すファームウェア内部の関数
+void check_switches(void);
+void send_midi_messages(uint8_t event_idx);
+void service_output_queue(void);
+void midi_rx_task(void);
+void get_output_queue_stats(uint32_t* queued, uint32_t* drops, uint8_t* high_water);
+
+// USBフレームを待たずにRX FIFOへ直接パケットを入れる（満杯ならfalse）
+bool sim_rx_inject(const uint8_t packet[4]);
+
+// USBフレームを待たずにTX FIFOからパケットを取り出す（空ならfalse）
+bool sim_tx_pop(uint8_t packet[4]);
+
+// TX FIFOの中身をホストに届けずに捨てる
+void sim_tx_discard(void);
+
+#endif // PICOMIDI_SIM_H
@@ -0,0 +1,320 @@
+// スイッチ入力のストレス試験（シミュレータ）
+//
+// usage: picomidi_stress [-d ms] [-i min_ms] [-I max_ms] [-b bounces] [-m messages]
+//                        [-f packets_per_frame] [-s seed] [--sweep] [--check] [-o result.json]
+//
+// 全スイッチにstress.hのパターン（乱数間隔の押下/解放 + チャタリング）を与え、
+// 受け付けた押下/解放毎に設定したパケット列がそのまま、順番通りに届いたかを検査する。
+// イベント毎に異なるメッセージ（-m 個）を設定するので、欠落・重複・入れ替わりを区別できる。
+// --sweep はメッセージ数を変えて繰り返し、欠落なしで処理できたイベントレートを報告する。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "stress.h"
+#include "switch_pins.h"
+
+#define SETTLE_US 100000
+#define DRAIN_US 100000
+#define SEARCH_WINDOW 1024
+
+typedef struct {
+    uint64_t time_us;
+    uint8_t switch_idx;
+    bool pressed;
+} accepted_edge_t;
+
+typedef struct {
+    uint32_t duration_ms;
+    stress_params_t params;
+    uint8_t messages;
+    uint32_t packets_per_frame;
+    uint32_t seed;
+} stress_config_t;
+
+typedef struct {
+    uint32_t transitions;
+    uint32_t accepted;          // ファームウェアが受け付けた押下/解放（キュー投入 + 溢れ）
+    uint32_t queue_drops;
+    uint8_t queue_high_water;
+    size_t tx_high_water;
+    uint32_t expected_packets;
+    uint32_t received_packets;
+    uint32_t lost;
+    uint32_t unexpected;        // 期待しない/順序が入れ替わったパケット
+    double events_per_sec;
+    double packets_per_sec;
+    bool ok;
+} stress_result_t;
+
+static accepted_edge_t* edges;
+static size_t edge_count;
+static size_t edge_capacity;
+
+static uint8_t (*received)[4];
+static size_t received_count;
+static size_t received_capacity;
+static bool recording;
+
+//--------------------------------------------------------------------+
+// Helpers
+//--------------------------------------------------------------------+
+
+static void* grow(void* array, size_t* capacity, size_t element) {
+    size_t next = *capacity ? *capacity * 2 : 4096;
+    void* grown = realloc(array, next * element);
+    if (!grown) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+    *capacity = next;
+    return grown;
+}
+
+// イベント(switch, event)のk番目のメッセージ（CC、イベント毎に一意）
+static void event_packet(uint8_t switch_idx, bool pressed, uint8_t k, uint8_t out[4]) {
+    uint8_t event_idx = switch_idx * 2 + (pressed ? 0 : 1);
+    out[0] = 0x0B;
+    out[1] = 0xB0 | (event_idx & 0x0F);
+    out[2] = (uint8_t)((event_idx >> 4) * 16 + k);
+    out[3] = pressed ? 127 : 0;
+}
+
+static void configure_events(uint8_t messages) {
+    for (uint8_t sw = 0; sw < num_switches; sw++) {
+        for (uint8_t ev = 0; ev < 2; ev++) {
+            uint8_t sysex[9 + 10 * 4] = {0xF0, 0x00, 0x7D, 0x01, 0x03, sw, ev, messages};
+            size_t len = 8;
+            for (uint8_t k = 0; k < messages; k++) {
+                uint8_t packet[4];
+                event_packet(sw, ev == 0, k, packet);
+                sysex[len++] = 0x01;                 // CC
+                sysex[len++] = packet[1] & 0x0F;
+                sysex[len++] = packet[2];
+                sysex[len++] = packet[3];
+            }
+            sysex[len++] = 0xF7;
+            sim_host_send(sysex, len);
+            sim_run_until(sim_now_us() + 5000);
+        }
+    }
+    sim_run_until(sim_now_us() + 50000);
+}
+
+static void on_packet(const sim_packet_t* packet, void* user) {
+    (void) user;
+    uint8_t cin = packet->data[0] & 0x0F;
+    if (!recording || packet->kind != SIM_PACKET_MIDI || (cin >= 0x04 && cin <= 0x07)) return;
+
+    if (received_count == received_capacity) {
+        received = grow(received, &received_capacity, sizeof(*received));
+    }
+    memcpy(received[received_count++], packet->data, 4);
+}
+
+static void on_edge(uint64_t time_us, uint8_t switch_idx, bool level, bool transition, void* user) {
+    (void) time_us;
+    (void) user;
+    sim_set_pin(switch_pins[switch_idx], level);
+    if (!transition) return;
+
+    // 次のループで読まれる（同じループ内ではスイッチ番号順に処理される）
+    if (edge_count == edge_capacity) {
+        edges = grow(edges, &edge_capacity, sizeof(*edges));
+    }
+    edges[edge_count++] = (accepted_edge_t){sim_now_us(), switch_idx, !level};
+}
+
+static int compare_edges(const void* a, const void* b) {
+    const accepted_edge_t* x = a;
+    const accepted_edge_t* y = b;
+    if (x->time_us != y->time_us) return x->time_us < y->time_us ? -1 : 1;
+    return (int)x->switch_idx - (int)y->switch_idx;
+}
+
+// 期待するパケット列と届いたパケット列を先頭から突き合わせる
+static void compare_streams(stress_result_t* result, uint8_t messages) {
+    qsort(edges, edge_count, sizeof(*edges), compare_edges);
+
+    size_t expected_count = edge_count * messages;
+    uint8_t (*expected)[4] = malloc((expected_count ? expected_count : 1) * sizeof(*expected));
+    for (size_t e = 0; e < edge_count; e++) {
+        for (uint8_t k = 0; k < messages; k++) {
+            event_packet(edges[e].switch_idx, edges[e].pressed, k, expected[e * messages + k]);
+        }
+    }
+
+    size_t j = 0;
+    for (size_t i = 0; i < received_count; i++) {
+        size_t found = j;
+        while (found < expected_count && found < j + SEARCH_WINDOW &&
+               memcmp(expected[found], received[i], 4) != 0) {
+            found++;
+        }
+        if (found < expected_count && found < j + SEARCH_WINDOW) {
+            result->lost += (uint32_t)(found - j);  // 飛ばした分は届かなかった
+            j = found + 1;
+        } else {
+            result->unexpected++;
+        }
+    }
+    result->lost += (uint32_t)(expected_count - j);
+    result->expected_packets = (uint32_t)expected_count;
+    result->received_packets = (uint32_t)received_count;
+    free(expected);
+}
+
+//--------------------------------------------------------------------+
+// Runner
+//--------------------------------------------------------------------+
+
+static void run_stress(const stress_config_t* config, stress_result_t* result) {
+    memset(result, 0, sizeof(*result));
+    edge_count = 0;
+    received_count = 0;
+    recording = false;
+
+    sim_options_t options;
+    sim_default_options(&options);
+    if (config->packets_per_frame) options.midi_packets_per_frame = config->packets_per_frame;
+    sim_reset(&options);
+    sim_set_packet_logging(false);
+    sim_set_packet_callback(on_packet, NULL);
+    sim_run_until(SETTLE_US);
+    configure_events(config->messages);
+
+    uint32_t base_queued, base_drops;
+    uint8_t high_water;
+    get_output_queue_stats(&base_queued, &base_drops, &high_water);
+
+    recording = true;
+    uint64_t start = sim_now_us();
+    uint64_t end = start + (uint64_t)config->duration_ms * 1000;
+    stress_gen_init(&config->params, num_switches, config->seed, start);
+
+    uint64_t next = stress_gen_poll(start, on_edge, NULL);
+    while (next < end) {
+        sim_run_until(next);
+        next = stress_gen_poll(sim_now_us(), on_edge, NULL);
+    }
+    sim_run_until(end);
+
+    // 最後の押下/解放の送信を待つ
+    sim_run_until(sim_now_us() + DRAIN_US);
+    sim_set_packet_callback(NULL, NULL);
+
+    uint32_t queued, drops;
+    get_output_queue_stats(&queued, &drops, &result->queue_high_water);
+    result->transitions = stress_gen_transitions();
+    result->accepted = (queued - base_queued) + (drops - base_drops);
+    result->queue_drops = drops - base_drops;
+    result->tx_high_water = sim_tx_high_water();
+
+    compare_streams(result, config->messages);
+
+    double seconds = config->duration_ms / 1000.0;
+    result->events_per_sec = result->transitions / seconds;
+    result->packets_per_sec = result->received_packets / seconds;
+    result->ok = result->lost == 0 && result->unexpected == 0 && result->queue_drops == 0 &&
+                 result->accepted == result->transitions && result->transitions == edge_count;
+}
+
+static void print_result(FILE* out, const stress_config_t* config, const stress_result_t* r, const char* suffix) {
+    fprintf(out,
+        "{\"switches\": %u, \"messages_per_event\": %u, \"min_interval_us\": %u, \"max_interval_us\": %u, "
+        "\"max_bounces\": %u, \"packets_per_frame\": %u, \"duration_ms\": %u, "
+        "\"events\": %u, \"accepted\": %u, \"events_per_sec\": %.1f, \"packets_per_sec\": %.1f, "
+        "\"expected_packets\": %u, \"received_packets\": %u, \"lost\": %u, \"unexpected\": %u, "
+        "\"queue_drops\": %u, \"queue_high_water\": %u, \"tx_fifo_high_water\": %zu, \"ok\": %s}%s\n",
+        num_switches, config->messages, config->params.min_interval_us, config->params.max_interval_us,
+        config->params.max_bounces, config->packets_per_frame, config->duration_ms,
+        r->transitions, r->accepted, r->events_per_sec, r->packets_per_sec,
+        r->expected_packets, r->received_packets, r->lost, r->unexpected,
+        r->queue_drops, r->queue_high_water, r->tx_high_water, r->ok ? "true" : "false", suffix);
+}
+
+int main(int argc, char** argv) {
+    stress_config_t config = {
+        .duration_ms = 10000,
+        .params = {25000, 60000, 6},
+        .messages = 1,
+        .packets_per_frame = 0,
+        .seed = 1,
+    };
+    bool sweep = false;
+    bool check = false;
+    const char* output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            config.duration_ms = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            config.params.min_interval_us = (uint32_t)(strtod(argv[++i], NULL) * 1000);
+        } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+            config.params.max_interval_us = (uint32_t)(strtod(argv[++i], NULL) * 1000);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            config.params.max_bounces = (uint8_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            config.messages = (uint8_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            config.packets_per_frame = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            config.seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--sweep") == 0) {
+            sweep = true;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-d ms] [-i min_ms] [-I max_ms] [-b bounces] [-m messages] "
+                            "[-f packets_per_frame] [-s seed] [--sweep] [--check] [-o result.json]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (config.messages < 1 || config.messages > 10) {
+        fprintf(stderr, "messages must be 1-10\n");
+        return 2;
+    }
+
+    FILE* out = stdout;
+    if (output) {
+        out = fopen(output, "w");
+        if (!out) {
+            perror(output);
+            return 2;
+        }
+    }
+
+    bool all_ok = true;
+    if (sweep) {
+        // デバウンスが許す最短の間隔で、メッセージ数を増やしながら欠落なしで処理できた最大のパケットレートを探す
+        config.params.min_interval_us = 21000;
+        config.params.max_interval_us = 25000;
+        static const uint8_t message_counts[] = {1, 2, 4, 6, 8, 10};
+        size_t count = sizeof(message_counts) / sizeof(message_counts[0]);
+        double capacity = 0;
+        fprintf(out, "{\"runs\": [\n");
+        for (size_t i = 0; i < count; i++) {
+            stress_result_t result;
+            config.messages = message_counts[i];
+            run_stress(&config, &result);
+            print_result(out, &config, &result, i + 1 < count ? "," : "");
+            if (result.ok && result.packets_per_sec > capacity) capacity = result.packets_per_sec;
+            all_ok = all_ok && result.ok;
+        }
+        fprintf(out, "], \"max_lossless_packets_per_sec\": %.1f}\n", capacity);
+    } else {
+        stress_result_t result;
+        run_stress(&config, &result);
+        print_result(out, &config, &result, "");
+        all_ok = result.ok;
+    }
+
+    if (out != stdout) fclose(out);
+    free(edges);
+    free(received);
+    return (check && !all_ok) ? 1 : 0;
+}
@@ -0,0 +1,162 @@
+// 送信中のイベントの設定を差し替えたときの検査
+//
+// usage: swap_test
+//
+// ホストが1フレームに1パケットしか読まず、10メッセージのイベントがTX FIFOに入りきらない間に
+// 同じイベントのSET_MESSAGEを送っても、送信中のイベントは古い設定のまま最後まで送られ（新旧が混ざらない）、
+// 次の押下から新しい設定になることを確認する。続けて送った要求は古い設定を送り終わるまで待たされる。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+
+#define LOOP_US 50
+#define MESSAGES 10
+
+// packets_per_frame: ホストが1フレームに読むパケット数（0は既定値）
+static void boot(uint32_t packets_per_frame) {
+    sim_options_t options;
+    sim_default_options(&options);
+    options.loop_us = LOOP_US;
+    options.erase_flash = true;
+    if (packets_per_frame != 0) {
+        options.midi_packets_per_frame = packets_per_frame;
+    }
+    test_boot_with(&options);
+}
+
+// スイッチの押下イベントを CC first..first+9（値 value、チャンネル1）にする
+static void send_set_message(uint8_t switch_idx, uint8_t first, uint8_t value) {
+    uint8_t sysex[9 + MESSAGES * 4];
+    size_t len = 0;
+    sysex[len++] = 0xF0;
+    sysex[len++] = 0x00;
+    sysex[len++] = 0x7D;
+    sysex[len++] = 0x01;
+    sysex[len++] = 0x03;
+    sysex[len++] = switch_idx;
+    sysex[len++] = 0x00;
+    sysex[len++] = MESSAGES;
+    for (uint8_t i = 0; i < MESSAGES; i++) {
+        sysex[len++] = 0x01;
+        sysex[len++] = 0x00;
+        sysex[len++] = first + i;
+        sysex[len++] = value;
+    }
+    sysex[len++] = 0xF7;
+    sim_host_send(sysex, len);
+}
+
+// 届いたCCのうち first..first+9 の範囲のものを順に集める
+static size_t collect_cc(uint8_t first, uint8_t* values, uint8_t* numbers, size_t max) {
+    size_t n = 0;
+    for (size_t i = 0; i < sim_packet_count(); i++) {
+        const sim_packet_t* packet = sim_packet_at(i);
+        if (packet->kind != SIM_PACKET_MIDI || (packet->data[0] & 0x0F) != 0x0B) continue;
+        uint8_t number = packet->data[2];
+        if (number < first || number >= first + MESSAGES || n >= max) continue;
+        numbers[n] = number;
+        values[n] = packet->data[3];
+        n++;
+    }
+    return n;
+}
+
+// 届いたSET_MESSAGEの応答のうち、結果がstatusのものの数
+static size_t count_status(uint8_t status) {
+    uint8_t message[16];
+    size_t pos = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < sim_packet_count(); i++) {
+        const sim_packet_t* packet = sim_packet_at(i);
+        uint8_t cin = packet->data[0] & 0x0F;
+        if (packet->kind != SIM_PACKET_MIDI || cin < 0x04 || cin > 0x07) continue;
+
+        uint8_t bytes = (cin == 0x04) ? 3 : cin - 0x04;
+        for (uint8_t k = 0; k < bytes && pos < sizeof(message); k++) {
+            message[pos++] = packet->data[1 + k];
+        }
+        if (cin != 0x04) {
+            if (pos == 7 && message[4] == 0x03 && message[5] == status) n++;
+            pos = 0;
+        }
+    }
+    return n;
+}
+
+static void check_event(uint8_t first, uint8_t value, const char* label) {
+    uint8_t values[3 * MESSAGES];
+    uint8_t numbers[3 * MESSAGES];
+    size_t n = collect_cc(first, values, numbers, sizeof(values));
+    CHECK(n == MESSAGES);
+    for (size_t i = 0; i < n && i < MESSAGES; i++) {
+        if (numbers[i] != first + i || values[i] != value) {
+            fprintf(stderr, "%s: packet %zu is CC %u = %u\n", label, i, numbers[i], values[i]);
+            test_failures++;
+            break;
+        }
+    }
+}
+
+static void test_swap_while_sending(void) {
+    boot(1);
+    send_set_message(0, 20, 1);
+    sim_run_until(sim_now_us() + 50000);
+    send_set_message(1, 20, 1);
+    sim_run_until(sim_now_us() + 50000);
+
+    // スイッチ0の10パケットでTX FIFOが埋まり、スイッチ1のイベントは途中まで送ったところで止まる
+    sim_clear_packets();
+    sim_set_switch(0, true);
+    sim_set_switch(1, true);
+    sim_run_until(sim_now_us() + 2000);
+
+    // 送信中のイベントを2回続けて差し替える（2回目は古い面を送り終わるまで読まれない）
+    send_set_message(1, 20, 2);
+    send_set_message(1, 20, 3);
+    sim_run_until(sim_now_us() + 200000);
+
+    uint8_t values[3 * MESSAGES];
+    uint8_t numbers[3 * MESSAGES];
+    size_t n = collect_cc(20, values, numbers, sizeof(values));
+    CHECK(n == 2 * MESSAGES);
+    // 先にスイッチ0、次にスイッチ1（押下の前の設定、値1）を混ぜずに送る
+    for (size_t i = 0; i < n; i++) {
+        if (numbers[i] != 20 + i % MESSAGES || values[i] != 1) {
+            fprintf(stderr, "in-flight event: packet %zu is CC %u = %u\n", i, numbers[i], values[i]);
+            test_failures++;
+            break;
+        }
+    }
+    CHECK(count_status(0x00) == 2);
+
+    // 次の押下は最後の設定
+    sim_set_switch(1, false);
+    sim_run_until(sim_now_us() + 100000);
+    sim_clear_packets();
+    sim_set_switch(1, true);
+    sim_run_until(sim_now_us() + 100000);
+    check_event(20, 3, "next press");
+}
+
+// 送信していないイベントの差し替えはすぐに反映される
+static void test_swap_idle(void) {
+    boot(0);
+    send_set_message(2, 40, 5);
+    sim_run_until(sim_now_us() + 20000);
+    sim_clear_packets();
+    sim_set_switch(2, true);
+    sim_run_until(sim_now_us() + 50000);
+    check_event(40, 5, "idle swap");
+}
+
+int main(void) {
+    sim_set_packet_logging(true);
+
+    test_swap_while_sending();
+    test_swap_idle();
+
+    return test_result();
+}
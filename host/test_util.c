@@ -0,0 +1,68 @@
+// ホストビルドのテストの共通部分（test_util.h）
+
+#include "test_util.h"
+
+int test_failures;
+
+void test_boot_with(const sim_options_t* options) {
+    sim_reset(options);
+    sim_run_until(TEST_SETTLE_US);
+}
+
+void test_boot(bool erase_flash, uint32_t loop_us) {
+    sim_options_t options;
+    sim_default_options(&options);
+    options.erase_flash = erase_flash;
+    if (loop_us != 0) {
+        options.loop_us = loop_us;
+    }
+    test_boot_with(&options);
+}
+
+size_t test_last_response(uint8_t* response, size_t max) {
+    size_t pos = 0;
+    size_t result = 0;
+    for (size_t i = 0; i < sim_packet_count(); i++) {
+        const sim_packet_t* packet = sim_packet_at(i);
+        uint8_t cin = packet->data[0] & 0x0F;
+        if (packet->kind != SIM_PACKET_MIDI || cin < 0x04 || cin > 0x07) continue;
+
+        uint8_t n = (cin == 0x04) ? 3 : cin - 0x04;
+        for (uint8_t k = 0; k < n && pos < max; k++) {
+            response[pos++] = packet->data[1 + k];
+        }
+        if (cin != 0x04) {
+            result = pos;
+            pos = 0;
+        }
+    }
+    return result;
+}
+
+size_t test_request(const uint8_t* sysex, size_t len, uint8_t* response, size_t max) {
+    sim_clear_packets();
+    sim_host_send(sysex, len);
+    sim_run_until(sim_now_us() + TEST_REQUEST_US);
+    return test_last_response(response, max);
+}
+
+int test_command(const uint8_t* sysex, size_t len) {
+    sim_clear_packets();
+    sim_host_send(sysex, len);
+    uint64_t deadline = sim_now_us() + TEST_COMMAND_US;
+    uint8_t response[64];
+    size_t n = 0;
+    while (sim_now_us() < deadline && (n = test_last_response(response, sizeof(response))) == 0) {
+        sim_step();
+    }
+    if (n != 7 || response[4] != sysex[4]) return -1;
+    return response[5];
+}
+
+int test_result(void) {
+    if (test_failures) {
+        fprintf(stderr, "%d check(s) failed\n", test_failures);
+        return 1;
+    }
+    return 0;
+}
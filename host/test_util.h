@@ -0,0 +1,43 @@
+// ホストビルドのテストの共通部分（検査マクロ、起動、SysExの要求と応答）
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sim.h"
+
+#define TEST_SETTLE_US 100000   // 起動から列挙と初期化が済むまで
+#define TEST_REQUEST_US 20000   // test_requestが応答を待つ時間
+#define TEST_COMMAND_US 200000  // test_commandが応答を待つ最大の時間（フラッシュの書き込みを含む）
+
+extern int test_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+// optionsで起動し（NULLは既定値）、TEST_SETTLE_USまで回す
+void test_boot_with(const sim_options_t* options);
+
+// 既定値にerase_flashとloop_us（0は既定値のまま）を設定して起動する
+void test_boot(bool erase_flash, uint32_t loop_us);
+
+// 記録したパケットから最後に届いたSysEx応答を組み立て、その長さを返す（なければ0）
+size_t test_last_response(uint8_t* response, size_t max);
+
+// SysExを送ってTEST_REQUEST_USだけ回し、最後に届いたSysEx応答を返す
+size_t test_request(const uint8_t* sysex, size_t len, uint8_t* response, size_t max);
+
+// SET系のSysExを送って応答が届くまで回し、結果（0: 成功、1: エラー、-1: 応答なし）を返す
+int test_command(const uint8_t* sysex, size_t len);
+
+// 失敗した検査の数を表示し、mainの戻り値を返す
+int test_result(void);
+
+#endif // TEST_UTIL_H
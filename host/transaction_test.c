@@ -0,0 +1,204 @@
+// 複数イベントのトランザクション（BEGIN/COMMIT/ROLLBACK）の検査
+//
+// usage: transaction_test
+//
+// トランザクション中のSET系は作業領域にたまるだけで、押下は古い設定のまま送られること、
+// GET系は作業領域を読むこと、COMMITで全部が一度に反映されフラッシュの書き込みが1回で済むこと、
+// ROLLBACKや切断で捨てられること、開いていないときのCOMMIT/ROLLBACKはエラーになることを確認する。
+// 16スイッチ分の押下・解放を書き換える時間を、SET毎に保存する場合と比べる。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "flash_sim.h"
+
+#define LOOP_US 50
+#define NUM_SWITCHES 16
+
+enum { CMD_GET_MESSAGE = 0x02, CMD_SET_MESSAGE = 0x03, CMD_SET_PIXEL_COLOR = 0x05, CMD_SET_PIN_MAP = 0x0A,
+       CMD_GET_DEBOUNCE = 0x0C, CMD_BEGIN = 0x0F, CMD_COMMIT = 0x10, CMD_ROLLBACK = 0x11 };
+
+static void boot(bool erase_flash, bool flash_stalls) {
+    sim_options_t options;
+    sim_default_options(&options);
+    options.loop_us = LOOP_US;
+    options.erase_flash = erase_flash;
+    options.flash_stalls = flash_stalls;
+    test_boot_with(&options);
+}
+
+static int simple(uint8_t cmd) {
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, cmd, 0xF7};
+    return test_command(sysex, sizeof(sysex));
+}
+
+// スイッチの押下/解放を CC number（値 value、チャンネル1）1つにする
+static int set_cc(uint8_t switch_idx, uint8_t event_type, uint8_t number, uint8_t value) {
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, CMD_SET_MESSAGE, switch_idx, event_type, 1,
+                       0x01, 0x00, number, value, 0xF7};
+    return test_command(sysex, sizeof(sysex));
+}
+
+// GET_MESSAGEで読んだ最初のメッセージのCC番号（読めなければ-1）
+static int get_cc(uint8_t switch_idx, uint8_t event_type) {
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, CMD_GET_MESSAGE, switch_idx, event_type, 0xF7};
+    uint8_t response[64];
+    size_t n = test_request(sysex, sizeof(sysex), response, sizeof(response));
+    if (n < 13 || response[4] != CMD_GET_MESSAGE || response[7] == 0) return -1;
+    return response[10];
+}
+
+// GET_DEBOUNCEに応答があるか（スイッチ数の外は応答しない）
+static bool has_debounce(uint8_t switch_idx) {
+    uint8_t sysex[] = {0xF0, 0x00, 0x7D, 0x01, CMD_GET_DEBOUNCE, switch_idx, 0xF7};
+    uint8_t response[64];
+    size_t n = test_request(sysex, sizeof(sysex), response, sizeof(response));
+    return n > 5 && response[4] == CMD_GET_DEBOUNCE;
+}
+
+// スイッチを押して離し、届いたCCの番号を順に集める
+static size_t press(uint8_t switch_idx, uint8_t* numbers, size_t max) {
+    sim_clear_packets();
+    sim_set_switch(switch_idx, true);
+    sim_run_until(sim_now_us() + 60000);
+    sim_set_switch(switch_idx, false);
+    sim_run_until(sim_now_us() + 60000);
+
+    size_t n = 0;
+    for (size_t i = 0; i < sim_packet_count() && n < max; i++) {
+        const sim_packet_t* packet = sim_packet_at(i);
+        if (packet->kind == SIM_PACKET_MIDI && (packet->data[0] & 0x0F) == 0x0B) {
+            numbers[n++] = packet->data[2];
+        }
+    }
+    return n;
+}
+
+// トランザクション中は古い設定で送り、COMMITで押下と解放が一緒に変わる
+static void test_commit(void) {
+    boot(true, false);
+    CHECK(simple(CMD_BEGIN) == 0);
+    uint32_t erases = flash_sim_stats()->erases;
+    CHECK(set_cc(3, 0, 40, 127) == 0);
+    CHECK(set_cc(3, 1, 41, 0) == 0);
+    uint8_t pixel[] = {0xF0, 0x00, 0x7D, 0x01, CMD_SET_PIXEL_COLOR, 0x00, 10, 20, 30, 0xF7};
+    CHECK(test_command(pixel, sizeof(pixel)) == 0);
+
+    // SET系では書き込まず、GET系は作業領域を読む
+    CHECK(flash_sim_stats()->erases == erases);
+    CHECK(get_cc(3, 0) == 40);
+    CHECK(get_cc(3, 1) == 41);
+
+    // 押下は確定した設定（デフォルト: スイッチsはCC s）のまま
+    uint8_t numbers[8];
+    size_t n = press(3, numbers, 8);
+    CHECK(n == 2 && numbers[0] == 3 && numbers[1] == 3);
+
+    CHECK(simple(CMD_COMMIT) == 0);
+    CHECK(flash_sim_stats()->erases == erases + 1);
+    n = press(3, numbers, 8);
+    CHECK(n == 2 && numbers[0] == 40 && numbers[1] == 41);
+
+    // 再起動後も残る
+    boot(false, false);
+    CHECK(get_cc(3, 0) == 40);
+    CHECK(get_cc(3, 1) == 41);
+
+    // 閉じた後のCOMMIT/ROLLBACKはエラー
+    CHECK(simple(CMD_COMMIT) == 1);
+    CHECK(simple(CMD_ROLLBACK) == 1);
+
+    // 何も変えないCOMMITは書き込まない
+    erases = flash_sim_stats()->erases;
+    CHECK(simple(CMD_BEGIN) == 0);
+    CHECK(set_cc(3, 0, 40, 127) == 0);
+    CHECK(simple(CMD_COMMIT) == 0);
+    CHECK(flash_sim_stats()->erases == erases);
+}
+
+// ROLLBACKと切断は作業領域を捨てる
+static void test_rollback(void) {
+    boot(true, false);
+    uint32_t erases = flash_sim_stats()->erases;
+    CHECK(simple(CMD_BEGIN) == 0);
+    CHECK(set_cc(5, 0, 50, 127) == 0);
+    CHECK(get_cc(5, 0) == 50);
+    CHECK(simple(CMD_ROLLBACK) == 0);
+    CHECK(get_cc(5, 0) == 5);
+    CHECK(simple(CMD_COMMIT) == 1);
+
+    CHECK(simple(CMD_BEGIN) == 0);
+    CHECK(set_cc(5, 0, 50, 127) == 0);
+    sim_set_mounted(false);
+    sim_run_until(sim_now_us() + 10000);
+    sim_set_mounted(true);
+    sim_run_until(sim_now_us() + 10000);
+    CHECK(simple(CMD_COMMIT) == 1);
+    CHECK(get_cc(5, 0) == 5);
+
+    // BEGINをやり直すと前の変更は捨てる
+    CHECK(simple(CMD_BEGIN) == 0);
+    CHECK(set_cc(5, 0, 50, 127) == 0);
+    CHECK(simple(CMD_BEGIN) == 0);
+    CHECK(get_cc(5, 0) == 5);
+    CHECK(simple(CMD_ROLLBACK) == 0);
+    CHECK(flash_sim_stats()->erases == erases);
+
+    // GET_DEBOUNCEも他のGET系と同じく作業領域のスイッチ数を使う
+    uint8_t pins[] = {0xF0, 0x00, 0x7D, 0x01, CMD_SET_PIN_MAP, 2, 2, 3, 0xF7};
+    CHECK(simple(CMD_BEGIN) == 0);
+    CHECK(test_command(pins, sizeof(pins)) == 0);
+    CHECK(has_debounce(1) && !has_debounce(5));
+    CHECK(simple(CMD_ROLLBACK) == 0);
+    CHECK(has_debounce(5));
+
+    uint8_t bad[] = {0xF0, 0x00, 0x7D, 0x01, CMD_BEGIN, 0x00, 0xF7};
+    CHECK(test_command(bad, sizeof(bad)) == 1);
+}
+
+// 16スイッチの押下・解放を書き換える時間（最初のSETから最後の応答まで）
+static uint64_t rewrite_all(bool transaction, uint8_t base, uint32_t* erases) {
+    uint32_t before = flash_sim_stats()->erases;
+    uint64_t start = sim_now_us();
+    if (transaction) CHECK(simple(CMD_BEGIN) == 0);
+    for (uint8_t s = 0; s < NUM_SWITCHES; s++) {
+        CHECK(set_cc(s, 0, base + s, 127) == 0);
+        CHECK(set_cc(s, 1, base + s, 0) == 0);
+    }
+    if (transaction) CHECK(simple(CMD_COMMIT) == 0);
+    *erases = flash_sim_stats()->erases - before;
+    return sim_now_us() - start;
+}
+
+static void test_update_time(void) {
+    boot(true, true);
+    uint32_t erases_single;
+    uint64_t single_us = rewrite_all(false, 20, &erases_single);
+    uint32_t erases_transaction;
+    uint64_t transaction_us = rewrite_all(true, 60, &erases_transaction);
+
+    CHECK(erases_single == 2 * NUM_SWITCHES);
+    CHECK(erases_transaction == 1);
+    CHECK(transaction_us * 4 < single_us);
+
+    uint8_t numbers[8];
+    size_t n = press(15, numbers, 8);
+    CHECK(n == 2 && numbers[0] == 75 && numbers[1] == 75);
+
+    printf("{\"switches\": %u, \"per_set_us\": %llu, \"per_set_erases\": %u, "
+           "\"transaction_us\": %llu, \"transaction_erases\": %u}\n",
+           NUM_SWITCHES, (unsigned long long)single_us, erases_single,
+           (unsigned long long)transaction_us, erases_transaction);
+}
+
+int main(void) {
+    sim_set_packet_logging(true);
+
+    test_commit();
+    test_rollback();
+    test_update_time();
+
+    return test_result();
+}
@@ -0,0 +1,144 @@
+#include "led.h"
+
+#include <stddef.h>
+
+#include "bsp/board.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+#ifdef PICO_DEFAULT_LED_PIN
+#include "hardware/gpio.h"
+#include "hardware/pwm.h"
+#endif
+
+#define LED_TICK_MS 10                // パターン再生中のタイマー周期
+#define LED_PWM_WRAP (255 * 255)      // 明るさを2乗してガンマ補正する
+
+typedef struct {
+    uint8_t level;      // 目標の明るさ（0-255）
+    uint16_t fade_ms;   // 目標までのフェード時間（0で即時）
+    uint16_t hold_ms;   // 到達後の保持時間
+} led_step_t;
+
+typedef struct {
+    const led_step_t* steps;
+    uint8_t count;
+} led_pattern_t;
+
+// 送受信時：125ms周期で3回点滅（従来の点滅と同じ見た目）
+static const led_step_t activity_steps[] = {
+    {255, 0, 125}, {0, 0, 125},
+    {255, 0, 125}, {0, 0, 125},
+    {255, 0, 125}, {0, 0, 125},
+};
+
+// エラー時：短く速い点滅のあとフェードアウト
+static const led_step_t error_steps[] = {
+    {255, 0, 40}, {0, 0, 40},
+    {255, 0, 40}, {0, 0, 40},
+    {255, 0, 40}, {0, 0, 40},
+    {255, 0, 40}, {0, 300, 200},
+};
+
+static const led_pattern_t activity_pattern = {activity_steps, sizeof(activity_steps) / sizeof(activity_steps[0])};
+static const led_pattern_t error_pattern = {error_steps, sizeof(error_steps) / sizeof(error_steps[0])};
+
+static uint8_t led_base_level = 0;
+static uint8_t led_level = 0;           // 現在の明るさ（ガンマ補正前）
+
+// 再生中のパターン（タイマー割り込みと共有）
+static const led_pattern_t* volatile led_pattern = NULL;
+static uint8_t led_step = 0;
+static uint32_t led_step_elapsed = 0;
+static uint8_t led_from_level = 0;
+static volatile bool led_timer_active = false;
+static repeating_timer_t led_timer;
+
+#ifdef PICO_DEFAULT_LED_PIN
+static uint led_slice;
+#endif
+
+static void led_write(uint8_t level) {
+    led_level = level;
+#ifdef PICO_DEFAULT_LED_PIN
+    pwm_set_gpio_level(PICO_DEFAULT_LED_PIN, (uint16_t)((uint32_t)level * level));
+#else
+    // PWM出力できないLED（Pico Wなど）はオン/オフのみ
+    board_led_write(level > 0);
+#endif
+}
+
+static bool led_timer_cb(repeating_timer_t* rt) {
+    (void) rt;
+    const led_pattern_t* pattern = led_pattern;
+    
+    if (pattern == NULL || led_step >= pattern->count) {
+        led_pattern = NULL;
+        led_write(led_base_level);
+        led_timer_active = false;
+        return false;  // タイマー停止：以降CPUを使わない
+    }
+    
+    const led_step_t* step = &pattern->steps[led_step];
+    led_step_elapsed += LED_TICK_MS;
+    
+    if (led_step_elapsed < step->fade_ms) {
+        int32_t diff = (int32_t)step->level - led_from_level;
+        led_write((uint8_t)(led_from_level + diff * (int32_t)led_step_elapsed / step->fade_ms));
+    } else {
+        if (led_level != step->level) {
+            led_write(step->level);
+        }
+        if (led_step_elapsed >= (uint32_t)step->fade_ms + step->hold_ms) {
+            led_from_level = step->level;
+            led_step_elapsed = 0;
+            led_step++;
+        }
+    }
+    return true;
+}
+
+static void led_play(const led_pattern_t* pattern) {
+    uint32_t interrupts = save_and_disable_interrupts();
+    led_pattern = pattern;
+    led_step = 0;
+    led_step_elapsed = 0;
+    led_from_level = led_level;
+    bool start = !led_timer_active;
+    led_timer_active = true;
+    restore_interrupts(interrupts);
+    
+    if (start) {
+        // 最初のステップは即時反映し、以降はタイマーで進める
+        if (pattern->steps[0].fade_ms == 0) {
+            led_write(pattern->steps[0].level);
+        }
+        add_repeating_timer_ms(-LED_TICK_MS, led_timer_cb, NULL, &led_timer);
+    }
+}
+
+void led_init(void) {
+#ifdef PICO_DEFAULT_LED_PIN
+    gpio_set_function(PICO_DEFAULT_LED_PIN, GPIO_FUNC_PWM);
+    led_slice = pwm_gpio_to_slice_num(PICO_DEFAULT_LED_PIN);
+    
+    pwm_config config = pwm_get_default_config();
+    pwm_config_set_wrap(&config, LED_PWM_WRAP);
+    pwm_init(led_slice, &config, true);
+#endif
+    led_write(0);
+}
+
+void led_set_base(uint8_t level) {
+    led_base_level = level;
+    if (!led_timer_active) {
+        led_write(level);
+    }
+}
+
+void led_activity(void) {
+    led_play(&activity_pattern);
+}
+
+void led_error(void) {
+    led_play(&error_pattern);
+}
@@ -0,0 +1,22 @@
+#ifndef LED_H
+#define LED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// PWMで駆動するステータスLED
+// 定常状態ではPWMのデューティを保持するだけでCPUを使わない。
+// パターン再生中のみタイマー割り込みでフェード/点滅を進める。
+
+void led_init(void);
+
+// パターン再生していないときの明るさ（0-255）。USB接続状態の表示に使う
+void led_set_base(uint8_t level);
+
+// MIDI/HID送受信時の短い点滅
+void led_activity(void);
+
+// 送信キュー溢れなどのエラー表示
+void led_error(void);
+
+#endif // LED_H
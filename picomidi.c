@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -8,39 +9,83 @@
 #include "hardware/flash.h" 
 #include "pico/flash.h"
 #include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "switch_pins.h"
+#include "usb_descriptors.h"
+#include "led.h"
+#include "ws2812.h"
+#ifdef PICOMIDI_STRESS
+#include "stress.h"
+#endif
+#ifdef PICOMIDI_DEFAULT_CONFIG
+#include "default_config.h"
+#endif
 
 // === 設定定数 ===
 #define MAX_SWITCHES 16              // 最大スイッチ数（GPIOの数に応じて調整可能）
 #define MAX_MESSAGES_PER_EVENT 10    // 各イベントあたりの最大メッセージ数
 
-// === メモリ使用量の計算 ===
+// === メモリ使用量の計算（device_config_t） ===
 // 各MIDIメッセージ: 4バイト (msg_type, channel, param1, param2)
 // 各イベント: 1バイト (message_count) + 10 * 4バイト (messages) = 41バイト
-// 各スイッチ: 2イベント * 41バイト = 82バイト
-// 16スイッチの場合: 16 * 82 = 1,312バイト
+// 16スイッチ * 2イベント: 1,312バイト
 // ヘッダ/フッタ: magic(4) + num_switches(1) + checksum(4) = 9バイト
-// 合計: 1,321バイト（RP2040のRAM 264KB、Flash 2MBに対して十分小さい）
+// WS2812の状態別カラー: 6状態 * 3バイト = 18バイト
+// ホストフィードバック: channel(1) + 32 * 4バイト = 129バイト
+// ピン割り当て: 16バイト
+// 世代: 4バイト、学習したデバウンス時間: 16バイト
+// 排他グループ: 8 * 2バイト = 16バイト
+// 合計: パディングを含めて1,520バイト（ファームウェアとホストビルドで同じ配置）。
+// 配置とtools/default_config.pyとの一致、1スロット（1セクタ）に収まることはdevice_config_tの定義の後で_Static_assertで確かめる
 
-// ピン番号の配列はswitch_pins.hで定義（CMakeで生成）
+// ピン番号の配列はswitch_pins.hで定義（CMakeで生成）。設定のピン割り当ての初期値になる
 
-#define DEBOUNCE_TIME_MS 20
+#define DEBOUNCE_TIME_MS 20          // 学習するまでの受け付け窓
+
+// スイッチ毎にチャタリングの長さをヒストグラムに集め、受け付け窓をそのp99 + 余裕に合わせる
+#define DEBOUNCE_MIN_MS 3
+#define DEBOUNCE_MAX_MS 31
+#define DEBOUNCE_MARGIN_MS 2
+#define DEBOUNCE_BUCKETS 32           // 1ms毎（最後のバケットは31ms以上）
+#define DEBOUNCE_HISTORY 127          // 標本数がこれに達したら全体を半分にする（古い標本ほど重みが小さい）
+#define DEBOUNCE_MIN_SAMPLES 32       // これだけ集まるまでは窓を変えない
+#define DEBOUNCE_SAVE_INTERVAL_MS (10 * 60 * 1000)  // 学習した窓を保存する間隔の下限
+#define DEBOUNCE_SAVE_IDLE_MS 5000    // 最後の操作からこれだけ経ってから保存する（書き込み中は割り込みが止まる）
+#define DEBOUNCE_SAVE_DELTA_MS 2      // 保存済みの窓とこれ以上違えば保存する
 #define MIDI_CABLE_NUM 0
 #define SYSEX_BUFFER_SIZE 64
+#define SYSEX_RESPONSE_SIZE (9 + MAX_MESSAGES_PER_EVENT * 4)  // 最大の応答（GET_MESSAGE）
 #define SYSEX_MIN_LENGTH 11
+#define MIDI_RX_PACKETS_PER_LOOP 16  // 1ループで処理する受信パケット数の上限
+
+#define MAX_FEEDBACK_MAPS 32         // ホストフィードバックの割り当て数
+#define MAX_EXCLUSIVE_GROUPS 8       // 排他グループ（ラジオボタン）の数
+#define FEEDBACK_CHANNEL_NONE 0x7F   // フィードバック無効
 
 #define FLASH_TARGET_OFFSET (256 * 1024)
+// 設定はA/Bの2セクタに交互に書き込み、読み込んだ方は消さない（書き込み中に電源が切れてももう一方が残る）
+#define CONFIG_SLOT_COUNT 2
+#define CONFIG_SLOT_OFFSET(slot) (FLASH_TARGET_OFFSET + (slot) * FLASH_SECTOR_SIZE)
+#define CONFIG_SAVE_TIMEOUT_MS 1000  // USBが列挙されない場合（電源のみ）に初期設定を書き込むまでの時間
 
-// LED control constants
-#define LED_PIN PICO_DEFAULT_LED_PIN  // GPIO25
-#define LED_BLINK_PERIOD_MS 250       // 点滅周期（0.5秒）
-#define LED_BLINK_COUNT 3             // 点滅回数
+// スイッチに割り当てられないGPIO
+// GP0/GP1: デバッグ用UART、GP23/GP24/GP29: Pico基板内部（電源制御・VBUS検出・VSYS測定）
+// 実行時にはさらにボードのLEDとWS2812のピンを除く（reserved_pin_mask()）
+#define RESERVED_PIN_MASK ((1u << 0) | (1u << 1) | (1u << 23) | (1u << 24) | (1u << 29))
+#define NUM_GPIO_PINS 30
+
+// 送信イベントキュー（MIDIとHIDで共用）
+#define EVENT_QUEUE_SIZE 32           // 2の累乗であること
+#define HID_KEYBOARD_REPORT_SIZE 8    // modifier, reserved, keycode[6]
+#define HID_CONSUMER_REPORT_SIZE 2    // 16bit usage (little endian)
 
 typedef enum {
     MIDI_MSG_NONE = 0,
     MIDI_MSG_CC = 1,
     MIDI_MSG_PC = 2,
-    MIDI_MSG_NOTE = 3
+    MIDI_MSG_NOTE = 3,
+    MIDI_MSG_HID_KEY = 4,       // channel=modifier(Ctrl/Shift/Alt/GUI), param1=keycode, param2>0で押下/0で解放
+    MIDI_MSG_HID_CONSUMER = 5   // usage = param2 << 7 | param1, usage 0で解放
 } midi_msg_type_t;
 
 typedef enum {
@@ -51,20 +96,95 @@ typedef enum {
 typedef enum {
     SYSEX_CMD_GET_INFO = 0x01,      // スイッチ数やバージョンを返す
     SYSEX_CMD_GET_MESSAGE = 0x02,   // 特定のスイッチの設定を取得
-    SYSEX_CMD_SET_MESSAGE = 0x03    // 特定のスイッチの設定をセット
+    SYSEX_CMD_SET_MESSAGE = 0x03,   // 特定のスイッチの設定をセット
+    SYSEX_CMD_GET_PIXEL_COLORS = 0x04, // WS2812の状態別カラーを取得
+    SYSEX_CMD_SET_PIXEL_COLOR = 0x05,  // WS2812の状態別カラーをセット
+    SYSEX_CMD_GET_FEEDBACK_MAP = 0x06, // ホストフィードバックの割り当てを取得
+    SYSEX_CMD_SET_FEEDBACK_MAP = 0x07, // ホストフィードバックの割り当てをセット
+    SYSEX_CMD_SET_FEEDBACK_CHANNEL = 0x08, // ホストフィードバックの受信チャンネルをセット
+    SYSEX_CMD_GET_PIN_MAP = 0x09,   // スイッチのピン割り当てを取得
+    SYSEX_CMD_SET_PIN_MAP = 0x0A,   // スイッチのピン割り当てをセット
+    SYSEX_CMD_GET_BOOT_TIMES = 0x0B, // 起動の各段階の時刻を取得
+    SYSEX_CMD_GET_DEBOUNCE = 0x0C,  // スイッチの受け付け窓とチャタリングのヒストグラムを取得
+    SYSEX_CMD_GET_FLIGHT_RECORD = 0x0D, // フライトレコーダの記録を取得
+    SYSEX_CMD_SET_FLIGHT_RECORDER = 0x0E, // フライトレコーダの再開/停止
+    SYSEX_CMD_BEGIN_TRANSACTION = 0x0F,   // 以後のSET系を作業領域にためる
+    SYSEX_CMD_COMMIT_TRANSACTION = 0x10,  // ためた変更を検証して1回で反映・保存する
+    SYSEX_CMD_ROLLBACK_TRANSACTION = 0x11, // ためた変更を捨てる
+    SYSEX_CMD_GET_EXCLUSIVE_GROUPS = 0x12, // 排他グループのメンバー（ビットマスク）を返す
+    SYSEX_CMD_SET_EXCLUSIVE_GROUP = 0x13   // 排他グループのメンバーを設定
 } sysex_command_t;
 
+// 起動の段階（GET_BOOT_TIMESで時刻を返す順）
+typedef enum {
+    BOOT_PHASE_START = 0,       // picomidi_init開始
+    BOOT_PHASE_USB_INIT,        // tusb_init完了（ホストから接続が見える）
+    BOOT_PHASE_CONFIG_LOADED,   // 設定の検証・読み込み完了
+    BOOT_PHASE_READY,           // スキャン表・送信パケットの準備完了
+    BOOT_PHASE_MOUNTED,         // USBの列挙完了
+    BOOT_PHASE_CONFIG_SAVED,    // 初期設定の書き込み完了（書き込みが不要なら未到達のまま）
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+#define BOOT_TIME_NONE 0x0FFFFFFF  // 未到達（7bit×4で送れる最大値）
+
+#ifdef PICOMIDI_FLIGHT_RECORDER
+// フライトレコーダ: デバウンス前のピンの変化（µs）、受け付けた変化、送信したパケットをRAMのリングバッファに記録する。
+// 異常（解放の直後の再押下、送信キュー溢れ）を見つけたら、その後しばらく記録して止める（ホストが読み出すまで残す）
+#define FLIGHT_ENTRIES 256            // 2の累乗であること（8バイト × 256 = 2KB）
+#define FLIGHT_POST_TRIGGER 64        // 異常の後に記録する件数の上限（異常の前の記録を上書きしすぎない）
+#define FLIGHT_POST_TRIGGER_US 50000  // 異常の後に記録する時間（続くチャタリングとパケット）
+#define FLIGHT_RETRIGGER_MS 40        // 解放からこれより短い間の押下は二重押下とみなす
+#define FLIGHT_ENTRIES_PER_RESPONSE 4
+#define FLIGHT_INDEX_NONE 0x3FFF      // 異常の位置がない（7bit×2で送れる最大値）
+
+typedef enum {
+    FLIGHT_RAW = 0,      // デバウンス前のレベル（id: スイッチ、value: 押下1/解放0）
+    FLIGHT_ACCEPT = 1,   // 受け付けた変化（id: スイッチ、value: 受け付け窓ms << 1 | 押下）
+    FLIGHT_PACKET = 2,   // 送信したパケット（id: イベント、value: イベント内の番号）
+    FLIGHT_DROP = 3      // 送信キュー溢れで捨てたイベント（id: イベント）
+} flight_entry_type_t;
+
+typedef enum {
+    FLIGHT_REASON_NONE = 0,
+    FLIGHT_REASON_RETRIGGER = 1,    // 解放の直後の再押下
+    FLIGHT_REASON_QUEUE_FULL = 2,   // 送信キュー溢れ
+    FLIGHT_REASON_HOST = 3          // ホストが止めた
+} flight_reason_t;
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t type;        // flight_entry_type_t
+    uint8_t id;
+    uint8_t value;
+} flight_entry_t;
+#endif
+
+// スイッチ毎のWS2812 LEDの表示状態（カラーは設定で変更可能）
+typedef enum {
+    PIXEL_STATE_IDLE = 0,       // 解放中
+    PIXEL_STATE_PRESSED,        // 押下中
+    PIXEL_STATE_HOST_1,         // ホストからのフィードバック表示
+    PIXEL_STATE_HOST_2,
+    PIXEL_STATE_HOST_3,
+    PIXEL_STATE_HOST_4,
+    PIXEL_STATE_COUNT
+} pixel_state_t;
+
+// フラッシュに保存する設定の一部なので、msg_typeはenumの大きさ（ABI依存）によらない1バイトにする
 typedef struct {
-    midi_msg_type_t msg_type;
+    uint8_t msg_type;    // midi_msg_type_t
     uint8_t channel;
     uint8_t param1;
     uint8_t param2;
 } midi_config_t;
 
-// 各スイッチの状態管理
+// 各スイッチの状態管理（押下状態は switch_pressed_mask のビット）
 typedef struct {
-    bool state;
-    uint32_t debounce_time;
+    uint32_t debounce_time;     // 最後に受け付けた変化の時刻
+    uint32_t bounce_ms;         // その変化の後、受け付けた状態に最後に戻るまでの時間（チャタリングの長さ）
+    uint8_t debounce_ms;        // 受け付け窓
+    bool has_edge;              // 起動後に受け付けた変化がある（debounce_timeが有効）
 } switch_state_t;
 
 // イベント設定（複数メッセージ対応）
@@ -73,15 +193,99 @@ typedef struct {
     midi_config_t messages[MAX_MESSAGES_PER_EVENT]; // メッセージ配列
 } event_config_t;
 
+// ホストからのCC/Noteを、スイッチのLED表示状態に割り当てる
+// 値が0以外ならstateを点灯、0（Note Offを含む）なら消灯
+typedef struct {
+    uint8_t msg_type;    // MIDI_MSG_CC or MIDI_MSG_NOTE（MIDI_MSG_NONEは未使用）
+    uint8_t number;      // CC番号/ノート番号
+    uint8_t switch_num;
+    uint8_t state;       // PIXEL_STATE_HOST_1〜PIXEL_STATE_HOST_4
+} feedback_map_t;
+
 // デバイス全体の設定
 typedef struct {
     uint32_t magic;
     uint8_t num_switches;                    // 実際のスイッチ数
     event_config_t events[MAX_SWITCHES * 2]; // [switch_idx * 2 + event_type]
+    uint8_t pixel_colors[PIXEL_STATE_COUNT][3]; // 状態毎のRGB（各0-127）
+    uint8_t feedback_channel;                // フィードバック受信チャンネル（0x7Fで無効）
+    feedback_map_t feedback_maps[MAX_FEEDBACK_MAPS];
+    uint8_t pin_map[MAX_SWITCHES];           // スイッチ毎のGPIO番号（num_switches個）
+    uint32_t generation;                     // 保存毎に増える世代（新しい方のスロットを選ぶ）
+    uint8_t debounce_ms[MAX_SWITCHES];       // スイッチ毎に学習した受け付け窓（0: 未学習）
+    uint16_t exclusive_groups[MAX_EXCLUSIVE_GROUPS]; // グループ毎のメンバー（bit i: スイッチi、0: 未使用）
     uint32_t checksum;
 } device_config_t;
 
-#define CONFIG_MAGIC 0x4D494449
+#define CONFIG_MAGIC 0x4D494437
+
+_Static_assert(sizeof(device_config_t) <= FLASH_SECTOR_SIZE, "device_config_t must fit in one flash slot");
+// tools/default_config.py の config_image() と同じ配置（ビルド時の初期設定のchecksumはこの配置で計算される）
+_Static_assert(sizeof(midi_config_t) == 4 && sizeof(event_config_t) == 41 &&
+               offsetof(device_config_t, checksum) == 1516, "device_config_t layout differs from tools/default_config.py");
+
+// フラッシュ上の設定の大きさ（ページ単位に切り上げ）
+#define CONFIG_FLASH_SIZE ((sizeof(device_config_t) + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1))
+
+// 過去のレイアウト。項目は常に末尾（checksumの直前）に追加しているので、
+// 旧レイアウトは現在の設定の先頭lengthバイトと同じ配置で、その直後にchecksumがある
+typedef struct {
+    uint32_t magic;
+    size_t length;
+} legacy_layout_t;
+
+static const legacy_layout_t legacy_layouts[] = {
+    {0x4D494449, offsetof(device_config_t, pixel_colors)},      // イベント設定のみ
+    {0x4D494432, offsetof(device_config_t, feedback_channel)},  // + WS2812カラー
+    {0x4D494433, offsetof(device_config_t, pin_map)},           // + ホストフィードバック
+    {0x4D494434, offsetof(device_config_t, generation)},        // + ピン割り当て
+    {0x4D494435, offsetof(device_config_t, debounce_ms)},       // + 世代（A/Bスロット）
+    {0x4D494436, offsetof(device_config_t, exclusive_groups)},  // + 学習した受け付け窓
+};
+
+static const uint8_t default_pixel_colors[PIXEL_STATE_COUNT][3] = {
+    {0, 0, 4},      // IDLE: 暗い青
+    {0, 127, 0},    // PRESSED: 緑
+    {127, 0, 0},    // HOST_1: 赤
+    {0, 127, 0},    // HOST_2: 緑
+    {127, 80, 0},   // HOST_3: 黄
+    {0, 40, 127},   // HOST_4: 青
+};
+
+#ifdef PICOMIDI_DEFAULT_CONFIG
+// JSONプロファイルから生成した初期設定（default_config.cmake）。検証とchecksumの計算は生成時に済んでいて、
+// フラッシュ（.rodata）に置かれるので、設定セクタが空でも書き込まずにそのまま使える
+static const device_config_t default_config = {
+    .magic = CONFIG_MAGIC,
+    .num_switches = DEFAULT_CONFIG_NUM_SWITCHES,
+    .events = DEFAULT_CONFIG_EVENTS,
+    .pixel_colors = DEFAULT_CONFIG_PIXEL_COLORS,
+    .feedback_channel = DEFAULT_CONFIG_FEEDBACK_CHANNEL,
+    .feedback_maps = DEFAULT_CONFIG_FEEDBACK_MAPS,
+    .pin_map = DEFAULT_CONFIG_PIN_MAP,
+    .exclusive_groups = DEFAULT_CONFIG_EXCLUSIVE_GROUPS,
+    .checksum = DEFAULT_CONFIG_CHECKSUM,
+};
+#endif
+
+// 送信パケットの種別
+typedef enum {
+    OUTPUT_MIDI = 0,
+    OUTPUT_HID = 1
+} output_kind_t;
+
+// 設定ロード時に組み立て済みの送信パケット（USB-MIDIイベントパケット or HIDレポート）
+typedef struct {
+    uint8_t kind;       // output_kind_t
+    uint8_t report_id;  // HIDのみ
+    uint8_t len;
+    uint8_t data[HID_KEYBOARD_REPORT_SIZE];
+} output_packet_t;
+
+typedef struct {
+    uint8_t count;
+    output_packet_t packets[MAX_MESSAGES_PER_EVENT];
+} compiled_event_t;
 
 // SysEx Protocol Constants
 #define SYSEX_START_BYTE 0xF0
@@ -92,47 +296,249 @@ typedef struct {
 #define SYSEX_BASIC_MIN_LENGTH 6
 
 static switch_state_t switch_states[MAX_SWITCHES];
-static device_config_t current_config;
+static uint32_t switch_pressed_mask = 0;    // 受け付けた押下状態（bit i: スイッチi）
+
+// チャタリングの学習
+static uint8_t bounce_histogram[MAX_SWITCHES][DEBOUNCE_BUCKETS];  // 長さ(ms)毎の標本数
+static uint8_t bounce_samples[MAX_SWITCHES];
+static uint32_t bounce_pending_mask = 0;    // 窓の中で受け付けた状態と違うレベルを見ているスイッチ
+static uint32_t last_switch_edge_ms = 0;    // 最後に変化を受け付けた時刻
+static uint32_t debounce_checked_ms = 0;    // 学習した窓の保存を最後に検討した時刻
 
-// LED control variables
-static bool led_blink_active = false;
-static uint32_t led_blink_start_time = 0;
-static uint8_t led_blink_remaining = 0;
-static bool led_blink_state = false;
-static uint32_t led_last_toggle_time = 0;
+// ピン割り当てから組み立てたスキャン表（compile_pin_map）
+static bool scan_build_pins = true;         // ビルド時のピンと同じ（switch_pins.hのスキャン式を使う）
+static uint32_t scan_low_mask = 0;          // ピンが昇順に連続している場合のマスク（0: 連続していない）
+static uint8_t scan_first_pin = 0;          // 連続している場合の先頭ピン
+static uint8_t scan_bit_pos[MAX_SWITCHES];  // スイッチi -> gpio_get_all()のビット位置
 
-// Function prototypes
-void start_led_blink(void);
-void update_led_state(void);
+// 設定はフラッシュ（XIP）上のものを直接読む（設定セクタ、またはビルド時の初期設定）。
+// RAMに置くのは編集中の設定だけで、保存が済むとフラッシュを指し直す
+static const device_config_t* active_config;
+
+// 編集中の設定。フラッシュへの書き込みはページ単位なので、ページ境界まで0xFFで埋めた大きさにする。
+// トランザクション中はその作業領域になる（確定した設定はフラッシュにあるので、ROLLBACKは捨てるだけ）
+static union {
+    device_config_t config;
+    uint8_t bytes[CONFIG_FLASH_SIZE];
+} config_edit;
+
+// トランザクション中か。BEGINで確定した設定をconfig_editに写し、SET系はそこだけを変える（GET系もそこを読む）。
+// COMMITで変わった部分だけを組み立て直し、フラッシュへは1回だけ書く
+static bool transaction_open = false;
+
+static int8_t config_slot = -1;          // 最新の有効な設定があるスロット（-1はなし）
+static uint32_t config_generation = 0;   // そのスロットの世代
+
+// 組み立て済みの送信パケットはイベント毎に2面持ち、送信側は公開中の面だけを読む（RCU）。
+// 組み立ては公開していない面に行い、終わってからポインタを1回の書き込みで差し替えるので、
+// 送信側はロックなしで、組み立て途中のイベントを見ない
+static compiled_event_t compiled_slots[MAX_SWITCHES * 2][2];
+static const compiled_event_t* compiled_events[MAX_SWITCHES * 2];   // 公開中の面
+static uint8_t pixel_host_states[MAX_SWITCHES];   // ホスト指定の表示状態のビットマスク（bit n: 状態n）
+
+// 排他グループ（compile_exclusive_groups）。押下時にANDとORだけで解除するスイッチを決める
+static uint32_t exclusive_others[MAX_SWITCHES];   // スイッチ毎の、同じグループの他のメンバー
+static uint32_t exclusive_members = 0;            // いずれかのグループに属するスイッチ
+static uint32_t exclusive_active_mask = 0;        // 選択中のメンバー
+
+// 受信中のSysEx
+static uint8_t sysex_buffer[SYSEX_BUFFER_SIZE];
+static uint16_t sysex_pos = 0;
+
+// TX FIFOに入りきらなかったSysEx応答の残り（書き終わるまで受信を止める）
+static uint8_t sysex_response[SYSEX_RESPONSE_SIZE];
+static uint8_t sysex_response_pos = 0;
+static uint8_t sysex_response_len = 0;
+
+// 起動の各段階の時刻（リセットからのµs）
+static uint32_t boot_times[BOOT_PHASE_COUNT];
+
+// 初期設定の書き込みを列挙の後に回している
+static bool config_save_pending = false;
+
+// ホストフィードバックの逆引き表 [0: CC, 1: Note][番号] -> feedback_maps のインデックス + 1（0: 割り当てなし）
+static uint8_t feedback_lookup[2][128];
+
+// 送信待ちイベントのリングバッファ（イベントインデックスを格納）
+static uint8_t event_queue[EVENT_QUEUE_SIZE];
+static uint8_t event_queue_head = 0;    // 送信中のイベント
+static uint8_t event_queue_tail = 0;    // 次に追加する位置
+static uint8_t event_packet_pos = 0;    // 先頭イベントの送信済みパケット数
+static const compiled_event_t* event_sending = NULL;  // 先頭イベントを送り始めた時に公開されていた面（送り終わるまで使う）
+static uint32_t event_queue_drops = 0;  // キュー溢れで捨てたイベント数
+static uint32_t events_queued = 0;
+static uint8_t event_queue_high_water = 0;
+
+#ifdef PICOMIDI_FLIGHT_RECORDER
+static flight_entry_t flight_entries[FLIGHT_ENTRIES];
+static uint32_t flight_count = 0;           // これまでに記録した数（上書きした分を含む）
+static uint32_t flight_trigger_pos = 0;     // 異常を見つけた記録の通し番号
+static uint8_t flight_reason = FLIGHT_REASON_NONE;
+static uint8_t flight_post_remaining = 0;   // 止めるまでに記録する残りの件数
+static bool flight_frozen = false;
+static uint32_t flight_raw_mask = 0;        // 最後に記録したデバウンス前の押下状態
+#endif
 
 // Validation functions
 bool validate_midi_config(const midi_config_t* config) {
     return (config->channel <= 15) && 
            (config->param1 <= 127) && 
            (config->param2 <= 127) &&
-           (config->msg_type <= MIDI_MSG_NOTE);
+           (config->msg_type <= MIDI_MSG_HID_CONSUMER);
+}
+
+bool is_debounce_elapsed(uint32_t last_time, uint32_t current_time, uint8_t window_ms) {
+    return (current_time - last_time) >= window_ms;
+}
+
+// 起動の段階に到達した時刻を記録する（最初の1回のみ）
+void boot_mark(boot_phase_t phase) {
+    if (boot_times[phase] != BOOT_TIME_NONE) return;
+    
+    uint32_t now = time_us_32();
+    boot_times[phase] = now < BOOT_TIME_NONE ? now : BOOT_TIME_NONE - 1;
+}
+
+#ifdef PICOMIDI_FLIGHT_RECORDER
+// 異常の後の記録を終えていれば止める
+bool flight_is_frozen(uint32_t now_us) {
+    if (!flight_frozen && flight_post_remaining != 0 &&
+        now_us - flight_entries[flight_trigger_pos & (FLIGHT_ENTRIES - 1)].time_us >= FLIGHT_POST_TRIGGER_US) {
+        flight_frozen = true;
+    }
+    return flight_frozen;
+}
+
+void flight_record(uint8_t type, uint8_t id, uint8_t value) {
+    uint32_t now = time_us_32();
+    if (flight_is_frozen(now)) return;
+    
+    flight_entry_t* entry = &flight_entries[flight_count & (FLIGHT_ENTRIES - 1)];
+    entry->time_us = now;
+    entry->type = type;
+    entry->id = id;
+    entry->value = value;
+    flight_count++;
+    
+    if (flight_reason != FLIGHT_REASON_NONE && --flight_post_remaining == 0) {
+        flight_frozen = true;
+    }
+}
+
+// 異常を見つけた（直前の記録の位置を残す）。最初の異常だけを残し、後の異常で上書きしない
+void flight_trigger(flight_reason_t reason) {
+    if (flight_reason != FLIGHT_REASON_NONE) return;
+    
+    flight_reason = reason;
+    flight_trigger_pos = flight_count - 1;
+    flight_post_remaining = FLIGHT_POST_TRIGGER;
 }
 
-bool is_debounce_elapsed(uint32_t last_time, uint32_t current_time) {
-    return (current_time - last_time) >= DEBOUNCE_TIME_MS;
+// ホストが止める（先に見つけた異常があればその理由を残す）
+void flight_freeze(void) {
+    if (flight_reason == FLIGHT_REASON_NONE) {
+        flight_reason = FLIGHT_REASON_HOST;
+    }
+    flight_frozen = true;
 }
 
+// 記録を消して再開する
+void flight_reset(void) {
+    flight_count = 0;
+    flight_trigger_pos = 0;
+    flight_reason = FLIGHT_REASON_NONE;
+    flight_post_remaining = 0;
+    flight_frozen = false;
+}
 
+// デバウンス前のレベルが前回から変わったスイッチを記録する
+// （check_switches()の最初の比較を抜けた時だけ呼ぶ。抜けない間は受け付けた状態と同じレベルのまま）
+void flight_record_raw(uint32_t pressed) {
+    uint32_t raw_changed = pressed ^ flight_raw_mask;
+    flight_raw_mask = pressed;
+    while (raw_changed != 0) {
+        uint8_t i = __builtin_ctz(raw_changed);
+        raw_changed &= raw_changed - 1;
+        flight_record(FLIGHT_RAW, i, (pressed >> i) & 1u);
+    }
+}
+#else
+#define flight_record(type, id, value) ((void)0)
+#define flight_trigger(reason) ((void)0)
+#endif
+
+// スイッチに割り当てられないピン
+uint32_t reserved_pin_mask(void) {
+    uint32_t mask = RESERVED_PIN_MASK;
+#ifdef PICO_DEFAULT_LED_PIN
+    mask |= 1u << PICO_DEFAULT_LED_PIN;
+#endif
+#ifdef WS2812_PIN
+    mask |= 1u << WS2812_PIN;
+#endif
+    return mask;
+}
+
+// ピン割り当ての検証（1〜MAX_SWITCHES個、有効なGPIO、予約ピン・重複なし）
+bool validate_pin_map(uint8_t count, const uint8_t* pins) {
+    if (count == 0 || count > MAX_SWITCHES) return false;
+    
+    uint32_t used = reserved_pin_mask();
+    for (uint8_t i = 0; i < count; i++) {
+        if (pins[i] >= NUM_GPIO_PINS || (used & (1u << pins[i]))) return false;
+        used |= 1u << pins[i];
+    }
+    return true;
+}
+
+void init_default_pin_map(device_config_t* cfg) {
+    cfg->num_switches = num_switches;
+    memset(cfg->pin_map, 0, sizeof(cfg->pin_map));
+    memcpy(cfg->pin_map, switch_pins, num_switches);
+}
+
+// 設定を編集用にRAMへ写す（すでに編集中ならそのまま）
+device_config_t* edit_config(void) {
+    if (active_config != &config_edit.config) {
+        memset(config_edit.bytes, 0xFF, sizeof(config_edit.bytes));
+        memcpy(&config_edit.config, active_config, sizeof(device_config_t));
+        active_config = &config_edit.config;
+    }
+    return &config_edit.config;
+}
+
+// SysExのGET系と検証が読む設定（トランザクション中は作業領域）
+const device_config_t* config_view(void) {
+    return transaction_open ? &config_edit.config : active_config;
+}
+
+// SysExのSET系の変更先（トランザクション中は作業領域、それ以外は編集中の設定）
+device_config_t* config_target(void) {
+    return transaction_open ? &config_edit.config : edit_config();
+}
+
+// 組み込みの初期設定をRAMに作る
 void init_default_config(void) {
-    current_config.magic = CONFIG_MAGIC;
-    current_config.num_switches = num_switches;
+    device_config_t* cfg = &config_edit.config;
+    memset(config_edit.bytes, 0xFF, sizeof(config_edit.bytes));
+    memset(cfg, 0, sizeof(*cfg));
+    active_config = cfg;
+    
+    cfg->magic = CONFIG_MAGIC;
+    init_default_pin_map(cfg);
     
     // すべてのイベントをクリア
-    memset(current_config.events, 0, sizeof(current_config.events));
+    memset(cfg->events, 0, sizeof(cfg->events));
     
     // デフォルト設定：全ボタンにCC連番を設定
+    // ピン割り当てでスイッチを増やした場合に備えて、最大数まで設定しておく
     uint8_t cc_number = 0;  // CC番号の開始値
     
-    for (uint8_t i = 0; i < num_switches && i < MAX_SWITCHES; i++) {
+    for (uint8_t i = 0; i < MAX_SWITCHES; i++) {
         // Press イベント（CC値127）
         uint8_t press_idx = i * 2 + 0;
-        current_config.events[press_idx].message_count = 1;
-        midi_config_t* press_msg = &current_config.events[press_idx].messages[0];
+        cfg->events[press_idx].message_count = 1;
+        midi_config_t* press_msg = &cfg->events[press_idx].messages[0];
         press_msg->msg_type = MIDI_MSG_CC;
         press_msg->channel = 0;
         press_msg->param1 = cc_number;  // CC番号
@@ -140,8 +546,8 @@ void init_default_config(void) {
         
         // Release イベント（CC値0）
         uint8_t release_idx = i * 2 + 1;
-        current_config.events[release_idx].message_count = 1;
-        midi_config_t* release_msg = &current_config.events[release_idx].messages[0];
+        cfg->events[release_idx].message_count = 1;
+        midi_config_t* release_msg = &cfg->events[release_idx].messages[0];
         release_msg->msg_type = MIDI_MSG_CC;
         release_msg->channel = 0;
         release_msg->param1 = cc_number;  // 同じCC番号
@@ -151,206 +557,649 @@ void init_default_config(void) {
         if (cc_number > 127) cc_number = 0;  // CC番号は0-127の範囲
     }
     
-    current_config.checksum = 0;
+    memcpy(cfg->pixel_colors, default_pixel_colors, sizeof(cfg->pixel_colors));
+    
+    // デフォルトのフィードバック：チャンネル16のCC n でスイッチ n をHOST_1表示
+    memset(cfg->feedback_maps, 0, sizeof(cfg->feedback_maps));
+    cfg->feedback_channel = 15;
+    for (uint8_t i = 0; i < num_switches && i < MAX_SWITCHES; i++) {
+        feedback_map_t* map = &cfg->feedback_maps[i];
+        map->msg_type = MIDI_MSG_CC;
+        map->number = i;
+        map->switch_num = i;
+        map->state = PIXEL_STATE_HOST_1;
+    }
+    
+    cfg->checksum = 0;
 }
 
-uint32_t calculate_checksum(const device_config_t* config) {
+// 多項式0xEDB88320で4bit分シフトしたときの値（起動時の検証を速くするため1bitずつではなく4bitずつ処理する）
+static const uint32_t checksum_nibble_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t calculate_checksum_bytes(const uint8_t* data, size_t len) {
     // Simple CRC32-like hash (not full CRC32 to avoid extra dependencies)
     uint32_t hash = 0x12345678;
-    const uint8_t* data = (const uint8_t*)config;
-    size_t len = sizeof(device_config_t) - sizeof(uint32_t);
     
     for (size_t i = 0; i < len; i++) {
         hash = hash ^ data[i];
-        for (int j = 0; j < 8; j++) {
-            if (hash & 1) {
-                hash = (hash >> 1) ^ 0xEDB88320;
-            } else {
-                hash = hash >> 1;
-            }
-        }
+        hash = (hash >> 4) ^ checksum_nibble_table[hash & 0x0F];
+        hash = (hash >> 4) ^ checksum_nibble_table[hash & 0x0F];
     }
     return hash;
 }
 
+uint32_t calculate_checksum(const device_config_t* config) {
+    return calculate_checksum_bytes((const uint8_t*)config, sizeof(device_config_t) - sizeof(uint32_t));
+}
+
+const device_config_t* config_slot_data(uint8_t slot) {
+    return (const device_config_t*)(XIP_BASE + CONFIG_SLOT_OFFSET(slot));
+}
+
+// スロットに有効な設定があるか（マジックとchecksumだけを見る）
+bool config_slot_valid(uint8_t slot) {
+    const device_config_t* slot_config = config_slot_data(slot);
+    return slot_config->magic == CONFIG_MAGIC && slot_config->checksum == calculate_checksum(slot_config);
+}
+
 bool save_config_to_flash(void) {
-    current_config.checksum = calculate_checksum(&current_config);
+    config_save_pending = false;
+    device_config_t* cfg = edit_config();
+    
+    // 最新のスロットには触れず、もう一方に次の世代として書く
+    // （書き込みに失敗した場合も最新のスロットは変わらないので、次もこちらに書く）
+    uint8_t slot = (config_slot == 1) ? 0 : 1;
+    cfg->generation = config_generation + 1;
+    cfg->checksum = calculate_checksum(cfg);
     
     uint32_t interrupts = save_and_disable_interrupts();
     
     // Erase flash sector
-    flash_range_erase(FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_erase(CONFIG_SLOT_OFFSET(slot), FLASH_SECTOR_SIZE);
     
-    // Program config to flash
-    flash_range_program(FLASH_TARGET_OFFSET, (const uint8_t*)&current_config, sizeof(device_config_t));
+    // Program config to flash（末尾はページ境界まで0xFF）
+    flash_range_program(CONFIG_SLOT_OFFSET(slot), config_edit.bytes, sizeof(config_edit.bytes));
     
     restore_interrupts(interrupts);
     
     // Verify written data
-    const device_config_t* flash_config = (const device_config_t*)(XIP_BASE + FLASH_TARGET_OFFSET);
-    if (flash_config->magic != CONFIG_MAGIC) {
+    if (!config_slot_valid(slot)) {
         return false;
     }
     
-    uint32_t expected_checksum = calculate_checksum(flash_config);
-    if (flash_config->checksum != expected_checksum) {
-        return false;
+    // 以後はフラッシュ上の設定を直接読む（書き込みに失敗した場合はRAMのまま）
+    config_slot = slot;
+    config_generation = cfg->generation;
+    active_config = config_slot_data(slot);
+    return true;
+}
+
+// スロットにある旧レイアウトの設定（checksumが合わなければNULL）
+const legacy_layout_t* legacy_slot_layout(uint8_t slot) {
+    const uint8_t* flash_data = (const uint8_t*)config_slot_data(slot);
+    uint32_t magic;
+    memcpy(&magic, flash_data, sizeof(magic));
+    
+    for (size_t i = 0; i < sizeof(legacy_layouts) / sizeof(legacy_layouts[0]); i++) {
+        const legacy_layout_t* layout = &legacy_layouts[i];
+        if (magic != layout->magic) continue;
+        
+        // checksumは4バイト境界に配置されていて、直前のパディングも計算に含まれる
+        size_t checksum_offset = (layout->length + 3) & ~(size_t)3;
+        uint32_t stored_checksum;
+        memcpy(&stored_checksum, flash_data + checksum_offset, sizeof(stored_checksum));
+        return stored_checksum == calculate_checksum_bytes(flash_data, checksum_offset) ? layout : NULL;
+    }
+    return NULL;
+}
+
+// 旧レイアウトの設定を読み込む（既存の項目は引き継ぎ、追加項目はデフォルトのまま）
+// 世代を持たないレイアウトはスロットAの位置だけを使っていた
+bool load_legacy_config_from_flash(void) {
+    const legacy_layout_t* newest = NULL;
+    uint8_t newest_slot = 0;
+    uint32_t newest_generation = 0;
+    
+    for (uint8_t slot = 0; slot < CONFIG_SLOT_COUNT; slot++) {
+        const legacy_layout_t* layout = legacy_slot_layout(slot);
+        if (layout == NULL) continue;
+        
+        uint32_t generation = 0;
+        if (layout->length > offsetof(device_config_t, generation)) {
+            generation = config_slot_data(slot)->generation;
+        }
+        if (newest == NULL || (int32_t)(generation - newest_generation) > 0) {
+            newest = layout;
+            newest_slot = slot;
+            newest_generation = generation;
+        }
+    }
+    if (newest == NULL) return false;
+    
+    // 初期設定（init_default_config）の上に重ねるので、RAMで使い続ける
+    device_config_t* cfg = &config_edit.config;
+    memcpy(cfg, config_slot_data(newest_slot), newest->length);
+    cfg->magic = CONFIG_MAGIC;
+    active_config = cfg;
+    
+    // 次の保存は読み込んだスロットを残してもう一方に書く
+    config_slot = newest_slot;
+    config_generation = newest_generation;
+    
+    // ピン割り当てのないレイアウトや、使えないピンがある場合はビルド時のピンを使う
+    if (newest->length <= offsetof(device_config_t, pin_map) ||
+        !validate_pin_map(cfg->num_switches, cfg->pin_map)) {
+        init_default_pin_map(cfg);
     }
     return true;
 }
 
+// 有効なスロットのうち世代が新しい方を読み込む
 bool load_config_from_flash(void) {
-    const device_config_t* flash_config = (const device_config_t*)(XIP_BASE + FLASH_TARGET_OFFSET);
-    
-    if (flash_config->magic != CONFIG_MAGIC) {
-        return false;
+    int8_t newest = -1;
+    for (uint8_t slot = 0; slot < CONFIG_SLOT_COUNT; slot++) {
+        if (!config_slot_valid(slot)) continue;
+        // 世代は差で比べる（32bitを一周しても順序が保たれる）
+        if (newest < 0 ||
+            (int32_t)(config_slot_data(slot)->generation - config_slot_data(newest)->generation) > 0) {
+            newest = slot;
+        }
+    }
+    if (newest < 0) {
+        return load_legacy_config_from_flash();
     }
     
-    uint32_t expected_checksum = calculate_checksum(flash_config);
-    if (flash_config->checksum != expected_checksum) {
+    const device_config_t* flash_config = config_slot_data(newest);
+    config_slot = newest;
+    config_generation = flash_config->generation;
+    active_config = flash_config;
+    
+    // 別のボード向けのビルドで予約ピンが変わった場合などは、ビルド時のピンに戻す
+    if (!validate_pin_map(flash_config->num_switches, flash_config->pin_map)) {
+        init_default_pin_map(edit_config());
+    }
+    return true;
+}
+
+// フラッシュに有効な設定がないときの初期設定をビルド時のプロファイルから読み込む。
+// checksumが合わなければ（生成スクリプトとレイアウトがずれている）使わない
+bool load_default_config(void) {
+#ifdef PICOMIDI_DEFAULT_CONFIG
+    if (default_config.checksum != calculate_checksum(&default_config)) {
+        printf("Default config does not match this build\n");
         return false;
     }
-    
-    memcpy(&current_config, flash_config, sizeof(device_config_t));
+    active_config = &default_config;
     return true;
+#else
+    return false;
+#endif
 }
 
-void send_midi_message(const midi_config_t* config) {
-    if (!validate_midi_config(config)) {
-        return;
+// ピン割り当てを初期化し、スキャン表を組み立てる（設定ロード時・変更時）
+// ビルド時と同じピンならswitch_pins.hのスキャン式、昇順に連続していればシフト1回、
+// それ以外はスイッチ毎のビット位置の表で押下マスクを作る
+void compile_pin_map(void) {
+    uint8_t count = active_config->num_switches;
+    const uint8_t* pins = active_config->pin_map;
+    
+    scan_build_pins = (count == num_switches) && memcmp(pins, switch_pins, num_switches) == 0;
+    scan_first_pin = pins[0];
+    scan_low_mask = (1u << count) - 1;
+    
+    for (uint8_t i = 0; i < count; i++) {
+        gpio_init(pins[i]);
+        gpio_set_dir(pins[i], GPIO_IN);
+        gpio_pull_up(pins[i]);
+        
+        scan_bit_pos[i] = pins[i];
+        if (pins[i] != scan_first_pin + i) {
+            scan_low_mask = 0;
+        }
     }
     
-    // Do nothing if message type is NONE
-    if (config->msg_type == MIDI_MSG_NONE) {
-        return;
+    // 割り当てが変わったら押下中の状態とチャタリングの標本は引き継がない
+    // （受け付け窓は保存済みの学習値から始める）
+    switch_pressed_mask = 0;
+    bounce_pending_mask = 0;
+#ifdef PICOMIDI_FLIGHT_RECORDER
+    flight_raw_mask = 0;
+#endif
+    memset(switch_states, 0, sizeof(switch_states));
+    memset(bounce_histogram, 0, sizeof(bounce_histogram));
+    memset(bounce_samples, 0, sizeof(bounce_samples));
+    for (uint8_t i = 0; i < MAX_SWITCHES; i++) {
+        uint8_t saved = active_config->debounce_ms[i];
+        switch_states[i].debounce_ms = (saved >= DEBOUNCE_MIN_MS && saved <= DEBOUNCE_MAX_MS) ? saved : DEBOUNCE_TIME_MS;
+    }
+}
+
+// 1メッセージを送信パケットに変換する（NONEの場合はfalse）
+bool compile_message(const midi_config_t* msg, output_packet_t* out) {
+    if (!validate_midi_config(msg)) {
+        return false;
     }
     
-    uint8_t packet[4] = {0};
+    memset(out, 0, sizeof(*out));
     
-    switch (config->msg_type) {
+    switch (msg->msg_type) {
         case MIDI_MSG_CC:
-            packet[0] = MIDI_CABLE_NUM << 4 | 0x0B;
-            packet[1] = 0xB0 | config->channel;
-            packet[2] = config->param1;
-            packet[3] = config->param2;
-            break;
+            out->kind = OUTPUT_MIDI;
+            out->len = 4;
+            out->data[0] = MIDI_CABLE_NUM << 4 | 0x0B;
+            out->data[1] = 0xB0 | msg->channel;
+            out->data[2] = msg->param1;
+            out->data[3] = msg->param2;
+            return true;
             
         case MIDI_MSG_PC:
-            packet[0] = MIDI_CABLE_NUM << 4 | 0x0C;
-            packet[1] = 0xC0 | config->channel;
-            packet[2] = config->param1;
-            packet[3] = 0;
-            break;
+            out->kind = OUTPUT_MIDI;
+            out->len = 4;
+            out->data[0] = MIDI_CABLE_NUM << 4 | 0x0C;
+            out->data[1] = 0xC0 | msg->channel;
+            out->data[2] = msg->param1;
+            out->data[3] = 0;
+            return true;
             
         case MIDI_MSG_NOTE:
-            if (config->param2 > 0) {
-                packet[0] = MIDI_CABLE_NUM << 4 | 0x09; // Note On
-                packet[1] = 0x90 | config->channel;
+            out->kind = OUTPUT_MIDI;
+            out->len = 4;
+            if (msg->param2 > 0) {
+                out->data[0] = MIDI_CABLE_NUM << 4 | 0x09;  // Note On
+                out->data[1] = 0x90 | msg->channel;
             } else {
-                packet[0] = MIDI_CABLE_NUM << 4 | 0x08; // Note Off
-                packet[1] = 0x80 | config->channel;
+                out->data[0] = MIDI_CABLE_NUM << 4 | 0x08;  // Note Off
+                out->data[1] = 0x80 | msg->channel;
             }
-            packet[2] = config->param1;
-            packet[3] = config->param2;
-            break;
+            out->data[2] = msg->param1;
+            out->data[3] = msg->param2;
+            return true;
+            
+        case MIDI_MSG_HID_KEY:
+            out->kind = OUTPUT_HID;
+            out->report_id = REPORT_ID_KEYBOARD;
+            out->len = HID_KEYBOARD_REPORT_SIZE;
+            if (msg->param2 > 0) {
+                out->data[0] = msg->channel;  // 下位4bitはHIDの左Ctrl/Shift/Alt/GUIと同じ並び
+                out->data[2] = msg->param1;
+            }
+            return true;
+            
+        case MIDI_MSG_HID_CONSUMER: {
+            uint16_t usage = (uint16_t)(msg->param2 << 7 | msg->param1);
+            out->kind = OUTPUT_HID;
+            out->report_id = REPORT_ID_CONSUMER_CONTROL;
+            out->len = HID_CONSUMER_REPORT_SIZE;
+            out->data[0] = usage & 0xFF;
+            out->data[1] = usage >> 8;
+            return true;
+        }
             
         default:
-            return;
+            return false;
+    }
+}
+
+// イベントの送信パケット列を公開していない面に組み立ててから公開する
+// （公開前の面を送信中のイベントが使っていないことはmidi_rx_task()が保証する）
+void compile_event(uint8_t event_idx) {
+    const event_config_t* event = &active_config->events[event_idx];
+    compiled_event_t* shadow = &compiled_slots[event_idx][compiled_events[event_idx] == &compiled_slots[event_idx][0]];
+    
+    shadow->count = 0;
+    for (uint8_t i = 0; i < event->message_count && i < MAX_MESSAGES_PER_EVENT; i++) {
+        if (compile_message(&event->messages[i], &shadow->packets[shadow->count])) {
+            shadow->count++;
+        }
     }
     
-    if (tud_midi_mounted()) {
-        tud_midi_stream_write(MIDI_CABLE_NUM, packet, 4);
-        start_led_blink();  // MIDI送信時にLED点滅開始
+    __atomic_store_n(&compiled_events[event_idx], shadow, __ATOMIC_RELEASE);
+}
+
+// 差し替えられた面をまだ送信中（次の組み立てがその面に書くので、送り終わるまで待つ）
+bool compile_grace_pending(void) {
+    return event_sending != NULL &&
+           event_sending != compiled_events[event_queue[event_queue_head & (EVENT_QUEUE_SIZE - 1)]];
+}
+
+void compile_all_events(void) {
+    for (uint8_t i = 0; i < MAX_SWITCHES * 2; i++) {
+        compile_event(i);
     }
 }
 
-void send_midi_messages(const event_config_t* event) {
-    if (!tud_midi_mounted() || !event) return;
+// イベントを送信キューに積む（実際の送信はservice_output_queue）
+void send_midi_messages(uint8_t event_idx) {
+    if (!tud_mounted() || compiled_events[event_idx]->count == 0) return;
     
-    // 設定されているすべてのメッセージを連続送信
-    for (uint8_t i = 0; i < event->message_count; i++) {
-        const midi_config_t* msg = &event->messages[i];
+    if ((uint8_t)(event_queue_tail - event_queue_head) >= EVENT_QUEUE_SIZE) {
+        event_queue_drops++;
+        flight_record(FLIGHT_DROP, event_idx, 0);
+        flight_trigger(FLIGHT_REASON_QUEUE_FULL);
+        led_error();
+        return;
+    }
+    
+    event_queue[event_queue_tail & (EVENT_QUEUE_SIZE - 1)] = event_idx;
+    event_queue_tail++;
+    events_queued++;
+    
+    uint8_t depth = event_queue_tail - event_queue_head;
+    if (depth > event_queue_high_water) event_queue_high_water = depth;
+    
+    led_activity();  // LED点滅開始
+}
+
+// 送信キューの統計（積んだイベント数、溢れて捨てた数、最大の滞留数）
+void get_output_queue_stats(uint32_t* queued, uint32_t* drops, uint8_t* high_water) {
+    *queued = events_queued;
+    *drops = event_queue_drops;
+    *high_water = event_queue_high_water;
+}
+
+// SysEx応答を送る。TX FIFOに入りきらない分は保留し、flush_sysex_response()で続きを書く
+void send_sysex_response(const uint8_t* data, uint8_t length) {
+    if (sysex_response_len != 0) return;  // 保留中は受信を止めているので来ない
+    
+    uint32_t written = tud_midi_stream_write(MIDI_CABLE_NUM, data, length);
+    if (written < length) {
+        memcpy(sysex_response, data + written, length - written);
+        sysex_response_pos = 0;
+        sysex_response_len = length - written;
+    }
+}
+
+// 保留中の応答を書けるだけ書く。書き終わっていればtrue
+bool flush_sysex_response(void) {
+    if (sysex_response_len == 0) return true;
+    
+    sysex_response_pos += tud_midi_stream_write(MIDI_CABLE_NUM,
+                                                &sysex_response[sysex_response_pos],
+                                                sysex_response_len - sysex_response_pos);
+    if (sysex_response_pos < sysex_response_len) return false;
+    
+    sysex_response_pos = sysex_response_len = 0;
+    return true;
+}
+
+// キュー先頭から順にMIDI/HIDエンドポイントへ送信する
+// 送信できない場合はそこで止め、次のループで続きから再開するので順序は保たれる
+void service_output_queue(void) {
+    if (!tud_mounted()) {
+        event_queue_head = event_queue_tail;
+        event_packet_pos = 0;
+        event_sending = NULL;
+        sysex_response_pos = sysex_response_len = 0;
+        return;
+    }
+    
+    // SysEx応答の途中にイベントのパケットを挟まない
+    if (!flush_sysex_response()) return;
+    
+    while (event_queue_head != event_queue_tail) {
+        uint8_t event_idx = event_queue[event_queue_head & (EVENT_QUEUE_SIZE - 1)];
+        if (event_sending == NULL) {
+            event_sending = __atomic_load_n(&compiled_events[event_idx], __ATOMIC_ACQUIRE);
+        }
+        const compiled_event_t* event = event_sending;
         
-        if (msg->msg_type == MIDI_MSG_NONE) continue;
+        while (event_packet_pos < event->count) {
+            const output_packet_t* packet = &event->packets[event_packet_pos];
+            
+            if (packet->kind == OUTPUT_MIDI) {
+                if (!tud_midi_packet_write(packet->data)) return;  // TX FIFO満杯
+            } else {
+                if (!tud_hid_ready()) return;  // 前のレポートが転送中
+                tud_hid_report(packet->report_id, packet->data, packet->len);
+            }
+            flight_record(FLIGHT_PACKET, event_idx, event_packet_pos);
+            event_packet_pos++;
+        }
         
-        uint8_t packet[4] = {0};
+        event_packet_pos = 0;
+        event_sending = NULL;
+        event_queue_head++;
+    }
+}
+
+// スイッチのWS2812表示を更新（押下中・排他グループで選択中 > ホスト指定 > 待機の優先順）
+void update_switch_pixel(uint8_t switch_idx) {
+    uint8_t state = PIXEL_STATE_IDLE;
+    if ((switch_pressed_mask | exclusive_active_mask) & (1u << switch_idx)) {
+        state = PIXEL_STATE_PRESSED;
+    } else if (pixel_host_states[switch_idx] != 0) {
+        // 複数の状態が点灯している場合は番号の大きい方を優先
+        state = 31 - __builtin_clz(pixel_host_states[switch_idx]);
+    }
+    
+    // 設定は7bitなので8bitに伸長する
+    const uint8_t* color = active_config->pixel_colors[state];
+    ws2812_set_pixel(switch_idx,
+                     color[0] << 1 | color[0] >> 6,
+                     color[1] << 1 | color[1] >> 6,
+                     color[2] << 1 | color[2] >> 6);
+}
+
+void update_all_pixels(void) {
+    for (uint8_t i = 0; i < active_config->num_switches; i++) {
+        update_switch_pixel(i);
+    }
+}
+
+// 排他グループから、スイッチ毎に同じグループの他のメンバーのマスクを作る（設定ロード時・変更時）
+// スイッチ数より後ろのビットと、メンバーが1つ以下のグループは使わない。選択状態は引き継がない
+void compile_exclusive_groups(void) {
+    uint32_t switches = (1u << active_config->num_switches) - 1;
+    memset(exclusive_others, 0, sizeof(exclusive_others));
+    exclusive_members = 0;
+    exclusive_active_mask = 0;
+    
+    for (uint8_t g = 0; g < MAX_EXCLUSIVE_GROUPS; g++) {
+        uint32_t group = active_config->exclusive_groups[g] & switches;
+        if (__builtin_popcount(group) < 2) continue;
         
-        switch (msg->msg_type) {
-            case MIDI_MSG_CC:
-                packet[0] = MIDI_CABLE_NUM << 4 | 0x0B;
-                packet[1] = 0xB0 | msg->channel;
-                packet[2] = msg->param1;
-                packet[3] = msg->param2;
-                break;
-                
-            case MIDI_MSG_PC:
-                packet[0] = MIDI_CABLE_NUM << 4 | 0x0C;
-                packet[1] = 0xC0 | msg->channel;
-                packet[2] = msg->param1;
-                packet[3] = 0;
-                break;
-                
-            case MIDI_MSG_NOTE:
-                if (msg->param2 > 0) {
-                    packet[0] = MIDI_CABLE_NUM << 4 | 0x09;  // Note On
-                    packet[1] = 0x90 | msg->channel;
-                } else {
-                    packet[0] = MIDI_CABLE_NUM << 4 | 0x08;  // Note Off
-                    packet[1] = 0x80 | msg->channel;
-                }
-                packet[2] = msg->param1;
-                packet[3] = msg->param2;
-                break;
+        exclusive_members |= group;
+        for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+            uint8_t i = __builtin_ctz(rest);
+            exclusive_others[i] |= group & ~(1u << i);
+        }
+    }
+}
+
+// フィードバック割り当てから逆引き表を作る（設定ロード時・変更時）
+void compile_feedback_lookup(void) {
+    memset(feedback_lookup, 0, sizeof(feedback_lookup));
+    
+    for (uint8_t i = 0; i < MAX_FEEDBACK_MAPS; i++) {
+        const feedback_map_t* map = &active_config->feedback_maps[i];
+        if (map->switch_num >= active_config->num_switches || map->number > 127 ||
+            map->state < PIXEL_STATE_HOST_1 || map->state >= PIXEL_STATE_COUNT) {
+            continue;
+        }
+        if (map->msg_type == MIDI_MSG_CC) {
+            feedback_lookup[0][map->number] = i + 1;
+        } else if (map->msg_type == MIDI_MSG_NOTE) {
+            feedback_lookup[1][map->number] = i + 1;
         }
-        
-        tud_midi_stream_write(MIDI_CABLE_NUM, packet, 4);
     }
     
-    start_led_blink();  // LED点滅開始
+    // 割り当てが変わったら表示中のフィードバックはリセット
+    memset(pixel_host_states, 0, sizeof(pixel_host_states));
+    update_all_pixels();
 }
 
-void start_led_blink(void) {
-    led_blink_active = true;
-    led_blink_remaining = LED_BLINK_COUNT * 2; // ON/OFFで2回カウント
-    led_blink_start_time = board_millis();
-    led_last_toggle_time = led_blink_start_time;
-    led_blink_state = true;
+// ホストからのチャンネルメッセージ（USB-MIDIパケット）をLED表示に反映する。表引き1回のO(1)
+void handle_feedback_packet(const uint8_t packet[4]) {
+    uint8_t cin = packet[0] & 0x0F;
+    if ((packet[1] & 0x0F) != active_config->feedback_channel) return;
+    
+    uint8_t value;
+    uint8_t entry;
+    switch (cin) {
+        case 0x0B:  // Control Change
+            entry = feedback_lookup[0][packet[2] & 0x7F];
+            value = packet[3];
+            break;
+        case 0x09:  // Note On
+            entry = feedback_lookup[1][packet[2] & 0x7F];
+            value = packet[3];
+            break;
+        case 0x08:  // Note Off
+            entry = feedback_lookup[1][packet[2] & 0x7F];
+            value = 0;
+            break;
+        default:
+            return;
+    }
+    if (entry == 0) return;
+    
+    const feedback_map_t* map = &active_config->feedback_maps[entry - 1];
+    uint8_t bits = pixel_host_states[map->switch_num];
+    if (value > 0) {
+        bits |= 1 << map->state;
+    } else {
+        bits &= ~(1 << map->state);
+    }
+    
+    if (bits != pixel_host_states[map->switch_num]) {
+        pixel_host_states[map->switch_num] = bits;
+        update_switch_pixel(map->switch_num);
+    }
 }
 
-void update_led_state(void) {
-    if (led_blink_active) {
-        uint32_t now = board_millis();
-        if (now - led_last_toggle_time >= LED_BLINK_PERIOD_MS / 2) {
-            led_blink_state = !led_blink_state;
-            led_last_toggle_time = now;
-            led_blink_remaining--;
-            
-            if (led_blink_remaining == 0) {
-                led_blink_active = false;
+// チャタリングの長さの標本をヒストグラムに加え、受け付け窓をp99 + 余裕に合わせる（変化を受け付けた時だけ）
+void record_bounce(uint8_t switch_idx, uint32_t bounce_ms) {
+    uint8_t* histogram = bounce_histogram[switch_idx];
+    histogram[bounce_ms < DEBOUNCE_BUCKETS ? bounce_ms : DEBOUNCE_BUCKETS - 1]++;
+    
+    if (++bounce_samples[switch_idx] >= DEBOUNCE_HISTORY) {
+        // 切り上げるので、まれな長いチャタリングも1つは残る
+        uint8_t total = 0;
+        for (uint8_t b = 0; b < DEBOUNCE_BUCKETS; b++) {
+            histogram[b] = (histogram[b] + 1) / 2;
+            total += histogram[b];
+        }
+        bounce_samples[switch_idx] = total;
+    }
+    if (bounce_samples[switch_idx] < DEBOUNCE_MIN_SAMPLES) return;
+    
+    // 長い方から標本数の1%までを除いた最長のバケット
+    uint8_t outliers = bounce_samples[switch_idx] / 100;
+    uint8_t bucket = DEBOUNCE_BUCKETS - 1;
+    while (bucket > 0 && histogram[bucket] <= outliers) {
+        outliers -= histogram[bucket];
+        bucket--;
+    }
+    
+    uint8_t window = bucket + DEBOUNCE_MARGIN_MS;
+    if (window < DEBOUNCE_MIN_MS) window = DEBOUNCE_MIN_MS;
+    if (window > DEBOUNCE_MAX_MS) window = DEBOUNCE_MAX_MS;
+    switch_states[switch_idx].debounce_ms = window;
+}
+
+void handle_switch_change(uint8_t switch_idx, bool pressed, uint32_t now) {
+    switch_state_t* state = &switch_states[switch_idx];
+    if (!is_debounce_elapsed(state->debounce_time, now, state->debounce_ms)) {
+        // 窓の中の逆のレベルはチャタリング。受け付けた状態に戻った時刻をcheck_switches()で記録する
+        bounce_pending_mask |= 1u << switch_idx;
+        return;
+    }
+    
+    // 前の変化のチャタリングの長さを学習する
+    // （窓の終わりまで逆のレベルが続いた場合は本当の変化なので、戻った時刻だけを使う）
+    if (state->has_edge) {
+        record_bounce(switch_idx, state->bounce_ms);
+    }
+    bounce_pending_mask &= ~(1u << switch_idx);
+    
+#ifdef PICOMIDI_FLIGHT_RECORDER
+    flight_record(FLIGHT_ACCEPT, switch_idx, state->debounce_ms << 1 | pressed);
+    if (pressed && state->has_edge && now - state->debounce_time < FLIGHT_RETRIGGER_MS) {
+        flight_trigger(FLIGHT_REASON_RETRIGGER);
+    }
+#endif
+    
+    uint32_t bit = 1u << switch_idx;
+    switch_pressed_mask ^= bit;
+    state->debounce_time = now;
+    state->bounce_ms = 0;
+    state->has_edge = true;
+    last_switch_edge_ms = now;
+    
+    if (exclusive_members & bit) {
+        // 排他グループのメンバーは押下で選択され、解放イベントは選択を解除されたときに送る（離しても何も送らない）。
+        // 解除するメンバーの解放イベントを押下と続けてキューに積むので、同じ送信で（TX FIFOに入りきれば同じUSBフレームで）届く
+        if (pressed) {
+            uint32_t released = exclusive_active_mask & exclusive_others[switch_idx];
+            exclusive_active_mask = (exclusive_active_mask & ~released) | bit;
+            while (released != 0) {
+                uint8_t i = __builtin_ctz(released);
+                released &= released - 1;
+                send_midi_messages(i * 2 + 1);
+                update_switch_pixel(i);
             }
+            send_midi_messages(switch_idx * 2);
         }
-        board_led_write(led_blink_state);
-    } else {
-        // 通常時はUSB接続状態を表示
-        board_led_write(tud_mounted());
+        update_switch_pixel(switch_idx);
+        return;
     }
+    update_switch_pixel(switch_idx);
+    
+    // イベント設定のインデックス計算
+    uint8_t event_idx = switch_idx * 2 + (pressed ? 0 : 1);
+    send_midi_messages(event_idx);
 }
 
+// 全ピンを1回で読み、スキャン表（compile_pin_map）で押下マスクに変換する。
+// 変化がなければ比較1回で終わり、変化したスイッチだけを処理する
 void check_switches(void) {
+    uint32_t levels = gpio_get_all();
+    uint32_t pressed;
+    
+    if (scan_build_pins) {
+        pressed = SWITCH_SCAN_PRESSED(levels);
+    } else if (scan_low_mask != 0) {
+        pressed = (~levels >> scan_first_pin) & scan_low_mask;
+    } else {
+        pressed = 0;
+        for (uint8_t i = 0; i < active_config->num_switches; i++) {
+            pressed |= ((~levels >> scan_bit_pos[i]) & 1u) << i;
+        }
+    }
+    
+    uint32_t changed = pressed ^ switch_pressed_mask;
+    if ((changed | bounce_pending_mask) == 0) return;
+    
+#ifdef PICOMIDI_FLIGHT_RECORDER
+    flight_record_raw(pressed);
+#endif
+    
     uint32_t now = board_millis();
     
-    for (uint8_t i = 0; i < num_switches; i++) {
-        bool pressed = !gpio_get(switch_pins[i]);
-        
-        if (pressed != switch_states[i].state && 
-            is_debounce_elapsed(switch_states[i].debounce_time, now)) {
-            
-            switch_states[i].state = pressed;
-            switch_states[i].debounce_time = now;
-            
-            // イベント設定のインデックス計算
-            uint8_t event_idx = i * 2 + (pressed ? 0 : 1);
-            send_midi_messages(&current_config.events[event_idx]);
+    // 窓の中で受け付けた状態に戻ったスイッチは、そこまでをチャタリングの長さとする
+    uint32_t settled = bounce_pending_mask & ~changed;
+    bounce_pending_mask &= changed;
+    while (settled != 0) {
+        uint8_t i = __builtin_ctz(settled);
+        settled &= settled - 1;
+        switch_states[i].bounce_ms = now - switch_states[i].debounce_time;
+    }
+    if (changed == 0) return;
+    
+    if (scan_build_pins) {
+        // GPIO_PINSから生成した定数インデックスで展開
+#define X(i, pin) \
+        if (changed & (1u << (i))) handle_switch_change((i), (pressed >> (i)) & 1u, now);
+        SWITCH_FOR_EACH(X)
+#undef X
+    } else {
+        while (changed != 0) {
+            uint8_t i = __builtin_ctz(changed);
+            changed &= changed - 1;
+            handle_switch_change(i, (pressed >> i) & 1u, now);
         }
     }
 }
@@ -359,21 +1208,24 @@ void send_info_response(void) {
     uint8_t response[] = {
         SYSEX_START_BYTE, SYSEX_MANUFACTURER_ID_1, SYSEX_MANUFACTURER_ID_2, SYSEX_DEVICE_ID,
         SYSEX_CMD_GET_INFO,
-        num_switches,  // スイッチ数
+        config_view()->num_switches,  // スイッチ数
         0x01,          // バージョン（1.0）
         SYSEX_END_BYTE
     };
-    tud_midi_stream_write(MIDI_CABLE_NUM, response, sizeof(response));
+    send_sysex_response(response, sizeof(response));
 }
 
 void send_message_response(uint8_t switch_num, uint8_t event_type) {
-    if (switch_num >= num_switches || event_type > 1) return;
+    const device_config_t* cfg = config_view();
+    if (switch_num >= cfg->num_switches || event_type > 1) return;
     
     uint8_t event_idx = switch_num * 2 + event_type;
-    event_config_t* event = &current_config.events[event_idx];
+    const event_config_t* event = &cfg->events[event_idx];
+    
+    uint8_t count = event->message_count;
+    if (count > MAX_MESSAGES_PER_EVENT) count = MAX_MESSAGES_PER_EVENT;
     
-    // 応答バッファ（最大サイズ）
-    uint8_t response[64];
+    uint8_t response[SYSEX_RESPONSE_SIZE];
     uint8_t pos = 0;
     
     response[pos++] = SYSEX_START_BYTE;
@@ -383,11 +1235,11 @@ void send_message_response(uint8_t switch_num, uint8_t event_type) {
     response[pos++] = SYSEX_CMD_GET_MESSAGE;
     response[pos++] = switch_num;
     response[pos++] = event_type;
-    response[pos++] = event->message_count;
+    response[pos++] = count;
     
     // 各メッセージのデータを追加
-    for (uint8_t i = 0; i < event->message_count && pos < 60; i++) {
-        midi_config_t* msg = &event->messages[i];
+    for (uint8_t i = 0; i < count; i++) {
+        const midi_config_t* msg = &event->messages[i];
         response[pos++] = msg->msg_type;
         response[pos++] = msg->channel;
         response[pos++] = msg->param1;
@@ -395,27 +1247,264 @@ void send_message_response(uint8_t switch_num, uint8_t event_type) {
     }
     
     response[pos++] = SYSEX_END_BYTE;
-    tud_midi_stream_write(MIDI_CABLE_NUM, response, pos);
+    send_sysex_response(response, pos);
 }
 
-void send_success_response(void) {
+void send_pixel_colors_response(void) {
+    uint8_t response[6 + PIXEL_STATE_COUNT * 3 + 1];
+    uint8_t pos = 0;
+    
+    response[pos++] = SYSEX_START_BYTE;
+    response[pos++] = SYSEX_MANUFACTURER_ID_1;
+    response[pos++] = SYSEX_MANUFACTURER_ID_2;
+    response[pos++] = SYSEX_DEVICE_ID;
+    response[pos++] = SYSEX_CMD_GET_PIXEL_COLORS;
+    response[pos++] = PIXEL_STATE_COUNT;
+    
+    for (uint8_t i = 0; i < PIXEL_STATE_COUNT; i++) {
+        response[pos++] = config_view()->pixel_colors[i][0];
+        response[pos++] = config_view()->pixel_colors[i][1];
+        response[pos++] = config_view()->pixel_colors[i][2];
+    }
+    
+    response[pos++] = SYSEX_END_BYTE;
+    send_sysex_response(response, pos);
+}
+
+void send_feedback_map_response(uint8_t index) {
+    if (index >= MAX_FEEDBACK_MAPS) return;
+    
+    const feedback_map_t* map = &config_view()->feedback_maps[index];
     uint8_t response[] = {
         SYSEX_START_BYTE, SYSEX_MANUFACTURER_ID_1, SYSEX_MANUFACTURER_ID_2, SYSEX_DEVICE_ID,
-        SYSEX_CMD_SET_MESSAGE,
+        SYSEX_CMD_GET_FEEDBACK_MAP,
+        index,
+        config_view()->feedback_channel,
+        map->msg_type,
+        map->number,
+        map->switch_num,
+        map->state,
+        SYSEX_END_BYTE
+    };
+    send_sysex_response(response, sizeof(response));
+}
+
+void send_pin_map_response(void) {
+    uint8_t response[6 + MAX_SWITCHES + 1];
+    uint8_t pos = 0;
+    
+    response[pos++] = SYSEX_START_BYTE;
+    response[pos++] = SYSEX_MANUFACTURER_ID_1;
+    response[pos++] = SYSEX_MANUFACTURER_ID_2;
+    response[pos++] = SYSEX_DEVICE_ID;
+    response[pos++] = SYSEX_CMD_GET_PIN_MAP;
+    const device_config_t* cfg = config_view();
+    response[pos++] = cfg->num_switches;
+    
+    for (uint8_t i = 0; i < cfg->num_switches; i++) {
+        response[pos++] = cfg->pin_map[i];
+    }
+    
+    response[pos++] = SYSEX_END_BYTE;
+    send_sysex_response(response, pos);
+}
+
+// グループ数と、グループ毎のメンバー（bit i: スイッチi）を7ビットずつ3バイトで
+void send_exclusive_groups_response(void) {
+    uint8_t response[6 + MAX_EXCLUSIVE_GROUPS * 3 + 1];
+    uint8_t pos = 0;
+    
+    response[pos++] = SYSEX_START_BYTE;
+    response[pos++] = SYSEX_MANUFACTURER_ID_1;
+    response[pos++] = SYSEX_MANUFACTURER_ID_2;
+    response[pos++] = SYSEX_DEVICE_ID;
+    response[pos++] = SYSEX_CMD_GET_EXCLUSIVE_GROUPS;
+    response[pos++] = MAX_EXCLUSIVE_GROUPS;
+    
+    for (uint8_t g = 0; g < MAX_EXCLUSIVE_GROUPS; g++) {
+        uint16_t group = config_view()->exclusive_groups[g];
+        response[pos++] = group & 0x7F;
+        response[pos++] = (group >> 7) & 0x7F;
+        response[pos++] = group >> 14;
+    }
+    
+    response[pos++] = SYSEX_END_BYTE;
+    send_sysex_response(response, pos);
+}
+
+// 受け付け窓・保存済みの窓・標本数とチャタリングの長さ(ms)毎の標本数
+void send_debounce_response(uint8_t switch_num) {
+    if (switch_num >= config_view()->num_switches) return;
+    
+    uint8_t response[10 + DEBOUNCE_BUCKETS + 1];
+    uint8_t pos = 0;
+    
+    response[pos++] = SYSEX_START_BYTE;
+    response[pos++] = SYSEX_MANUFACTURER_ID_1;
+    response[pos++] = SYSEX_MANUFACTURER_ID_2;
+    response[pos++] = SYSEX_DEVICE_ID;
+    response[pos++] = SYSEX_CMD_GET_DEBOUNCE;
+    response[pos++] = switch_num;
+    response[pos++] = switch_states[switch_num].debounce_ms;
+    response[pos++] = config_view()->debounce_ms[switch_num] & 0x7F;
+    response[pos++] = bounce_samples[switch_num];
+    response[pos++] = DEBOUNCE_BUCKETS;
+    
+    for (uint8_t b = 0; b < DEBOUNCE_BUCKETS; b++) {
+        response[pos++] = bounce_histogram[switch_num][b];
+    }
+    
+    response[pos++] = SYSEX_END_BYTE;
+    send_sysex_response(response, pos);
+}
+
+#ifdef PICOMIDI_FLIGHT_RECORDER
+// 記録の状態と、残っている中で古い方からindex番目以降の記録（最大FLIGHT_ENTRIES_PER_RESPONSE件）
+// 番号は7bit×2、各記録は時刻µs（7bit×5）・種類・id・value（いずれも下位から）
+void send_flight_record_response(uint16_t index) {
+    uint32_t count = flight_count < FLIGHT_ENTRIES ? flight_count : FLIGHT_ENTRIES;
+    uint32_t oldest = flight_count - count;
+    uint32_t trigger = FLIGHT_INDEX_NONE;
+    if ((flight_reason == FLIGHT_REASON_RETRIGGER || flight_reason == FLIGHT_REASON_QUEUE_FULL) &&
+        flight_trigger_pos >= oldest) {
+        trigger = flight_trigger_pos - oldest;
+    }
+    
+    uint8_t response[14 + FLIGHT_ENTRIES_PER_RESPONSE * 8 + 1];
+    uint8_t pos = 0;
+    
+    response[pos++] = SYSEX_START_BYTE;
+    response[pos++] = SYSEX_MANUFACTURER_ID_1;
+    response[pos++] = SYSEX_MANUFACTURER_ID_2;
+    response[pos++] = SYSEX_DEVICE_ID;
+    response[pos++] = SYSEX_CMD_GET_FLIGHT_RECORD;
+    response[pos++] = index & 0x7F;
+    response[pos++] = (index >> 7) & 0x7F;
+    response[pos++] = count & 0x7F;
+    response[pos++] = (count >> 7) & 0x7F;
+    response[pos++] = trigger & 0x7F;
+    response[pos++] = (trigger >> 7) & 0x7F;
+    response[pos++] = flight_reason;
+    response[pos++] = flight_is_frozen(time_us_32()) ? 1 : 0;
+    
+    uint8_t n = 0;
+    while (n < FLIGHT_ENTRIES_PER_RESPONSE && index + n < count) n++;
+    response[pos++] = n;
+    
+    for (uint8_t i = 0; i < n; i++) {
+        const flight_entry_t* entry = &flight_entries[(oldest + index + i) & (FLIGHT_ENTRIES - 1)];
+        for (uint8_t shift = 0; shift < 35; shift += 7) {
+            response[pos++] = (entry->time_us >> shift) & 0x7F;
+        }
+        response[pos++] = entry->type;
+        response[pos++] = entry->id;
+        response[pos++] = entry->value;
+    }
+    
+    response[pos++] = SYSEX_END_BYTE;
+    send_sysex_response(response, pos);
+}
+#endif
+
+// 各時刻は7bit×4（下位から）
+void send_boot_times_response(void) {
+    uint8_t response[6 + BOOT_PHASE_COUNT * 4 + 1];
+    uint8_t pos = 0;
+    
+    response[pos++] = SYSEX_START_BYTE;
+    response[pos++] = SYSEX_MANUFACTURER_ID_1;
+    response[pos++] = SYSEX_MANUFACTURER_ID_2;
+    response[pos++] = SYSEX_DEVICE_ID;
+    response[pos++] = SYSEX_CMD_GET_BOOT_TIMES;
+    response[pos++] = BOOT_PHASE_COUNT;
+    
+    for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++) {
+        for (uint8_t shift = 0; shift < 28; shift += 7) {
+            response[pos++] = (boot_times[i] >> shift) & 0x7F;
+        }
+    }
+    
+    response[pos++] = SYSEX_END_BYTE;
+    send_sysex_response(response, pos);
+}
+
+void send_success_response(uint8_t command) {
+    uint8_t response[] = {
+        SYSEX_START_BYTE, SYSEX_MANUFACTURER_ID_1, SYSEX_MANUFACTURER_ID_2, SYSEX_DEVICE_ID,
+        command,
         0x00,  // 成功
         SYSEX_END_BYTE
     };
-    tud_midi_stream_write(MIDI_CABLE_NUM, response, sizeof(response));
+    send_sysex_response(response, sizeof(response));
 }
 
-void send_error_response(void) {
+void send_error_response(uint8_t command) {
     uint8_t response[] = {
         SYSEX_START_BYTE, SYSEX_MANUFACTURER_ID_1, SYSEX_MANUFACTURER_ID_2, SYSEX_DEVICE_ID,
-        SYSEX_CMD_SET_MESSAGE,
+        command,
         0x01,  // エラー
         SYSEX_END_BYTE
     };
-    tud_midi_stream_write(MIDI_CABLE_NUM, response, sizeof(response));
+    send_sysex_response(response, sizeof(response));
+}
+
+// 設定全体の検証（トランザクションのCOMMIT時。個々のSET系で検証済みの内容を、反映の直前にもう一度確かめる）
+bool validate_config(const device_config_t* cfg) {
+    if (!validate_pin_map(cfg->num_switches, cfg->pin_map) ||
+        (cfg->feedback_channel > 15 && cfg->feedback_channel != FEEDBACK_CHANNEL_NONE)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < MAX_SWITCHES * 2; i++) {
+        const event_config_t* event = &cfg->events[i];
+        if (event->message_count > MAX_MESSAGES_PER_EVENT) return false;
+        for (uint8_t m = 0; m < event->message_count; m++) {
+            if (!validate_midi_config(&event->messages[m])) return false;
+        }
+    }
+    for (uint8_t i = 0; i < PIXEL_STATE_COUNT; i++) {
+        if (cfg->pixel_colors[i][0] > 127 || cfg->pixel_colors[i][1] > 127 || cfg->pixel_colors[i][2] > 127) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 作業領域の設定を反映する。変わったイベントだけを組み立て直して公開し、フラッシュへは1回だけ書く。
+// 1回のメインループの中で終わるので、スイッチの変化や送信からは新旧が混ざった状態は見えない
+bool commit_transaction(void) {
+    transaction_open = false;
+    const device_config_t* staged = &config_edit.config;
+    if (!validate_config(staged)) return false;
+    if (memcmp(staged, active_config, sizeof(device_config_t)) == 0) return true;  // 変更なし
+    
+    bool pins_changed = staged->num_switches != active_config->num_switches ||
+                        memcmp(staged->pin_map, active_config->pin_map, sizeof(staged->pin_map)) != 0;
+    bool groups_changed = pins_changed ||
+                          memcmp(staged->exclusive_groups, active_config->exclusive_groups,
+                                 sizeof(staged->exclusive_groups)) != 0;
+    uint32_t events_changed = 0;
+    for (uint8_t i = 0; i < MAX_SWITCHES * 2; i++) {
+        if (memcmp(&staged->events[i], &active_config->events[i], sizeof(event_config_t)) != 0) {
+            events_changed |= 1u << i;
+        }
+    }
+    
+    active_config = staged;
+    
+    if (pins_changed) {
+        compile_pin_map();
+    }
+    if (groups_changed) {
+        compile_exclusive_groups();  // 選択状態は引き継がない
+    }
+    while (events_changed != 0) {
+        uint8_t i = __builtin_ctz(events_changed);
+        events_changed &= events_changed - 1;
+        compile_event(i);
+    }
+    compile_feedback_lookup();
+    update_all_pixels();
+    return save_config_to_flash();
 }
 
 void process_sysex_data(const uint8_t* data, uint16_t length) {
@@ -458,120 +1547,495 @@ void process_sysex_data(const uint8_t* data, uint16_t length) {
                 uint8_t message_count = data[7];
                 
                 // バリデーション
-                if (switch_num >= num_switches || event_type > 1 || 
+                if (switch_num >= config_view()->num_switches || event_type > 1 || 
                     message_count > MAX_MESSAGES_PER_EVENT || 
-                    length < 8 + message_count * 4) {
-                    send_error_response();
+                    length < 9 + message_count * 4) {  // F7はメッセージに含めない
+                    send_error_response(SYSEX_CMD_SET_MESSAGE);
                     return;
                 }
                 
-                uint8_t event_idx = switch_num * 2 + event_type;
-                event_config_t* event = &current_config.events[event_idx];
-                
-                // メッセージをクリア
-                event->message_count = 0;
-                memset(event->messages, 0, sizeof(event->messages));
+                // 全メッセージを検証してから反映する（途中でエラーになっても設定は変えない）
+                event_config_t event;
+                memset(&event, 0, sizeof(event));
                 
-                // 新しいメッセージを設定
                 uint8_t pos = 8;
-                for (uint8_t i = 0; i < message_count && pos + 3 < length; i++) {
-                    midi_config_t* msg = &event->messages[i];
+                for (uint8_t i = 0; i < message_count; i++) {
+                    midi_config_t* msg = &event.messages[i];
                     msg->msg_type = data[pos++];
                     msg->channel = data[pos++] & 0x0F;
                     msg->param1 = data[pos++] & 0x7F;
                     msg->param2 = data[pos++] & 0x7F;
                     
-                    if (validate_midi_config(msg)) {
-                        event->message_count++;
-                    } else {
-                        send_error_response();
+                    if (!validate_midi_config(msg)) {
+                        send_error_response(SYSEX_CMD_SET_MESSAGE);
                         return;
                     }
                 }
+                event.message_count = message_count;
                 
-                save_config_to_flash();
-                send_success_response();
+                uint8_t event_idx = switch_num * 2 + event_type;
+                config_target()->events[event_idx] = event;
+                if (!transaction_open) {
+                    compile_event(event_idx);
+                    save_config_to_flash();
+                }
+                send_success_response(SYSEX_CMD_SET_MESSAGE);
             } else {
-                send_error_response();
+                send_error_response(SYSEX_CMD_SET_MESSAGE);
             }
             break;
         }
-    }
-}
-
-void tud_midi_rx_cb(uint8_t port) {
-    printf("RX CB called, port=%d, available=%d\n", port, tud_midi_available());
-    static uint8_t sysex_buffer[SYSEX_BUFFER_SIZE];
-    static uint16_t sysex_pos = 0;
-    
-    uint8_t midi_data[32]; // Buffer for MIDI stream data
-    
-    while (tud_midi_available()) {
-        uint32_t bytes_read = tud_midi_stream_read(midi_data, sizeof(midi_data));
-        if (bytes_read == 0) break;
         
-        printf("MIDI stream: %d bytes\n", bytes_read);
-        start_led_blink();  // MIDI受信時にLED点滅開始
+        case SYSEX_CMD_GET_PIXEL_COLORS: {
+            if (length == SYSEX_BASIC_MIN_LENGTH) {
+                send_pixel_colors_response();
+            }
+            break;
+        }
+        
+        case SYSEX_CMD_SET_PIXEL_COLOR: {
+            // F0 00 7D 01 05 <state> <r> <g> <b> F7
+            if (length != 10 || data[5] >= PIXEL_STATE_COUNT ||
+                data[6] > 127 || data[7] > 127 || data[8] > 127) {
+                send_error_response(SYSEX_CMD_SET_PIXEL_COLOR);
+                return;
+            }
+            
+            device_config_t* cfg = config_target();
+            cfg->pixel_colors[data[5]][0] = data[6];
+            cfg->pixel_colors[data[5]][1] = data[7];
+            cfg->pixel_colors[data[5]][2] = data[8];
+            
+            if (!transaction_open) {
+                update_all_pixels();
+                save_config_to_flash();
+            }
+            send_success_response(SYSEX_CMD_SET_PIXEL_COLOR);
+            break;
+        }
+        
+        case SYSEX_CMD_GET_FEEDBACK_MAP: {
+            if (length == 7) {  // F0 00 7D 01 06 <index> F7
+                send_feedback_map_response(data[5]);
+            }
+            break;
+        }
+        
+        case SYSEX_CMD_SET_FEEDBACK_MAP: {
+            // F0 00 7D 01 07 <index> <type> <number> <switch> <state> F7
+            // typeがNONEの場合は割り当て解除
+            if (length != 11 || data[5] >= MAX_FEEDBACK_MAPS ||
+                (data[6] != MIDI_MSG_NONE && data[6] != MIDI_MSG_CC && data[6] != MIDI_MSG_NOTE) ||
+                data[7] > 127 || data[8] >= config_view()->num_switches ||
+                data[9] < PIXEL_STATE_HOST_1 || data[9] >= PIXEL_STATE_COUNT) {
+                send_error_response(SYSEX_CMD_SET_FEEDBACK_MAP);
+                return;
+            }
+            
+            feedback_map_t* map = &config_target()->feedback_maps[data[5]];
+            map->msg_type = data[6];
+            map->number = data[7];
+            map->switch_num = data[8];
+            map->state = data[9];
+            
+            if (!transaction_open) {
+                compile_feedback_lookup();
+                save_config_to_flash();
+            }
+            send_success_response(SYSEX_CMD_SET_FEEDBACK_MAP);
+            break;
+        }
+        
+        case SYSEX_CMD_SET_FEEDBACK_CHANNEL: {
+            // F0 00 7D 01 08 <channel> F7（0x7Fで無効）
+            if (length != 7 || (data[5] > 15 && data[5] != FEEDBACK_CHANNEL_NONE)) {
+                send_error_response(SYSEX_CMD_SET_FEEDBACK_CHANNEL);
+                return;
+            }
+            
+            config_target()->feedback_channel = data[5];
+            if (!transaction_open) {
+                compile_feedback_lookup();
+                save_config_to_flash();
+            }
+            send_success_response(SYSEX_CMD_SET_FEEDBACK_CHANNEL);
+            break;
+        }
+        
+        case SYSEX_CMD_GET_PIN_MAP: {
+            if (length == SYSEX_BASIC_MIN_LENGTH) {
+                send_pin_map_response();
+            }
+            break;
+        }
         
-        // Process pure MIDI data stream
-        for (uint32_t i = 0; i < bytes_read; i++) {
-            uint8_t byte = midi_data[i];
+        case SYSEX_CMD_SET_PIN_MAP: {
+            // F0 00 7D 01 0A <count> <pin 0> ... <pin count-1> F7
+            if (length < 7 || length != 7 + data[5] || !validate_pin_map(data[5], &data[6])) {
+                send_error_response(SYSEX_CMD_SET_PIN_MAP);
+                return;
+            }
             
-            if (byte == SYSEX_START_BYTE) {
-                // Start of SysEx
-                printf("SysEx start\n");
-                sysex_pos = 0;
-                sysex_buffer[sysex_pos++] = byte;
-            } else if (byte == SYSEX_END_BYTE) {
-                // End of SysEx  
-                printf("SysEx end, pos=%d\n", sysex_pos);
-                if (sysex_pos < SYSEX_BUFFER_SIZE) {
-                    sysex_buffer[sysex_pos++] = byte;
-                    process_sysex_data(sysex_buffer, sysex_pos);
+            device_config_t* cfg = config_target();
+            // ピンが変わったスイッチの学習値は別のスイッチのものなので捨てる
+            for (uint8_t i = 0; i < MAX_SWITCHES; i++) {
+                if (i >= data[5] || cfg->pin_map[i] != data[6 + i]) {
+                    cfg->debounce_ms[i] = 0;
                 }
-                sysex_pos = 0;
-                // Continue processing remaining data, don't return
-            } else if (sysex_pos > 0 && sysex_pos < SYSEX_BUFFER_SIZE - 1) {
-                // Data byte (only process if we're in a SysEx)
-                printf("SysEx data: %02X\n", byte);
-                sysex_buffer[sysex_pos++] = byte;
+            }
+            cfg->num_switches = data[5];
+            memset(cfg->pin_map, 0, sizeof(cfg->pin_map));
+            memcpy(cfg->pin_map, &data[6], data[5]);
+            
+            if (!transaction_open) {
+                compile_pin_map();
+                compile_exclusive_groups();
+                compile_feedback_lookup();  // 範囲外になった割り当ての除外と表示の更新
+                save_config_to_flash();
+            }
+            send_success_response(SYSEX_CMD_SET_PIN_MAP);
+            break;
+        }
+        
+        case SYSEX_CMD_GET_BOOT_TIMES: {
+            if (length == SYSEX_BASIC_MIN_LENGTH) {
+                send_boot_times_response();
+            }
+            break;
+        }
+        
+        case SYSEX_CMD_GET_DEBOUNCE: {
+            if (length == 7) {  // F0 00 7D 01 0C <switch> F7
+                send_debounce_response(data[5]);
+            }
+            break;
+        }
+        
+        case SYSEX_CMD_GET_EXCLUSIVE_GROUPS: {
+            if (length == SYSEX_BASIC_MIN_LENGTH) {
+                send_exclusive_groups_response();
+            }
+            break;
+        }
+        
+        case SYSEX_CMD_SET_EXCLUSIVE_GROUP: {
+            // F0 00 7D 01 13 <group> <members bit0-6> <bit7-13> <bit14-15> F7
+            // メンバーはスイッチ数の範囲で、0（未使用）か2つ以上
+            if (length != 10 || data[5] >= MAX_EXCLUSIVE_GROUPS || data[8] > 0x03) {
+                send_error_response(SYSEX_CMD_SET_EXCLUSIVE_GROUP);
+                return;
+            }
+            uint32_t members = data[6] | data[7] << 7 | data[8] << 14;
+            if ((members >> config_view()->num_switches) != 0 || __builtin_popcount(members) == 1) {
+                send_error_response(SYSEX_CMD_SET_EXCLUSIVE_GROUP);
+                return;
+            }
+            
+            config_target()->exclusive_groups[data[5]] = members;
+            if (!transaction_open) {
+                compile_exclusive_groups();
+                update_all_pixels();
+                save_config_to_flash();
+            }
+            send_success_response(SYSEX_CMD_SET_EXCLUSIVE_GROUP);
+            break;
+        }
+        
+        case SYSEX_CMD_BEGIN_TRANSACTION: {
+            // F0 00 7D 01 0F F7（開いていれば捨ててやり直す）
+            // 確定した設定がまだRAMにあれば（保存待ち・保存の失敗）先に保存して、config_editを空ける
+            if (length != SYSEX_BASIC_MIN_LENGTH ||
+                (active_config == &config_edit.config && !save_config_to_flash())) {
+                send_error_response(SYSEX_CMD_BEGIN_TRANSACTION);
+                return;
+            }
+            
+            memset(config_edit.bytes, 0xFF, sizeof(config_edit.bytes));
+            memcpy(&config_edit.config, active_config, sizeof(device_config_t));
+            transaction_open = true;
+            send_success_response(SYSEX_CMD_BEGIN_TRANSACTION);
+            break;
+        }
+        
+        case SYSEX_CMD_COMMIT_TRANSACTION: {
+            // F0 00 7D 01 10 F7（開いていない・検証に失敗した場合はエラー。どちらでもトランザクションは閉じる）
+            if (length != SYSEX_BASIC_MIN_LENGTH || !transaction_open || !commit_transaction()) {
+                transaction_open = false;
+                send_error_response(SYSEX_CMD_COMMIT_TRANSACTION);
+                return;
+            }
+            send_success_response(SYSEX_CMD_COMMIT_TRANSACTION);
+            break;
+        }
+        
+        case SYSEX_CMD_ROLLBACK_TRANSACTION: {
+            // F0 00 7D 01 11 F7（開いていなければエラー）
+            if (length != SYSEX_BASIC_MIN_LENGTH || !transaction_open) {
+                send_error_response(SYSEX_CMD_ROLLBACK_TRANSACTION);
+                return;
+            }
+            transaction_open = false;
+            send_success_response(SYSEX_CMD_ROLLBACK_TRANSACTION);
+            break;
+        }
+        
+#ifdef PICOMIDI_FLIGHT_RECORDER
+        case SYSEX_CMD_GET_FLIGHT_RECORD: {
+            if (length == 8) {  // F0 00 7D 01 0D <index lo> <index hi> F7
+                send_flight_record_response(data[5] | data[6] << 7);
+            }
+            break;
+        }
+        
+        case SYSEX_CMD_SET_FLIGHT_RECORDER: {
+            // F0 00 7D 01 0E <0: 記録を消して再開, 1: 止める> F7
+            if (length != 7 || data[5] > 1) {
+                send_error_response(SYSEX_CMD_SET_FLIGHT_RECORDER);
+                return;
+            }
+            
+            if (data[5] == 0) {
+                flight_reset();
             } else {
-                printf("MIDI byte: %02X\n", byte);
+                flight_freeze();
             }
+            send_success_response(SYSEX_CMD_SET_FLIGHT_RECORDER);
+            break;
         }
+#endif
     }
 }
 
-int main(void) {
-    board_init();
-    
-    printf("PicoMIDI Switch Startup\n");
+// SysExのバイト列を組み立て、F7で完結したらprocess_sysex_data()に渡す
+void sysex_feed_byte(uint8_t byte) {
+    if (byte == SYSEX_START_BYTE) {
+        // Start of SysEx
+        sysex_pos = 0;
+        sysex_buffer[sysex_pos++] = byte;
+    } else if (byte == SYSEX_END_BYTE) {
+        // End of SysEx
+        if (sysex_pos > 0 && sysex_pos < SYSEX_BUFFER_SIZE) {
+            sysex_buffer[sysex_pos++] = byte;
+            process_sysex_data(sysex_buffer, sysex_pos);
+        }
+        sysex_pos = 0;
+    } else if (sysex_pos > 0) {
+        // Data byte (only process if we're in a SysEx)
+        if ((byte & 0x80) || sysex_pos >= SYSEX_BUFFER_SIZE - 1) {
+            // 途中のステータスバイトやバッファ超過は途切れたメッセージとして捨てる
+            sysex_pos = 0;
+        } else {
+            sysex_buffer[sysex_pos++] = byte;
+        }
+    }
+}
+
+// 受信したUSB-MIDIパケットを処理する
+// 1ループあたりの処理数を制限し、ホストからの大量のフィードバックでもスイッチ走査を止めない
+void midi_rx_task(void) {
+    uint8_t packet[4];
+    uint8_t budget = MIDI_RX_PACKETS_PER_LOOP;
+    bool received = false;
     
-    // 配列内の各ピンを初期化
-    for (uint8_t i = 0; i < num_switches; i++) {
-        gpio_init(switch_pins[i]);
-        gpio_set_dir(switch_pins[i], GPIO_IN);
-        gpio_pull_up(switch_pins[i]);
+    // 応答を書き終わるまで、差し替えた送信パケットの古い面を送り終わるまでは次の要求を読まない（ホストへの背圧）
+    while (budget-- > 0 && sysex_response_len == 0 && !compile_grace_pending() && tud_midi_packet_read(packet)) {
+        received = true;
         
-        switch_states[i].state = false;
-        switch_states[i].debounce_time = 0;
+        switch (packet[0] & 0x0F) {
+            case 0x04:  // SysEx start/continue (3 bytes)
+            case 0x07:  // SysEx end (3 bytes)
+                sysex_feed_byte(packet[1]);
+                sysex_feed_byte(packet[2]);
+                sysex_feed_byte(packet[3]);
+                break;
+            case 0x06:  // SysEx end (2 bytes)
+                sysex_feed_byte(packet[1]);
+                sysex_feed_byte(packet[2]);
+                break;
+            case 0x05:  // SysEx end (1 byte) / single-byte system common
+                sysex_feed_byte(packet[1]);
+                break;
+            case 0x08:  // Note Off
+            case 0x09:  // Note On
+            case 0x0B:  // Control Change
+                handle_feedback_packet(packet);
+                break;
+            default:
+                break;
+        }
     }
     
+    if (received) {
+        led_activity();  // MIDI受信時にLED点滅開始
+    }
+}
+
+// USB接続状態はLEDの常時点灯で表示する
+void tud_mount_cb(void) {
+    led_set_base(255);
+    boot_mark(BOOT_PHASE_MOUNTED);
+}
+
+void tud_umount_cb(void) {
+    led_set_base(0);
+    transaction_open = false;  // 切断したホストの変更は反映しない
+}
+
+// HID GET_REPORT要求（入力レポートはキュー経由でのみ送るので未使用）
+uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen) {
+    (void) instance;
+    (void) report_id;
+    (void) report_type;
+    (void) buffer;
+    (void) reqlen;
+    return 0;
+}
+
+// HID SET_REPORT要求（キーボードLEDなど。使用しない）
+void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer, uint16_t bufsize) {
+    (void) instance;
+    (void) report_id;
+    (void) report_type;
+    (void) buffer;
+    (void) bufsize;
+}
+
+// 学習した受け付け窓を時々保存する。操作のない間だけ書き込み（割り込みが止まる）、
+// 保存済みの値からあまり変わっていなければ書かない
+void debounce_save_task(void) {
+    uint32_t now = board_millis();
+    if (now - debounce_checked_ms < DEBOUNCE_SAVE_INTERVAL_MS ||
+        now - last_switch_edge_ms < DEBOUNCE_SAVE_IDLE_MS ||
+        switch_pressed_mask != 0 || event_queue_head != event_queue_tail || config_save_pending ||
+        transaction_open) {
+        return;
+    }
+    debounce_checked_ms = now;
+    
+    bool changed = false;
+    for (uint8_t i = 0; i < active_config->num_switches; i++) {
+        if (bounce_samples[i] < DEBOUNCE_MIN_SAMPLES) continue;
+        int diff = (int)switch_states[i].debounce_ms - (int)active_config->debounce_ms[i];
+        if (active_config->debounce_ms[i] == 0 || abs(diff) >= DEBOUNCE_SAVE_DELTA_MS) {
+            changed = true;
+        }
+    }
+    if (!changed) return;
+    
+    device_config_t* cfg = edit_config();
+    for (uint8_t i = 0; i < cfg->num_switches; i++) {
+        if (bounce_samples[i] >= DEBOUNCE_MIN_SAMPLES) {
+            cfg->debounce_ms[i] = switch_states[i].debounce_ms;
+        }
+    }
+    save_config_to_flash();
+}
+
+// 起動処理（ボード初期化後）
+// USBを最初に開始し、設定の検証などは列挙を待つ間に行う。
+// フラッシュへの初期設定の書き込み（数十msの間割り込みが止まる）は列挙の後に回す
+void picomidi_init(void) {
+    for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++) {
+        boot_times[i] = BOOT_TIME_NONE;
+    }
+    boot_mark(BOOT_PHASE_START);
+    
+    tusb_init();
+    boot_mark(BOOT_PHASE_USB_INIT);
+    
+    printf("PicoMIDI Switch Startup\n");
+    
+    event_queue_head = event_queue_tail = 0;
+    event_packet_pos = 0;
+    event_sending = NULL;
+    event_queue_drops = 0;
+    transaction_open = false;
+    events_queued = 0;
+    event_queue_high_water = 0;
+    sysex_pos = 0;
+    sysex_response_pos = sysex_response_len = 0;
+    last_switch_edge_ms = 0;
+    debounce_checked_ms = 0;
+#ifdef PICOMIDI_FLIGHT_RECORDER
+    flight_reset();
+#endif
+    
     init_default_config();
-    if (!load_config_from_flash()) {
+    config_slot = -1;
+    config_generation = 0;
+    // ビルド時のプロファイルがあれば初回起動でも書き込みは不要
+    config_save_pending = !load_config_from_flash() && !load_default_config();
+    // 旧レイアウトからの移行などでRAMの設定を使っている場合も、書き込んで次回からはフラッシュを直接読む
+    if (active_config == &config_edit.config) {
+        config_save_pending = true;
+    }
+    boot_mark(BOOT_PHASE_CONFIG_LOADED);
+    
+    compile_pin_map();
+    compile_all_events();
+    compile_exclusive_groups();
+    
+#ifdef WS2812_PIN
+    ws2812_init(WS2812_PIN, active_config->num_switches);
+#endif
+    compile_feedback_lookup();
+    boot_mark(BOOT_PHASE_READY);
+}
+
+// メインループ1回分
+void picomidi_task(void) {
+    tud_task();
+    midi_rx_task();
+    check_switches();
+    service_output_queue();
+    ws2812_task();
+    
+    // 初回起動・破損時の初期設定は、列挙が終わってから（USBなしなら一定時間後に）書き込む
+    if (config_save_pending && (tud_mounted() || board_millis() >= CONFIG_SAVE_TIMEOUT_MS)) {
         save_config_to_flash();
+        boot_mark(BOOT_PHASE_CONFIG_SAVED);
     }
     
-    tusb_init();
+    debounce_save_task();
+}
+
+// ホストビルド（host/）では、シミュレータがpicomidi_init/picomidi_taskを直接駆動する
+#ifndef PICOMIDI_HOST
+int main(void) {
+    board_init();
+    led_init();
     
+    picomidi_init();
+    
+#ifdef PICOMIDI_STRESS
+    // 全スイッチに乱数の押下/解放とチャタリングを与え、1秒毎に受け付けた数を報告する
+    stress_params_t stress = {PICOMIDI_STRESS_MIN_INTERVAL_US, PICOMIDI_STRESS_MAX_INTERVAL_US, 6};
+    stress_start(active_config->pin_map, active_config->num_switches, &stress);
+    uint32_t last_report = board_millis();
+    uint32_t last_transitions = 0;
+#endif
     
     printf("Entering main loop\n");
     
     while (1) {
-        tud_task();
-        check_switches();
-        update_led_state();
+        picomidi_task();
+        
+#ifdef PICOMIDI_STRESS
+        if (board_millis() - last_report >= 1000) {
+            last_report += 1000;
+            uint32_t transitions = stress_gen_transitions();
+            uint32_t queued, drops;
+            uint8_t high_water;
+            get_output_queue_stats(&queued, &drops, &high_water);
+            // 押下/解放はすべて受け付けられ、キューに積むか溢れるかのどちらかになるはず
+            printf("stress: %lu events/s, generated %lu, accepted %lu, dropped %lu, queue high water %u/%u\n",
+                   (unsigned long)(transitions - last_transitions), (unsigned long)transitions,
+                   (unsigned long)(queued + drops), (unsigned long)drops, high_water, EVENT_QUEUE_SIZE);
+            last_transitions = transitions;
+        }
+#endif
     }
     
     return 0;
 }
+#endif
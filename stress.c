@@ -0,0 +1,143 @@
+#include "stress.h"
+
+#include <string.h>
+
+#ifndef PICOMIDI_HOST
+#include "hardware/gpio.h"
+#include "hardware/timer.h"
+#include "pico/time.h"
+#endif
+
+#define STRESS_MIN_BOUNCE_GAP_US 50
+
+typedef struct {
+    uint64_t next_us;           // 次のエッジの時刻
+    uint64_t transition_us;     // 直近の押下/解放の時刻
+    uint8_t bounces_left;       // 残りのチャタリングのエッジ数（偶数なら最後は目標レベル）
+    bool level;                 // 現在のピンのレベル
+    bool target;                // 押下/解放後のレベル
+} stress_switch_t;
+
+static stress_params_t stress_params;
+static stress_switch_t stress_switches[STRESS_MAX_SWITCHES];
+static uint8_t stress_count = 0;
+static uint32_t stress_rng = 1;
+static uint32_t stress_transitions = 0;
+
+static uint32_t stress_random(uint32_t range) {
+    stress_rng ^= stress_rng << 13;
+    stress_rng ^= stress_rng >> 17;
+    stress_rng ^= stress_rng << 5;
+    return range ? stress_rng % range : 0;
+}
+
+static uint32_t stress_interval(void) {
+    return stress_params.min_interval_us +
+           stress_random(stress_params.max_interval_us - stress_params.min_interval_us + 1);
+}
+
+static uint32_t stress_bounce_gap(void) {
+    // 全パルスがウィンドウ内に収まる間隔
+    uint32_t max_gap = STRESS_BOUNCE_WINDOW_US / (stress_params.max_bounces + 1);
+    if (max_gap <= STRESS_MIN_BOUNCE_GAP_US) return STRESS_MIN_BOUNCE_GAP_US;
+    return STRESS_MIN_BOUNCE_GAP_US + stress_random(max_gap - STRESS_MIN_BOUNCE_GAP_US);
+}
+
+void stress_gen_init(const stress_params_t* params, uint8_t count, uint32_t seed, uint64_t now_us) {
+    stress_params = *params;
+    if (stress_params.max_interval_us < stress_params.min_interval_us) {
+        stress_params.max_interval_us = stress_params.min_interval_us;
+    }
+    stress_count = count > STRESS_MAX_SWITCHES ? STRESS_MAX_SWITCHES : count;
+    stress_rng = seed ? seed : 1;
+    stress_transitions = 0;
+
+    memset(stress_switches, 0, sizeof(stress_switches));
+    for (uint8_t i = 0; i < stress_count; i++) {
+        stress_switches[i].level = true;   // 解放状態から開始
+        stress_switches[i].target = true;
+        stress_switches[i].next_us = now_us + stress_interval();
+    }
+}
+
+// 1つのスイッチの次のエッジを進める
+static void stress_advance(uint8_t idx, stress_edge_cb_t callback, void* user) {
+    stress_switch_t* sw = &stress_switches[idx];
+    uint64_t time_us = sw->next_us;
+    bool transition = sw->bounces_left == 0;
+
+    if (transition) {
+        // 押下/解放の最初のエッジ。チャタリングは偶数回のパルスで最後に目標レベルへ戻る
+        sw->target = !sw->target;
+        sw->level = sw->target;
+        sw->transition_us = time_us;
+        sw->bounces_left = 2 * (uint8_t)stress_random(stress_params.max_bounces / 2 + 1);
+        stress_transitions++;
+    } else {
+        sw->level = !sw->level;
+        sw->bounces_left--;
+    }
+
+    if (sw->bounces_left > 0) {
+        sw->next_us = time_us + stress_bounce_gap();
+    } else {
+        sw->next_us = sw->transition_us + stress_interval();
+    }
+
+    if (callback) {
+        callback(time_us, idx, sw->level, transition, user);
+    }
+}
+
+uint64_t stress_gen_poll(uint64_t now_us, stress_edge_cb_t callback, void* user) {
+    while (true) {
+        // 最も早いエッジを選ぶ（同時刻ならスイッチ番号順）
+        uint8_t earliest = 0;
+        for (uint8_t i = 1; i < stress_count; i++) {
+            if (stress_switches[i].next_us < stress_switches[earliest].next_us) {
+                earliest = i;
+            }
+        }
+        if (stress_count == 0 || stress_switches[earliest].next_us > now_us) {
+            return stress_count ? stress_switches[earliest].next_us : UINT64_MAX;
+        }
+        stress_advance(earliest, callback, user);
+    }
+}
+
+uint32_t stress_gen_transitions(void) {
+    return stress_transitions;
+}
+
+#ifndef PICOMIDI_HOST
+
+#define STRESS_TICK_US 20
+
+static const uint8_t* stress_pins;
+static repeating_timer_t stress_timer;
+
+static void stress_apply_edge(uint64_t time_us, uint8_t switch_idx, bool level, bool transition, void* user) {
+    (void) time_us;
+    (void) transition;
+    (void) user;
+    gpio_set_inover(stress_pins[switch_idx], level ? GPIO_OVERRIDE_HIGH : GPIO_OVERRIDE_LOW);
+}
+
+static bool stress_timer_callback(repeating_timer_t* timer) {
+    (void) timer;
+    stress_gen_poll(time_us_64(), stress_apply_edge, NULL);
+    return true;
+}
+
+bool stress_start(const uint8_t* pins, uint8_t count, const stress_params_t* params) {
+    stress_pins = pins;
+    stress_gen_init(params, count, time_us_32(), time_us_64());
+
+    // 入力オーバーライドはSIOを含む全ペリフェラルから見た入力を置き換える
+    for (uint8_t i = 0; i < stress_count; i++) {
+        gpio_set_inover(pins[i], GPIO_OVERRIDE_HIGH);
+    }
+    return add_repeating_timer_us(-STRESS_TICK_US, stress_timer_callback, NULL, &stress_timer);
+}
+
+#endif // PICOMIDI_HOST
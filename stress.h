@@ -0,0 +1,40 @@
+#ifndef STRESS_H
+#define STRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// スイッチ入力のストレス試験用エッジ生成
+// 各スイッチを乱数の間隔で押下/解放し、最初のエッジの直後にチャタリング（短いパルスの連続）を加える。
+// チャタリングはデバウンス時間より十分短く、押下/解放の間隔はデバウンス時間より長いので、
+// 1回の押下/解放はちょうど1つのイベントとして受け付けられるはず。
+// 生成部はハードウェアに依存せず、ホストのシミュレータでも同じパターンを使う。
+
+#define STRESS_MAX_SWITCHES 16
+#define STRESS_BOUNCE_WINDOW_US 5000   // チャタリングは最初のエッジからこの時間内に収める
+
+typedef struct {
+    uint32_t min_interval_us;   // 押下/解放の間隔（デバウンス時間 + 1ms以上にする）
+    uint32_t max_interval_us;
+    uint8_t max_bounces;        // 1回の押下/解放に加えるパルス数の上限（0でチャタリングなし）
+} stress_params_t;
+
+// level: ピンのレベル（true = High = 解放）
+// transition: 押下/解放の最初のエッジならtrue、チャタリングならfalse
+typedef void (*stress_edge_cb_t)(uint64_t time_us, uint8_t switch_idx, bool level, bool transition, void* user);
+
+void stress_gen_init(const stress_params_t* params, uint8_t count, uint32_t seed, uint64_t now_us);
+
+// now_usまでに予定されたエッジを時刻順に通知し、次のエッジの時刻を返す
+uint64_t stress_gen_poll(uint64_t now_us, stress_edge_cb_t callback, void* user);
+
+// 生成した押下/解放の数
+uint32_t stress_gen_transitions(void);
+
+#ifndef PICOMIDI_HOST
+// 実機：GPIOの入力オーバーライドでスイッチ入力を生成パターンに置き換える
+// （スキャン処理はそのままgpio_get_all()で読む）
+bool stress_start(const uint8_t* pins, uint8_t count, const stress_params_t* params);
+#endif
+
+#endif // STRESS_H
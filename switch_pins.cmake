@@ -0,0 +1,62 @@
+# Generate switch_pins.h from a comma-separated GPIO pin list.
+#
+# Besides the pin table, the header carries a scan routine specialized for the
+# pin list: a single shift when the pins are contiguous and ascending, otherwise
+# one constant shift per pin, and an X-macro that unrolls per-switch handling
+# with constant indices.
+set(PICOMIDI_SWITCH_PINS_TEMPLATE ${CMAKE_CURRENT_LIST_DIR}/switch_pins.h.in)
+
+function(picomidi_generate_switch_pins pins output)
+    string(REPLACE "," ";" PIN_LIST "${pins}")
+    list(LENGTH PIN_LIST NUM_SWITCHES)
+    if(NUM_SWITCHES LESS 1 OR NUM_SWITCHES GREATER 16)
+        message(FATAL_ERROR "GPIO_PINS must list 1 to 16 pins (got ${NUM_SWITCHES})")
+    endif()
+
+    set(mask 0)
+    set(index 0)
+    set(contiguous 1)
+    set(first_pin "")
+    set(pins_clean "")
+    set(scan_terms "")
+    set(for_each "")
+
+    foreach(pin IN LISTS PIN_LIST)
+        string(STRIP "${pin}" pin)
+        if(NOT pin MATCHES "^[0-9]+$" OR pin GREATER 29)
+            message(FATAL_ERROR "GPIO_PINS: '${pin}' is not an RP2040 GPIO (0-29)")
+        endif()
+        math(EXPR bit "1 << ${pin}")
+        math(EXPR duplicate "${mask} & ${bit}")
+        if(NOT duplicate EQUAL 0)
+            message(FATAL_ERROR "GPIO_PINS: pin ${pin} is listed twice")
+        endif()
+        math(EXPR mask "${mask} | ${bit}")
+
+        if(index EQUAL 0)
+            set(first_pin ${pin})
+        else()
+            math(EXPR expected "${first_pin} + ${index}")
+            if(NOT pin EQUAL expected)
+                set(contiguous 0)
+            endif()
+        endif()
+
+        list(APPEND pins_clean ${pin})
+        list(APPEND scan_terms "((~(levels) >> ${pin}) & 1u) << ${index}")
+        string(APPEND for_each " X(${index}, ${pin})")
+        math(EXPR index "${index} + 1")
+    endforeach()
+
+    string(REPLACE ";" ", " SWITCH_PINS_ARRAY "${pins_clean}")
+    if(contiguous)
+        math(EXPR low_mask "(1 << ${NUM_SWITCHES}) - 1" OUTPUT_FORMAT HEXADECIMAL)
+        set(SWITCH_SCAN_EXPR "((~(levels) >> ${first_pin}) & ${low_mask}u)")
+    else()
+        string(REPLACE ";" " | \\\n     " SWITCH_SCAN_EXPR "${scan_terms}")
+        set(SWITCH_SCAN_EXPR "(${SWITCH_SCAN_EXPR})")
+    endif()
+    set(SWITCH_FOR_EACH "${for_each}")
+
+    configure_file(${PICOMIDI_SWITCH_PINS_TEMPLATE} ${output} @ONLY)
+endfunction()
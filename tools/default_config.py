@@ -0,0 +1,263 @@
+#!/usr/bin/env python3
+# JSONプロファイル（設定ツールの「ファイルに保存」と同じ形）から default_config.h を生成する
+#
+# usage: default_config.py <profile.json> <default_config.h> --pins 2,3 [--ws2812-pin N]
+#
+# プロファイル:
+#   {
+#     "deviceInfo": {"numSwitches": 2, "version": 1},
+#     "configurations": [
+#       {"press": {"messages": [{"msgType": 1, "channel": 0, "param1": 0, "param2": 127}]},
+#        "release": {"messages": [...]}},
+#       ...
+#     ],
+#     // 以下は省略可（省略時はファームウェアのデフォルトと同じ）
+#     "pinMap": [2, 3],                          // 省略時はGPIO_PINS
+#     "pixelColors": [[0, 0, 4], ...],           // 状態毎のRGB（0-127）× 6
+#     "feedbackChannel": 15,                     // 0-15、127で無効
+#     "feedbackMaps": [{"msgType": 1, "number": 0, "switchNum": 0, "state": 2}, ...],
+#     "exclusiveGroups": [[0, 1, 2], ...]        // 排他グループ毎のスイッチ番号（2つ以上）
+#   }
+#
+# 出力はdevice_config_tの初期化子とchecksumで、picomidi.cはこれをフラッシュ（.rodata）に置いて
+# 初回起動でも書き込まずに使う。checksumは下のレイアウトで計算するので、picomidi.cの
+# device_config_tを変えたらここも合わせる（ホストビルドのdefault_configテストで検出される）。
+
+import argparse
+import json
+import os
+import struct
+import sys
+
+# picomidi.c と合わせる
+CONFIG_MAGIC = 0x4D494437
+MAX_SWITCHES = 16
+MAX_MESSAGES_PER_EVENT = 10
+MAX_FEEDBACK_MAPS = 32
+MAX_EXCLUSIVE_GROUPS = 8
+CONFIG_CHECKSUM_OFFSET = 1516            # offsetof(device_config_t, checksum)
+PIXEL_STATE_COUNT = 6
+PIXEL_STATE_HOST_1 = 2
+MIDI_MSG_NONE, MIDI_MSG_CC, MIDI_MSG_NOTE, MIDI_MSG_HID_CONSUMER = 0, 1, 3, 5
+FEEDBACK_CHANNEL_NONE = 0x7F
+RESERVED_PINS = {0, 1, 23, 24, 25, 29}   # UART、Pico基板内部、ボードのLED
+NUM_GPIO_PINS = 30
+
+DEFAULT_PIXEL_COLORS = [
+    [0, 0, 4], [0, 127, 0], [127, 0, 0], [0, 127, 0], [127, 80, 0], [0, 40, 127],
+]
+
+
+class ProfileError(Exception):
+    pass
+
+
+def check_range(value, low, high, what):
+    if not isinstance(value, int) or isinstance(value, bool) or value < low or value > high:
+        raise ProfileError(f"{what}: {value!r} is not in {low}-{high}")
+    return value
+
+
+def parse_message(msg, what):
+    if not isinstance(msg, dict):
+        raise ProfileError(f"{what}: not an object")
+    return (
+        check_range(msg.get("msgType"), 0, MIDI_MSG_HID_CONSUMER, f"{what}.msgType"),
+        check_range(msg.get("channel", 0), 0, 15, f"{what}.channel"),
+        check_range(msg.get("param1", 0), 0, 127, f"{what}.param1"),
+        check_range(msg.get("param2", 0), 0, 127, f"{what}.param2"),
+    )
+
+
+def parse_event(event, what):
+    messages = (event or {}).get("messages", [])
+    if not isinstance(messages, list) or len(messages) > MAX_MESSAGES_PER_EVENT:
+        raise ProfileError(f"{what}: up to {MAX_MESSAGES_PER_EVENT} messages")
+    return [parse_message(m, f"{what}.messages[{i}]") for i, m in enumerate(messages)]
+
+
+def default_event(switch_idx, press):
+    return [(MIDI_MSG_CC, 0, switch_idx % 128, 127 if press else 0)]
+
+
+def parse_profile(profile, build_pins, ws2812_pin):
+    configurations = profile.get("configurations")
+    if not isinstance(configurations, list) or not 1 <= len(configurations) <= MAX_SWITCHES:
+        raise ProfileError(f"configurations: 1-{MAX_SWITCHES} switches required")
+    count = len(configurations)
+
+    info = profile.get("deviceInfo") or {}
+    if "numSwitches" in info and info["numSwitches"] != count:
+        raise ProfileError(f"deviceInfo.numSwitches ({info['numSwitches']}) != {count} configurations")
+
+    if "pinMap" in profile:
+        pins = profile["pinMap"]
+        reserved = RESERVED_PINS | ({ws2812_pin} if ws2812_pin is not None else set())
+        if not isinstance(pins, list) or len(pins) != count:
+            raise ProfileError(f"pinMap: {count} pins required")
+        for pin in pins:
+            check_range(pin, 0, NUM_GPIO_PINS - 1, "pinMap")
+            if pin in reserved:
+                raise ProfileError(f"pinMap: GP{pin} is reserved")
+        if len(set(pins)) != count:
+            raise ProfileError("pinMap: duplicate pins")
+    else:
+        if len(build_pins) != count:
+            raise ProfileError(f"{count} configurations but GPIO_PINS has {len(build_pins)} pins (add pinMap)")
+        pins = build_pins
+
+    events = []
+    for i in range(MAX_SWITCHES):
+        if i < count:
+            sw = configurations[i]
+            if not isinstance(sw, dict):
+                raise ProfileError(f"configurations[{i}]: not an object")
+            events.append(parse_event(sw.get("press"), f"configurations[{i}].press"))
+            events.append(parse_event(sw.get("release"), f"configurations[{i}].release"))
+        else:
+            # ピン割り当てでスイッチを増やした場合のデフォルト（init_default_config()と同じ）
+            events.append(default_event(i, True))
+            events.append(default_event(i, False))
+
+    colors = profile.get("pixelColors", DEFAULT_PIXEL_COLORS)
+    if not isinstance(colors, list) or len(colors) != PIXEL_STATE_COUNT:
+        raise ProfileError(f"pixelColors: {PIXEL_STATE_COUNT} colors required")
+    for i, rgb in enumerate(colors):
+        if not isinstance(rgb, list) or len(rgb) != 3:
+            raise ProfileError(f"pixelColors[{i}]: [r, g, b] required")
+        for c in rgb:
+            check_range(c, 0, 127, f"pixelColors[{i}]")
+
+    channel = profile.get("feedbackChannel", 15)
+    if channel != FEEDBACK_CHANNEL_NONE:
+        check_range(channel, 0, 15, "feedbackChannel")
+
+    if "feedbackMaps" in profile:
+        maps = profile["feedbackMaps"]
+        if not isinstance(maps, list) or len(maps) > MAX_FEEDBACK_MAPS:
+            raise ProfileError(f"feedbackMaps: up to {MAX_FEEDBACK_MAPS} entries")
+        feedback = []
+        for i, m in enumerate(maps):
+            what = f"feedbackMaps[{i}]"
+            if not isinstance(m, dict):
+                raise ProfileError(f"{what}: not an object")
+            msg_type = m.get("msgType")
+            if msg_type not in (MIDI_MSG_NONE, MIDI_MSG_CC, MIDI_MSG_NOTE):
+                raise ProfileError(f"{what}.msgType: 0 (none), 1 (CC) or 3 (Note)")
+            feedback.append((msg_type,
+                             check_range(m.get("number"), 0, 127, f"{what}.number"),
+                             check_range(m.get("switchNum"), 0, count - 1, f"{what}.switchNum"),
+                             check_range(m.get("state"), PIXEL_STATE_HOST_1, PIXEL_STATE_COUNT - 1, f"{what}.state")))
+    else:
+        feedback = [(MIDI_MSG_CC, i, i, PIXEL_STATE_HOST_1) for i in range(count)]
+    feedback += [(0, 0, 0, 0)] * (MAX_FEEDBACK_MAPS - len(feedback))
+
+    groups = profile.get("exclusiveGroups", [])
+    if not isinstance(groups, list) or len(groups) > MAX_EXCLUSIVE_GROUPS:
+        raise ProfileError(f"exclusiveGroups: up to {MAX_EXCLUSIVE_GROUPS} groups")
+    masks = []
+    for i, members in enumerate(groups):
+        what = f"exclusiveGroups[{i}]"
+        if not isinstance(members, list) or len(set(members)) != len(members) or len(members) < 2:
+            raise ProfileError(f"{what}: 2 or more different switches required")
+        masks.append(sum(1 << check_range(sw, 0, count - 1, what) for sw in members))
+    masks += [0] * (MAX_EXCLUSIVE_GROUPS - len(masks))
+
+    return count, pins, events, colors, channel, feedback, masks
+
+
+# device_config_t のバイト列（メンバーはすべて固定幅なので arm-none-eabi / x86-64 とも同じ配置。
+# picomidi.c の _Static_assert で checksum の位置を確かめている）
+#   magic(4) num_switches(1)
+#   events[32]: message_count(1) messages[10]: msg_type channel param1 param2
+#   pixel_colors(18) feedback_channel(1) feedback_maps(32 * 4) pin_map(16) generation(4)
+#   debounce_ms(16) exclusive_groups(8 * 2) checksum(4)
+def config_image(count, pins, events, colors, channel, feedback, groups):
+    data = bytearray(struct.pack("<IB", CONFIG_MAGIC, count))
+    for messages in events:
+        data.append(len(messages))
+        for i in range(MAX_MESSAGES_PER_EVENT):
+            data += bytes(messages[i] if i < len(messages) else (0, 0, 0, 0))
+    for rgb in colors:
+        data += bytes(rgb)
+    data.append(channel)
+    for entry in feedback:
+        data += bytes(entry)
+    data += bytes(pins) + bytes(MAX_SWITCHES - len(pins))
+    while len(data) % 4:
+        data.append(0)
+    data += struct.pack("<I", 0)  # generation: 初期設定はどのスロットの設定よりも古い
+    data += bytes(MAX_SWITCHES)   # debounce_ms: 未学習
+    data += struct.pack(f"<{MAX_EXCLUSIVE_GROUPS}H", *groups)
+    assert len(data) == CONFIG_CHECKSUM_OFFSET
+    return bytes(data)
+
+
+def calculate_checksum(data):
+    # picomidi.c の calculate_checksum_bytes() と同じ
+    crc = 0x12345678
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xEDB88320 if crc & 1 else crc >> 1
+    return crc
+
+
+def c_list(items):
+    return "{" + ", ".join(items) + "}"
+
+
+def write_header(path, source, count, pins, events, colors, channel, feedback, groups, checksum):
+    event_lines = []
+    for messages in events:
+        body = c_list(c_list(str(v) for v in m) for m in messages) if messages else "{{0}}"
+        event_lines.append(f"    {{{len(messages)}, {body}}}")
+
+    lines = [
+        f"// Generated by tools/default_config.py from {os.path.basename(source)}. Do not edit.",
+        "#ifndef DEFAULT_CONFIG_H",
+        "#define DEFAULT_CONFIG_H",
+        "",
+        f"#define DEFAULT_CONFIG_NUM_SWITCHES {count}",
+        f"#define DEFAULT_CONFIG_PIN_MAP {c_list(str(p) for p in pins)}",
+        "#define DEFAULT_CONFIG_EVENTS { \\",
+        ", \\\n".join(event_lines) + " \\",
+        "}",
+        f"#define DEFAULT_CONFIG_PIXEL_COLORS {c_list(c_list(str(c) for c in rgb) for rgb in colors)}",
+        f"#define DEFAULT_CONFIG_FEEDBACK_CHANNEL {channel}",
+        f"#define DEFAULT_CONFIG_FEEDBACK_MAPS {c_list(c_list(str(v) for v in m) for m in feedback)}",
+        f"#define DEFAULT_CONFIG_EXCLUSIVE_GROUPS {c_list(f'0x{m:04X}' for m in groups)}",
+        f"#define DEFAULT_CONFIG_CHECKSUM 0x{checksum:08X}u",
+        "",
+        "#endif // DEFAULT_CONFIG_H",
+        "",
+    ]
+    with open(path, "w", encoding="utf-8") as f:
+        f.write("\n".join(lines))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate default_config.h from a JSON profile")
+    parser.add_argument("profile")
+    parser.add_argument("output")
+    parser.add_argument("--pins", required=True, help="GPIO_PINS (comma-separated)")
+    parser.add_argument("--ws2812-pin", type=int)
+    args = parser.parse_args()
+
+    try:
+        with open(args.profile, encoding="utf-8") as f:
+            profile = json.load(f)
+        if not isinstance(profile, dict):
+            raise ProfileError("profile must be a JSON object")
+        build_pins = [int(p) for p in args.pins.split(",")]
+        count, pins, events, colors, channel, feedback, groups = parse_profile(profile, build_pins, args.ws2812_pin)
+    except (OSError, ValueError, ProfileError) as e:
+        sys.exit(f"{args.profile}: {e}")
+
+    image = config_image(count, pins, events, colors, channel, feedback, groups)
+    checksum = calculate_checksum(image)
+    write_header(args.output, args.profile, count, pins, events, colors, channel, feedback, groups, checksum)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,4 +1,5 @@
 #include "tusb.h"
+#include "usb_descriptors.h"
 
 //--------------------------------------------------------------------+
 // Device Descriptors
@@ -17,7 +18,7 @@ tusb_desc_device_t const desc_device =
 
     .idVendor           = 0xCafe,
     .idProduct          = 0x4011,
-    .bcdDevice          = 0x0100,
+    .bcdDevice          = 0x0200, // MIDI + HID composite
 
     .iManufacturer      = 0x01,
     .iProduct           = 0x02,
@@ -33,6 +34,25 @@ uint8_t const * tud_descriptor_device_cb(void)
   return (uint8_t const *) &desc_device;
 }
 
+//--------------------------------------------------------------------+
+// HID Report Descriptor
+//--------------------------------------------------------------------+
+
+uint8_t const desc_hid_report[] =
+{
+  TUD_HID_REPORT_DESC_KEYBOARD( HID_REPORT_ID(REPORT_ID_KEYBOARD         )),
+  TUD_HID_REPORT_DESC_CONSUMER( HID_REPORT_ID(REPORT_ID_CONSUMER_CONTROL ))
+};
+
+// Invoked when received GET HID REPORT DESCRIPTOR
+// Application return pointer to descriptor
+// Descriptor contents must exist long enough for transfer to complete
+uint8_t const * tud_hid_descriptor_report_cb(uint8_t instance)
+{
+  (void) instance;
+  return desc_hid_report;
+}
+
 //--------------------------------------------------------------------+
 // Configuration Descriptor
 //--------------------------------------------------------------------+
@@ -41,13 +61,18 @@ enum
 {
   ITF_NUM_MIDI = 0,
   ITF_NUM_MIDI_STREAMING,
+  ITF_NUM_HID,
   ITF_NUM_TOTAL
 };
 
-#define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_MIDI_DESC_LEN)
+#define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_MIDI_DESC_LEN + TUD_HID_DESC_LEN)
 
 #define EPNUM_MIDI_OUT   0x01
 #define EPNUM_MIDI_IN    0x81
+#define EPNUM_HID        0x82
+
+// HIDのポーリング間隔（ms）。MIDIと同等のレイテンシにするため最短の1ms
+#define HID_POLL_INTERVAL_MS  1
 
 uint8_t const desc_configuration[] =
 {
@@ -56,6 +81,9 @@ uint8_t const desc_configuration[] =
 
   // Interface number, string index, EP Out & EP In address, EP size
   TUD_MIDI_DESCRIPTOR(ITF_NUM_MIDI, 0, EPNUM_MIDI_OUT, EPNUM_MIDI_IN, 64),
+
+  // Interface number, string index, protocol, report descriptor len, EP In address, size & polling interval
+  TUD_HID_DESCRIPTOR(ITF_NUM_HID, 0, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), EPNUM_HID, CFG_TUD_HID_EP_BUFSIZE, HID_POLL_INTERVAL_MS),
 };
 
 #if TUD_OPT_HIGH_SPEED
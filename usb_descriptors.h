@@ -0,0 +1,12 @@
+#ifndef USB_DESCRIPTORS_H_
+#define USB_DESCRIPTORS_H_
+
+// HIDレポートID（キーボードとコンシューマーコントロールを1インターフェースで扱う）
+enum
+{
+  REPORT_ID_KEYBOARD = 1,
+  REPORT_ID_CONSUMER_CONTROL,
+  REPORT_ID_COUNT
+};
+
+#endif /* USB_DESCRIPTORS_H_ */
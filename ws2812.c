@@ -0,0 +1,80 @@
+#include "ws2812.h"
+
+#include <string.h>
+
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/timer.h"
+#include "ws2812.pio.h"
+
+#define WS2812_FREQ 800000
+#define WS2812_PIXEL_US 30      // 1ピクセル(24bit)の転送時間 [us]
+#define WS2812_RESET_US 300     // ラッチに必要なLow期間（新しいWS2812Bは280us以上）
+
+static PIO ws2812_pio = pio0;
+static uint ws2812_sm;
+static int ws2812_dma = -1;
+static uint8_t ws2812_count = 0;
+
+// CPUが書き換えるフレームと、DMAが読み出すフレーム
+static uint32_t framebuffer[WS2812_MAX_PIXELS];
+static uint32_t dma_buffer[WS2812_MAX_PIXELS];
+static bool framebuffer_dirty = false;
+static uint32_t last_transfer_start = 0;
+static uint32_t transfer_time_us = 0;
+
+bool ws2812_init(uint8_t pin, uint8_t count) {
+    if (count > WS2812_MAX_PIXELS) count = WS2812_MAX_PIXELS;
+    
+    if (!pio_can_add_program(ws2812_pio, &ws2812_program)) {
+        return false;
+    }
+    int sm = pio_claim_unused_sm(ws2812_pio, false);
+    if (sm < 0) {
+        return false;
+    }
+    ws2812_sm = (uint)sm;
+    uint offset = pio_add_program(ws2812_pio, &ws2812_program);
+    ws2812_program_init(ws2812_pio, ws2812_sm, offset, pin, WS2812_FREQ);
+    
+    ws2812_dma = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(ws2812_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(ws2812_pio, ws2812_sm, true));
+    dma_channel_configure(ws2812_dma, &c, &ws2812_pio->txf[ws2812_sm], dma_buffer, count, false);
+    
+    ws2812_count = count;
+    transfer_time_us = (uint32_t)count * WS2812_PIXEL_US + WS2812_RESET_US;
+    
+    // 起動時は全消灯を一度送る
+    memset(framebuffer, 0, sizeof(framebuffer));
+    framebuffer_dirty = true;
+    return true;
+}
+
+void ws2812_set_pixel(uint8_t index, uint8_t r, uint8_t g, uint8_t b) {
+    if (index >= ws2812_count) return;
+    
+    uint32_t grb = ((uint32_t)g << 24) | ((uint32_t)r << 16) | ((uint32_t)b << 8);
+    if (framebuffer[index] != grb) {
+        framebuffer[index] = grb;
+        framebuffer_dirty = true;
+    }
+}
+
+void ws2812_task(void) {
+    if (!framebuffer_dirty || ws2812_dma < 0) return;
+    
+    // 前回のフレームがシフトアウトされてラッチされるまで待つ（ブロックはしない）
+    if (dma_channel_is_busy(ws2812_dma) ||
+        time_us_32() - last_transfer_start < transfer_time_us) {
+        return;
+    }
+    
+    memcpy(dma_buffer, framebuffer, ws2812_count * sizeof(uint32_t));
+    framebuffer_dirty = false;
+    last_transfer_start = time_us_32();
+    dma_channel_transfer_from_buffer_now(ws2812_dma, dma_buffer, ws2812_count);
+}
@@ -0,0 +1,21 @@
+#ifndef WS2812_H
+#define WS2812_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// スイッチ毎のWS2812 RGB LEDチェーン
+// フレームバッファをDMAでPIOに流し込むのでCPUはビットを生成しない。
+// ピクセルが変化したときだけ次のws2812_task()で転送する。
+
+#define WS2812_MAX_PIXELS 16
+
+bool ws2812_init(uint8_t pin, uint8_t count);
+
+// 変化があった場合のみフレームをdirtyにする
+void ws2812_set_pixel(uint8_t index, uint8_t r, uint8_t g, uint8_t b);
+
+// dirtyなフレームがあり、前回の転送とリセット期間が終わっていれば転送を開始する
+void ws2812_task(void);
+
+#endif // WS2812_H